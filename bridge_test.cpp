@@ -0,0 +1,346 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    HPS-to-FPGA bridge self-test
+//!
+//! \file
+//!    bridge_test.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bridge_test.hpp"
+
+//!
+//! \brief
+//!    Test pattern
+//!
+//! \param[in] i
+//!    Word index
+//!
+//! \param[in] pass
+//!    Test pass.  Odd passes use the complement of the pattern so that every
+//!    data bit is driven both ways.
+//!
+
+static inline uint32_t pattern(uint32_t i, int pass) {
+    uint32_t v = (i * 0x9e3779b9) ^ (i << 16) ^ 0xa5a5a5a5;
+    return (pass & 1) ? ~v : v;
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+bridge_test_t::bridge_test_t(fpga_io_t &io) :
+    io(io),
+    gpio(false),
+    gpio_mask(0),
+    failed(false) {
+    lw.enabled  = false;
+    h2f.enabled = false;
+}
+
+//!
+//! \brief
+//!    Read the self-test configuration file.
+//!
+//! \param[in] filename
+//!    Name of the configuration file.
+//!
+//! \returns
+//!    True if the configuration is valid.
+//!
+
+bool bridge_test_t::configure(const char *filename) {
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    char line[256];
+    for (int lineno = 1; fgets(line, sizeof(line), fp); lineno++) {
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = 0;
+        }
+
+        char key[64], arg1[64], arg2[64];
+        int n = sscanf(line, "%63s %63s %63s", key, arg1, arg2);
+        if (n <= 0) {
+            continue;
+        }
+
+        bool ok = false;
+        if ((n == 3) && ((strcmp(key, "lw") == 0) || (strcmp(key, "h2f") == 0))) {
+            region_t &region = (key[0] == 'l') ? lw : h2f;
+            uint32_t window  = (key[0] == 'l') ? fpga_io_t::lwh2f_size : fpga_io_t::h2f_size;
+            region.offset  = strtoul(arg1, NULL, 0);
+            region.size    = strtoul(arg2, NULL, 0);
+            region.enabled = true;
+            ok = ((region.offset & 3) == 0) && ((region.size & 3) == 0) && (region.size != 0) &&
+                 (region.offset < window) && (region.size <= window - region.offset);
+        } else if ((n == 2) && (strcmp(key, "gpio") == 0)) {
+            gpio_mask = strtoul(arg1, NULL, 0);
+            gpio = ok = true;
+        } else if ((n == 3) && ((strcmp(arg1, "min") == 0) || (strcmp(arg1, "max") == 0))) {
+            threshold_t threshold;
+            threshold.name  = key;
+            threshold.min   = (strcmp(arg1, "min") == 0);
+            threshold.value = strtod(arg2, NULL);
+            thresholds.push_back(threshold);
+            ok = true;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: %s:%d: invalid self-test item.\n", PROGNAME, filename, lineno);
+            fclose(fp);
+            return false;
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+//!
+//! \brief
+//!    Record a measurement.
+//!
+
+void bridge_test_t::measure(const char *name, double value) {
+    result_t result;
+    result.name  = name;
+    result.value = value;
+    results.push_back(result);
+}
+
+//!
+//! \brief
+//!    Measure the bandwidth and latency of a bridge.
+//!
+//! \details
+//!    Each pass writes the region one 32-bit word at a time and then reads
+//!    it back and verifies it.  The per-access times are the averages over
+//!    the region.  Bridge writes are posted, so the write time is the rate
+//!    at which the MPU can issue them.
+//!
+//! \param[in] name
+//!    Name of the bridge.
+//!
+//! \param[in] base
+//!    Address of the test region.
+//!
+//! \param[in] size
+//!    Size of the test region in bytes.
+//!
+
+void bridge_test_t::test_region(const char *name, volatile uint32_t *base, uint32_t size) {
+
+    const int passes = 2;
+    uint32_t words   = size / sizeof(uint32_t);
+    uint64_t wr_time = 0;
+    uint64_t rd_time = 0;
+    uint32_t errors  = 0;
+
+    for (int pass = 0; pass < passes; pass++) {
+
+        uint64_t start = now_ns();
+        for (uint32_t i = 0; i < words; i++) {
+            io.write_reg(&base[i], pattern(i, pass));
+        }
+        uint64_t middle = now_ns();
+        for (uint32_t i = 0; i < words; i++) {
+            if (io.read_reg(&base[i]) != pattern(i, pass)) {
+                errors += 1;
+            }
+        }
+        uint64_t stop = now_ns();
+
+        wr_time += middle - start;
+        rd_time += stop - middle;
+    }
+
+    double bytes = (double)passes * size;
+    char metric[64];
+
+    snprintf(metric, sizeof(metric), "%s.write_MBps", name);
+    measure(metric, bytes * 1e3 / wr_time);
+    snprintf(metric, sizeof(metric), "%s.read_MBps", name);
+    measure(metric, bytes * 1e3 / rd_time);
+    snprintf(metric, sizeof(metric), "%s.write_ns", name);
+    measure(metric, (double)wr_time / (passes * words));
+    snprintf(metric, sizeof(metric), "%s.read_ns", name);
+    measure(metric, (double)rd_time / (passes * words));
+    snprintf(metric, sizeof(metric), "%s.errors", name);
+    measure(metric, errors);
+
+    if (errors) {
+        fprintf(stderr, "%s: %s bridge: %u data mismatches.\n", PROGNAME, name, errors);
+        failed = true;
+    }
+}
+
+//!
+//! \brief
+//!    Measure the GPO to GPI loopback round trip time.
+//!
+//! \details
+//!    The design is expected to return the GPO bits in the mask on the GPI
+//!    bits.  A walking one and a walking zero are written to GPO and the time
+//!    until they appear on GPI is measured.  Only patterns that change a bit
+//!    in the mask are timed; the others would be returned at once and pull
+//!    the mean down.  The original GPO value is restored afterwards.
+//!
+
+void bridge_test_t::test_gpio(void) {
+
+    const uint64_t timeout = 1000000;
+    uint32_t saved  = io.read_reg(&io.fpgamgr_regs->gpo);
+    uint32_t last   = saved & gpio_mask;
+    uint64_t total  = 0;
+    uint64_t max    = 0;
+    unsigned count  = 0;
+
+    for (int bit = 0; bit < 64; bit++) {
+
+        uint32_t value = (bit < 32) ? (1u << bit) : ~(1u << (bit - 32));
+        value &= gpio_mask;
+        if (value == last) {
+            continue;
+        }
+        last = value;
+
+        io.write_reg(&io.fpgamgr_regs->gpo, value);
+        uint64_t start = now_ns();
+        uint64_t elapsed;
+        bool match;
+        do {
+            match   = (io.read_reg(&io.fpgamgr_regs->gpi) & gpio_mask) == value;
+            elapsed = now_ns() - start;
+        } while (!match && (elapsed < timeout));
+
+        if (!match) {
+            fprintf(stderr, "%s: gpio loopback: GPO 0x%08x not returned on GPI.\n", PROGNAME, value);
+            failed = true;
+            break;
+        }
+
+        total += elapsed;
+        max    = (elapsed > max) ? elapsed : max;
+        count += 1;
+    }
+
+    io.write_reg(&io.fpgamgr_regs->gpo, saved);
+
+    if (count) {
+        measure("gpio.rtt_ns", (double)total / count);
+        measure("gpio.rtt_max_ns", max);
+    }
+}
+
+//!
+//! \brief
+//!    Run the self-test.
+//!
+//! \details
+//!    The bridges must have been enabled.
+//!
+//! \param[in] quiet
+//!    Only report failures.
+//!
+//! \returns
+//!    <b>EXIT_SUCCESS</b> if every check passed and every threshold was met,
+//!    <b>EXIT_FAILURE</b> otherwise.
+//!
+
+int bridge_test_t::run(bool quiet) {
+
+    uint64_t start = now_ns();
+
+    if (lw.enabled) {
+        test_region("lw", (volatile uint32_t *)(io.lwh2f + lw.offset), lw.size);
+    }
+
+    if (h2f.enabled) {
+        uint8_t *addr = io.map_h2f(h2f.offset, h2f.size);
+        if (addr) {
+            test_region("h2f", (volatile uint32_t *)addr, h2f.size);
+            io.unmap_h2f(addr, h2f.size);
+        } else {
+            failed = true;
+        }
+    }
+
+    if (gpio) {
+        test_gpio();
+    }
+
+    uint64_t elapsed = now_ns() - start;
+
+    //
+    // Report the measurements and compare them against the thresholds
+    //
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!quiet) {
+            printf("%s: self-test %-18s %12.1f\n", PROGNAME, results[i].name.c_str(), results[i].value);
+        }
+    }
+
+    for (size_t i = 0; i < thresholds.size(); i++) {
+        const threshold_t &threshold = thresholds[i];
+        size_t j;
+        for (j = 0; j < results.size(); j++) {
+            if (results[j].name == threshold.name) {
+                break;
+            }
+        }
+        if (j == results.size()) {
+            fprintf(stderr, "%s: self-test %s was not measured.\n", PROGNAME, threshold.name.c_str());
+            failed = true;
+        } else if (threshold.min ? (results[j].value < threshold.value) : (results[j].value > threshold.value)) {
+            fprintf(stderr, "%s: self-test %s is %.1f, %s is %.1f.\n", PROGNAME, threshold.name.c_str(),
+                    results[j].value, threshold.min ? "minimum" : "maximum", threshold.value);
+            failed = true;
+        }
+    }
+
+    if (!quiet) {
+        printf("%s: self-test %s in %.3f ms\n", PROGNAME, failed ? "failed" : "passed", elapsed * 1e-6);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
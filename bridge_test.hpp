@@ -0,0 +1,130 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    HPS-to-FPGA bridge self-test header file
+//!
+//! \details
+//!    This object measures the bandwidth and latency of the HPS-to-FPGA
+//!    bridges and the GPO to GPI loopback of a freshly loaded design and
+//!    compares the results against stored thresholds.
+//!
+//! \file
+//!    bridge_test.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __BRIDGE_TEST_H
+#define __BRIDGE_TEST_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fpga_io.hpp"
+
+//!
+//! \brief
+//!    HPS-to-FPGA bridge self-test object
+//!
+//! \details
+//!    The self-test configuration file contains one item per line.  Blank
+//!    lines and text following a '#' are ignored.
+//!
+//!    - <tt>lw offset size</tt> tests the lightweight HPS-to-FPGA bridge
+//!      using the RAM in the design at the offset into the bridge window.
+//!    - <tt>h2f offset size</tt> tests the HPS-to-FPGA bridge the same way.
+//!    - <tt>gpio mask</tt> tests the GPO to GPI loopback of the bits in the
+//!      mask.
+//!    - <tt>metric min value</tt> or <tt>metric max value</tt> sets a
+//!      threshold on a measurement.
+//!
+//!    The measurements are <tt>lw.write_MBps</tt>, <tt>lw.read_MBps</tt>,
+//!    <tt>lw.write_ns</tt>, <tt>lw.read_ns</tt>, <tt>lw.errors</tt>, the
+//!    same for <tt>h2f</tt>, <tt>gpio.rtt_ns</tt> and
+//!    <tt>gpio.rtt_max_ns</tt>.  Any data mismatch or loopback timeout fails
+//!    the test regardless of the thresholds.
+//!
+
+class bridge_test_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    Test region in a bridge window
+        //!
+
+        struct region_t {
+            bool     enabled;                   //!< Region is tested
+            uint32_t offset;                    //!< Offset into the bridge window
+            uint32_t size;                      //!< Size of the region in bytes
+        };
+
+        //!
+        //! \brief
+        //!    Threshold on a measurement
+        //!
+
+        struct threshold_t {
+            std::string name;                   //!< Measurement name
+            bool        min;                    //!< Lower limit, otherwise upper limit
+            double      value;                  //!< Limit
+        };
+
+        //!
+        //! \brief
+        //!    Measurement
+        //!
+
+        struct result_t {
+            std::string name;                   //!< Measurement name
+            double      value;                  //!< Measured value
+        };
+
+        fpga_io_t &io;                          //!< HPS register access
+        region_t lw;                            //!< Lightweight bridge test region
+        region_t h2f;                           //!< HPS-to-FPGA bridge test region
+        bool gpio;                              //!< GPO to GPI loopback is tested
+        uint32_t gpio_mask;                     //!< Bits that are looped back
+        bool failed;                            //!< A functional check failed
+        std::vector<threshold_t> thresholds;    //!< Thresholds
+        std::vector<result_t> results;          //!< Measurements
+
+        void measure(const char *name, double value);
+        void test_region(const char *name, volatile uint32_t *base, uint32_t size);
+        void test_gpio(void);
+
+    public:
+
+        bridge_test_t(fpga_io_t &io);
+        bool configure(const char *filename);
+        int run(bool quiet);
+
+};
+
+#endif
@@ -0,0 +1,249 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA device lock
+//!
+//! \file
+//!    device_lock.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/time.h>
+
+#include "fpga_loader.hpp"
+#include "device_lock.hpp"
+
+//!
+//! \brief
+//!    SIGALRM handler.  This only interrupts the blocking lock call.
+//!
+
+static void sigalrm_handler(int) {
+}
+
+//!
+//! \brief
+//!    Acquire or test the lock.
+//!
+//! \param[in] fd
+//!    Lock file descriptor.
+//!
+//! \param[in] wait
+//!    Block until the lock is available.
+//!
+//! \returns
+//!    Zero on success, otherwise -1 with errno set.  EWOULDBLOCK means that
+//!    the lock is held by another process.
+//!
+
+static int acquire(int fd, bool wait) {
+#ifdef F_OFD_SETLKW
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type   = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    int ret = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &fl);
+    if ((ret == 0) || (errno != EINVAL)) {
+        if ((ret < 0) && (errno == EACCES)) {
+            errno = EWOULDBLOCK;
+        }
+        return ret;
+    }
+#endif
+    return flock(fd, wait ? LOCK_EX : (LOCK_EX | LOCK_NB));
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+device_lock_t::device_lock_t(void) :
+    fd(-1),
+    holder(0),
+    wait_ns(0) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+device_lock_t::~device_lock_t(void) {
+    unlock();
+}
+
+//!
+//! \brief
+//!    Read the PID of the holder from the lock file.
+//!
+
+pid_t device_lock_t::read_holder(void) {
+    char buf[32];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = 0;
+    return (pid_t)strtol(buf, NULL, 10);
+}
+
+//!
+//! \brief
+//!    Acquire the device lock.
+//!
+//! \param[in] path
+//!    Lock file.
+//!
+//! \param[in] timeout
+//!    Maximum time to wait in seconds.  Zero waits forever.
+//!
+//! \param[in] quiet
+//!    Suppress the message that is printed when the lock is busy.
+//!
+//! \returns
+//!    True if the lock was acquired.
+//!
+
+bool device_lock_t::lock(const char *path, unsigned int timeout, bool quiet) {
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to open lock file \"%s\": %s\n", PROGNAME, path, strerror(errno));
+        return false;
+    }
+
+    uint64_t start = now_ns();
+
+    //
+    // Try once without blocking so that the holder can be reported
+    //
+
+    if (acquire(fd, false) != 0) {
+
+        if (errno != EWOULDBLOCK) {
+            fprintf(stderr, "%s: unable to lock \"%s\": %s\n", PROGNAME, path, strerror(errno));
+            unlock();
+            return false;
+        }
+
+        holder = read_holder();
+
+        //
+        // The lock is held for us by the process that ran us
+        //
+
+        const char *env = getenv(LOCKHOLDER);
+        if (env && (holder > 0) && (strtol(env, NULL, 10) == holder) && (kill(holder, 0) == 0)) {
+            unlock();
+            holder = 0;
+            return true;
+        }
+
+        if (!quiet) {
+            printf("%s: waiting for the FPGA, held by pid %d.\n", PROGNAME, (int)holder);
+        }
+
+        //
+        // Queue for the lock.  The alarm interrupts the wait.
+        //
+
+        struct sigaction sa, old_sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sigalrm_handler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGALRM, &sa, &old_sa);
+
+        struct itimerval timer, old_timer;
+        memset(&timer, 0, sizeof(timer));
+        timer.it_value.tv_sec = timeout;
+        setitimer(ITIMER_REAL, &timer, &old_timer);
+
+        int ret = acquire(fd, true);
+        int err = errno;
+
+        //
+        // Put back the caller's timer, less the time spent waiting, and
+        // its SIGALRM action.  A timer that would have expired during the
+        // wait fires as soon as possible.
+        //
+
+        if (old_timer.it_value.tv_sec || old_timer.it_value.tv_usec) {
+            uint64_t left_us = old_timer.it_value.tv_sec * 1000000ULL + old_timer.it_value.tv_usec;
+            uint64_t waited_us = (now_ns() - start) / 1000;
+            left_us = (left_us > waited_us) ? left_us - waited_us : 1;
+            old_timer.it_value.tv_sec  = left_us / 1000000;
+            old_timer.it_value.tv_usec = left_us % 1000000;
+        }
+        setitimer(ITIMER_REAL, &old_timer, NULL);
+        sigaction(SIGALRM, &old_sa, NULL);
+
+        if (ret != 0) {
+            if (err == EINTR) {
+                fprintf(stderr, "%s: timeout waiting for the FPGA, held by pid %d.\n", PROGNAME, (int)read_holder());
+            } else {
+                fprintf(stderr, "%s: unable to lock \"%s\": %s\n", PROGNAME, path, strerror(err));
+            }
+            unlock();
+            return false;
+        }
+    }
+
+    wait_ns = now_ns() - start;
+
+    //
+    // Record the holder
+    //
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%d\n", (int)getpid());
+    if ((ftruncate(fd, 0) != 0) || (pwrite(fd, buf, len, 0) != len)) {
+        fprintf(stderr, "%s: warning: unable to record pid in \"%s\".\n", PROGNAME, path);
+    }
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Release the device lock.
+//!
+
+void device_lock_t::unlock(void) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
@@ -0,0 +1,112 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA device lock header file
+//!
+//! \details
+//!    This object serializes access to the FPGA Manager between concurrent
+//!    loader processes.
+//!
+//! \file
+//!    device_lock.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __DEVICE_LOCK_H
+#define __DEVICE_LOCK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LOCKFILE "/var/lock/fpga_loader.lock"
+#define LOCKHOLDER "FPGA_LOADER_LOCK_HOLDER"
+
+//!
+//! \brief
+//!    FPGA device lock object
+//!
+//! \details
+//!    The lock is an advisory open file description (OFD) write lock on a
+//!    lock file, with a fallback to flock() on kernels without OFD locks.
+//!    Both kinds of lock are released by the kernel when the holder exits,
+//!    so a crashed loader never leaves the device locked.  Blocked waiters
+//!    are queued by the kernel.
+//!
+//!    The holder writes its PID into the lock file so that waiters can
+//!    report who they are waiting for.
+//!
+//!    A holder that runs other commands under the lock, like "sequence"
+//!    running its tests, sets FPGA_LOADER_LOCK_HOLDER to its PID.  A lock
+//!    that is held by that PID is then taken to be held by the command
+//!    too, so a test can run "fpga_loader io" without deadlocking.
+//!
+
+class device_lock_t {
+
+    private:
+
+        int fd;                                 //!< Lock file descriptor
+        pid_t holder;                           //!< PID of the holder when we had to wait
+        uint64_t wait_ns;                       //!< Time spent waiting for the lock
+
+        pid_t read_holder(void);
+
+    public:
+
+        device_lock_t(void);
+        ~device_lock_t(void);
+        bool lock(const char *path, unsigned int timeout, bool quiet);
+        void unlock(void);
+
+        //!
+        //! \brief
+        //!    PID of the process that held the lock when lock() was called.
+        //!
+        //! \returns
+        //!    PID or zero if the lock was free.
+        //!
+
+        pid_t waited_for(void) const {
+            return holder;
+        }
+
+        //!
+        //! \brief
+        //!    Time spent waiting for the lock.
+        //!
+        //! \returns
+        //!    Wait time in nanoseconds.
+        //!
+
+        uint64_t wait_time(void) const {
+            return wait_ns;
+        }
+
+};
+
+#endif
@@ -0,0 +1,275 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fabric memory initialization
+//!
+//! \file
+//!    fabric_mem.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "fabric_mem.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+fabric_mem_t::fabric_mem_t(fpga_io_t &io) :
+    io(io) {
+}
+
+//!
+//! \brief
+//!    Add a memory image.
+//!
+//! \param[in] spec
+//!    <tt>offset:file</tt>
+//!
+//! \returns
+//!    True if the image can be written.
+//!
+
+bool fabric_mem_t::add(const char *spec) {
+
+    char *end;
+    unsigned long offset = strtoul(spec, &end, 0);
+    if ((end == spec) || (*end != ':') || (end[1] == 0)) {
+        fprintf(stderr, "%s: invalid memory image \"%s\".  Use offset:file.\n", PROGNAME, spec);
+        return false;
+    }
+
+    region_t region;
+    region.offset   = offset;
+    region.filename = end + 1;
+    region.image    = rbf_image_t::open(region.filename.c_str());
+    if (!region.image.valid()) {
+        return false;
+    }
+
+    if (((offset & 3) != 0) || ((region.image.size() & 3) != 0)) {
+        fprintf(stderr, "%s: %s: offset and size must be whole 32-bit words.\n", PROGNAME,
+                region.filename.c_str());
+        return false;
+    }
+
+    if ((offset >= fpga_io_t::h2f_size) || (region.image.size() > fpga_io_t::h2f_size - offset)) {
+        fprintf(stderr, "%s: %s: does not fit in the hps2fpga window at offset 0x%08lx.\n", PROGNAME,
+                region.filename.c_str(), offset);
+        return false;
+    }
+
+    regions.push_back(std::move(region));
+    return true;
+}
+
+//!
+//! \brief
+//!    Copy words to the bridge.
+//!
+//! \details
+//!    Every store is a whole, aligned 32-bit or 128-bit access, which the
+//!    bridge turns into bursts.  memcpy() is not used because it may use
+//!    byte or unaligned accesses, which device memory does not allow.
+//!
+//! \param[in] dst
+//!    Destination in the bridge window.  This must be 4-byte aligned.
+//!
+//! \param[in] src
+//!    Source words.
+//!
+//! \param[in] words
+//!    Number of 32-bit words.
+//!
+
+void fabric_mem_t::copy(volatile uint32_t *dst, const uint32_t *src, size_t words) {
+
+#if defined(__ARM_NEON)
+
+    //
+    // 64-byte bursts once the destination is 16-byte aligned
+    //
+
+    while (words && ((uintptr_t)dst & 15)) {
+        *dst++ = *src++;
+        words--;
+    }
+    for (; words >= 16; words -= 16) {
+        uint32x4_t a = vld1q_u32(src + 0);
+        uint32x4_t b = vld1q_u32(src + 4);
+        uint32x4_t c = vld1q_u32(src + 8);
+        uint32x4_t d = vld1q_u32(src + 12);
+        vst1q_u32((uint32_t *)dst + 0,  a);
+        vst1q_u32((uint32_t *)dst + 4,  b);
+        vst1q_u32((uint32_t *)dst + 8,  c);
+        vst1q_u32((uint32_t *)dst + 12, d);
+        src += 16;
+        dst += 16;
+    }
+
+#else
+
+    for (; words >= 8; words -= 8) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = src[3];
+        dst[4] = src[4];
+        dst[5] = src[5];
+        dst[6] = src[6];
+        dst[7] = src[7];
+        src += 8;
+        dst += 8;
+    }
+
+#endif
+
+    while (words--) {
+        *dst++ = *src++;
+    }
+}
+
+//!
+//! \brief
+//!    Copy words from the bridge.
+//!
+//! \details
+//!    This is the reverse of copy().  Bridge reads are not posted, so wide
+//!    loads matter even more here: each one is a single burst.
+//!
+//! \param[out] dst
+//!    Destination words.
+//!
+//! \param[in] src
+//!    Source in the bridge window.  This must be 4-byte aligned.
+//!
+//! \param[in] words
+//!    Number of 32-bit words.
+//!
+
+void fabric_mem_t::fetch(uint32_t *dst, const volatile uint32_t *src, size_t words) {
+
+#if defined(__ARM_NEON)
+
+    while (words && ((uintptr_t)src & 15)) {
+        *dst++ = *src++;
+        words--;
+    }
+    for (; words >= 16; words -= 16) {
+        uint32x4_t a = vld1q_u32((const uint32_t *)src + 0);
+        uint32x4_t b = vld1q_u32((const uint32_t *)src + 4);
+        uint32x4_t c = vld1q_u32((const uint32_t *)src + 8);
+        uint32x4_t d = vld1q_u32((const uint32_t *)src + 12);
+        vst1q_u32(dst + 0,  a);
+        vst1q_u32(dst + 4,  b);
+        vst1q_u32(dst + 8,  c);
+        vst1q_u32(dst + 12, d);
+        src += 16;
+        dst += 16;
+    }
+
+#else
+
+    for (; words >= 8; words -= 8) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = src[3];
+        dst[4] = src[4];
+        dst[5] = src[5];
+        dst[6] = src[6];
+        dst[7] = src[7];
+        src += 8;
+        dst += 8;
+    }
+
+#endif
+
+    while (words--) {
+        *dst++ = *src++;
+    }
+}
+
+//!
+//! \brief
+//!    Write the memory images.
+//!
+//! \details
+//!    The bridges must have been enabled.
+//!
+//! \param[in] quiet
+//!    Only report failures.
+//!
+//! \returns
+//!    EXIT_SUCCESS if every image was written.
+//!
+
+int fabric_mem_t::run(bool quiet) {
+
+    uint64_t start = now_ns();
+    size_t total = 0;
+
+    for (size_t i = 0; i < regions.size(); i++) {
+
+        region_t &region = regions[i];
+        size_t size = region.image.size();
+
+        uint8_t *addr = io.map_h2f(region.offset, size);
+        if (!addr) {
+            return EXIT_FAILURE;
+        }
+
+        uint64_t t0 = now_ns();
+        copy((volatile uint32_t *)addr, region.image.words(), region.image.word_count());
+        double secs = (now_ns() - t0) * 1e-9;
+        io.unmap_h2f(addr, size);
+        total += size;
+
+        if (!quiet) {
+            printf("%s: wrote %s to h2f+0x%08x: %zu bytes in %.3f ms (%.1f MB/s)\n", PROGNAME,
+                   region.filename.c_str(), region.offset, size, secs * 1e3, size / secs / 1e6);
+        }
+    }
+
+    if (!quiet && (regions.size() > 1)) {
+        double secs = (now_ns() - start) * 1e-9;
+        printf("%s: wrote %zu memory images, %zu bytes in %.3f ms (%.1f MB/s)\n", PROGNAME,
+               regions.size(), total, secs * 1e3, total / secs / 1e6);
+    }
+
+    return EXIT_SUCCESS;
+}
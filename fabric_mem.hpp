@@ -0,0 +1,102 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fabric memory initialization header file
+//!
+//! \details
+//!    This object writes memory images into the FPGA design through the
+//!    HPS-to-FPGA bridge right after the FPGA has been configured.
+//!
+//! \file
+//!    fabric_mem.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FABRIC_MEM_H
+#define __FABRIC_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fpga_io.hpp"
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Fabric memory initialization object
+//!
+//! \details
+//!    Each memory image is given as <tt>offset:file</tt>, where the offset
+//!    is into the HPS-to-FPGA bridge window.  The files are opened and
+//!    checked before the FPGA is programmed so that a bad file does not
+//!    leave a half-initialized design.  After the bridges are enabled the
+//!    images are copied in order with wide stores: 64-byte NEON bursts on
+//!    ARM when NEON is available, otherwise unrolled 32-bit stores.  There
+//!    is no user-space DMA on the HPS, so the MPU does the copy.
+//!
+
+class fabric_mem_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    A memory image
+        //!
+
+        struct region_t {
+            uint32_t    offset;                 //!< Offset into the bridge window
+            std::string filename;               //!< Memory image file
+            rbf_image_t image;                  //!< Memory image
+        };
+
+        fpga_io_t &io;                          //!< HPS register access
+        std::vector<region_t> regions;          //!< Images in command line order
+
+    public:
+
+        fabric_mem_t(fpga_io_t &io);
+        bool add(const char *spec);
+        int run(bool quiet);
+        static void copy(volatile uint32_t *dst, const uint32_t *src, size_t words);
+        static void fetch(uint32_t *dst, const volatile uint32_t *src, size_t words);
+
+        //!
+        //! \brief
+        //!    Check whether there is anything to write.
+        //!
+
+        bool empty(void) const {
+            return regions.empty();
+        }
+
+};
+
+#endif
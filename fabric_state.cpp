@@ -0,0 +1,263 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fabric state save and restore
+//!
+//! \file
+//!    fabric_state.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fabric_mem.hpp"
+#include "fabric_state.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+fabric_state_t::fabric_state_t(fpga_io_t &io) :
+    io(io),
+    quiesce(false),
+    request(0),
+    acknowledge(0),
+    timeout_ms(1000),
+    requested(false),
+    start_ns(0),
+    quiesce_ns(0),
+    save_ns(0),
+    restore_ns(0),
+    window_ns(0),
+    bytes(0) {
+}
+
+//!
+//! \brief
+//!    Destructor.  This clears the request bits if the load failed after
+//!    they were set.
+//!
+
+fabric_state_t::~fabric_state_t(void) {
+    release();
+}
+
+//!
+//! \brief
+//!    Clear the request bits.
+//!
+
+void fabric_state_t::release(void) {
+    if (requested) {
+        io.write_reg(&io.fpgamgr_regs->gpo, io.read_reg(&io.fpgamgr_regs->gpo) & ~request);
+        requested = false;
+    }
+}
+
+//!
+//! \brief
+//!    Add a region to save.
+//!
+//! \param[in] spec
+//!    <tt>offset:size</tt>
+//!
+//! \returns
+//!    True if the region is valid.
+//!
+
+bool fabric_state_t::add(const char *spec) {
+
+    char *end;
+    unsigned long offset = strtoul(spec, &end, 0);
+    unsigned long size = 0;
+    if ((end != spec) && (*end == ':')) {
+        size = strtoul(end + 1, &end, 0);
+    }
+
+    if ((*end != 0) || (size == 0) || ((offset & 3) != 0) || ((size & 3) != 0) ||
+        (offset >= fpga_io_t::h2f_size) || (size > fpga_io_t::h2f_size - offset)) {
+        fprintf(stderr, "%s: invalid save region \"%s\".  Use offset:size in whole words inside the hps2fpga window.\n",
+                PROGNAME, spec);
+        return false;
+    }
+
+    region_t region;
+    region.offset = offset;
+    region.size   = size;
+    regions.push_back(std::move(region));
+    return true;
+}
+
+//!
+//! \brief
+//!    Set up the quiesce handshake.
+//!
+//! \param[in] spec
+//!    <tt>request:acknowledge[:timeout_ms]</tt> where request is a GPO mask
+//!    and acknowledge is a GPI mask.
+//!
+//! \returns
+//!    True if the handshake is valid.
+//!
+
+bool fabric_state_t::handshake(const char *spec) {
+
+    char *end;
+    request = strtoul(spec, &end, 0);
+    if ((end != spec) && (*end == ':')) {
+        acknowledge = strtoul(end + 1, &end, 0);
+        if (*end == ':') {
+            timeout_ms = strtoul(end + 1, &end, 0);
+        }
+    }
+
+    if ((*end != 0) || (request == 0) || (acknowledge == 0)) {
+        fprintf(stderr, "%s: invalid quiesce handshake \"%s\".  Use request:acknowledge[:timeout_ms].\n",
+                PROGNAME, spec);
+        return false;
+    }
+
+    quiesce = true;
+    return true;
+}
+
+//!
+//! \brief
+//!    Quiesce the old design and save its regions.
+//!
+
+bool fabric_state_t::pre_reset(void) {
+
+    start_ns = now_ns();
+
+    //
+    // Only a design that is running and was configured without errors has
+    // state worth saving
+    //
+
+    uint32_t mode = io.read_reg(&io.fpgamgr_regs->stat) & fpga_loader_t::mode;
+    if (mode != fpga_loader_t::mode_user) {
+        fprintf(stderr, "%s: the FPGA is not in user mode (mode %u).  There is no fabric state to save.\n", PROGNAME,
+                mode);
+        return false;
+    }
+
+    if (io.read_reg(&io.fpgamgr_regs->gpio_ext_porta) & fpga_loader_t::crc) {
+        fprintf(stderr, "%s: the FPGA reports a CRC error.  Its fabric state cannot be saved.\n", PROGNAME);
+        return false;
+    }
+
+    if (io.read_reg(io.rstmgr_brgmodrst) & fpga_io_t::hps2fpga) {
+        fprintf(stderr, "%s: the hps2fpga bridge is in reset.  There is no fabric state to save.\n", PROGNAME);
+        return false;
+    }
+
+    //
+    // Ask the design to stop and wait for it to agree
+    //
+
+    if (quiesce) {
+        io.write_reg(&io.fpgamgr_regs->gpo, io.read_reg(&io.fpgamgr_regs->gpo) | request);
+        requested = true;
+        while ((io.read_reg(&io.fpgamgr_regs->gpi) & acknowledge) != acknowledge) {
+            if (now_ns() - start_ns > timeout_ms * 1000000ULL) {
+                fprintf(stderr, "%s: the design did not acknowledge the quiesce request.\n", PROGNAME);
+                release();
+                return false;
+            }
+            io.wait_us(10);
+        }
+    }
+
+    quiesce_ns = now_ns() - start_ns;
+
+    //
+    // Read the regions
+    //
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        region_t &region = regions[i];
+        region.data = rbf_image_t::allocate(region.size, false);
+        uint8_t *addr = io.map_h2f(region.offset, region.size);
+        if (!region.data.valid() || !addr) {
+            io.unmap_h2f(addr, region.size);
+            release();
+            return false;
+        }
+        fabric_mem_t::fetch((uint32_t *)region.data.writable(), (const volatile uint32_t *)addr, region.size / 4);
+        io.unmap_h2f(addr, region.size);
+        bytes += region.size;
+    }
+
+    save_ns = now_ns() - start_ns - quiesce_ns;
+    return true;
+}
+
+//!
+//! \brief
+//!    Restore the regions into the new design and let it run.
+//!
+
+bool fabric_state_t::post_user_mode(void) {
+
+    uint64_t t0 = now_ns();
+    io.enable_bridges();
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        region_t &region = regions[i];
+        uint8_t *addr = io.map_h2f(region.offset, region.size);
+        if (!addr) {
+            return false;
+        }
+        fabric_mem_t::copy((volatile uint32_t *)addr, region.data.words(), region.size / 4);
+        io.unmap_h2f(addr, region.size);
+    }
+
+    release();
+
+    restore_ns = now_ns() - t0;
+    window_ns  = now_ns() - start_ns;
+    return true;
+}
+
+//!
+//! \brief
+//!    Print the timing of the save, reload and restore.
+//!
+
+void fabric_state_t::report(void) const {
+    double save_secs    = save_ns * 1e-9;
+    double restore_secs = restore_ns * 1e-9;
+    printf("%s: fabric state: quiesce %.3f ms, saved %zu bytes in %.3f ms (%.1f MB/s), "
+           "restored in %.3f ms (%.1f MB/s), %.3f ms from save to restore\n", PROGNAME,
+           quiesce_ns * 1e-6, bytes, save_secs * 1e3, save_secs ? bytes / save_secs / 1e6 : 0.0,
+           restore_secs * 1e3, restore_secs ? bytes / restore_secs / 1e6 : 0.0, window_ns * 1e-6);
+}
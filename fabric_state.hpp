@@ -0,0 +1,120 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fabric state save and restore header file
+//!
+//! \details
+//!    This object saves memories of the running design over the bridge
+//!    before a reload and writes them back into the new design.
+//!
+//! \file
+//!    fabric_state.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FABRIC_STATE_H
+#define __FABRIC_STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fpga_io.hpp"
+#include "fpga_loader.hpp"
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Fabric state save and restore object
+//!
+//! \details
+//!    Regions are given as <tt>offset:size</tt> in the HPS-to-FPGA bridge
+//!    window.  Before the FPGA is reset, the design can be asked to
+//!    quiesce: the request bits are set in GPO and the loader waits for the
+//!    acknowledge bits on GPI.  The regions are then read into memory.
+//!    After the new design reaches user mode the bridges are enabled, the
+//!    regions are written back and the request bits are cleared, which
+//!    lets the new design run.
+//!
+//!    If the design does not acknowledge, or the bridge is in reset, the
+//!    load is abandoned and the old design keeps running.
+//!
+
+class fabric_state_t : public fpga_hooks_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    A saved region
+        //!
+
+        struct region_t {
+            uint32_t    offset;                 //!< Offset into the bridge window
+            uint32_t    size;                   //!< Size in bytes
+            rbf_image_t data;                   //!< Saved contents
+        };
+
+        fpga_io_t &io;                          //!< HPS register access
+        std::vector<region_t> regions;          //!< Regions to save
+        bool quiesce;                           //!< Handshake with the design
+        uint32_t request;                       //!< GPO request bits
+        uint32_t acknowledge;                   //!< GPI acknowledge bits
+        unsigned int timeout_ms;                //!< Acknowledge timeout
+        bool requested;                         //!< Request bits are set
+        uint64_t start_ns;                      //!< Start of the save
+        uint64_t quiesce_ns;                    //!< Time to acknowledge
+        uint64_t save_ns;                       //!< Time to read the regions
+        uint64_t restore_ns;                    //!< Time to write the regions
+        uint64_t window_ns;                     //!< Save to restore, end to end
+        size_t bytes;                           //!< Bytes saved
+
+        void release(void);
+
+    public:
+
+        fabric_state_t(fpga_io_t &io);
+        ~fabric_state_t(void);
+        bool add(const char *spec);
+        bool handshake(const char *spec);
+        bool pre_reset(void);
+        bool post_user_mode(void);
+        void report(void) const;
+
+        //!
+        //! \brief
+        //!    Check whether there is anything to do.
+        //!
+
+        bool empty(void) const {
+            return regions.empty() && !quiesce;
+        }
+
+};
+
+#endif
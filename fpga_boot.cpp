@@ -0,0 +1,412 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Two-stage boot
+//!
+//! \file
+//!    fpga_boot.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "device_lock.hpp"
+#include "fpga_boot.hpp"
+#include "fpga_check.hpp"
+#include "fpga_loader.hpp"
+#include "fpga_sim.hpp"
+#include "rbf_fingerprint.hpp"
+#include "rbf_format.hpp"
+
+//!
+//! \brief
+//!    Time since power on in nanoseconds, including time spent suspended.
+//!
+
+static uint64_t boottime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//!
+//! \brief
+//!    Run a shell command without waiting for it.
+//!
+//! \details
+//!    The command is started from a grandchild so that it is never left as
+//!    a zombie of the loader.  Only a failure to start it is reported.
+//!
+
+static void spawn(const char *command) {
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "%s: unable to run \"%s\": %s\n", PROGNAME, command, strerror(errno));
+        return;
+    }
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    if (fork() != 0) {
+        _exit(0);
+    }
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    fprintf(stderr, "%s: unable to run \"%s\": %s\n", PROGNAME, command, strerror(errno));
+    _exit(127);
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] io
+//!    FPGA hardware or simulation.
+//!
+//! \param[in] status
+//!    Status page.  The stages are published to it.
+//!
+//! \param[in] start_ns
+//!    Start of the command.  The reading of the base image and the wait
+//!    for the device lock are part of the time to first service.
+//!
+
+fpga_boot_t::fpga_boot_t(fpga_io_t &io, fpga_status_t &status, uint64_t start_ns) :
+    io(io),
+    status(status),
+    start_ns(start_ns),
+    first_ns(0),
+    full_ns(0),
+    first_boot_ns(0),
+    full_boot_ns(0) {
+}
+
+//!
+//! \brief
+//!    Boot the FPGA in two stages.
+//!
+//! \details
+//!    The full design is not read until the board is ready, so reading it
+//!    does not delay the first stage.
+//!
+//! \param[in] base
+//!    Static design.
+//!
+//! \param[in] pr_file
+//!    Name of the full design for the PR region.
+//!
+//! \param[in] ready
+//!    Command to run once the static design is running, or NULL.
+//!
+//! \param[in] debug
+//!    Print debugging messages.
+//!
+//! \param[in] quiet
+//!    Only report failures.
+//!
+//! \returns
+//!    EXIT_SUCCESS if both designs were loaded.
+//!
+
+int fpga_boot_t::run(const rbf_image_t &base, const char *pr_file, const char *ready, bool debug, bool quiet) {
+
+    fpga_loader_t fpga_loader(io);
+
+    //
+    // Stage 1: the static design
+    //
+
+    status.publish(fpga_status_t::configuring, 0);
+    rbf_buffer_t base_buffer = base.chunks();
+    if (fpga_loader.loadFPGA(base_buffer, debug) != EXIT_SUCCESS) {
+        status.publish(fpga_status_t::failed, 0);
+        fprintf(stderr, "%s: static design failed to load.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+    io.enable_bridges();
+    first_ns      = now_ns() - start_ns;
+    first_boot_ns = boottime_ns();
+    uint64_t base_hash = fpga_loader.data_hash();
+    status.publish(fpga_status_t::user, base_hash);
+
+    if (!quiet) {
+        printf("%s: static design running after %.3f ms\n", PROGNAME, first_ns * 1e-6);
+        fflush(stdout);
+    }
+
+    //
+    // Signal that the board is ready.  The full design is loaded while the
+    // command runs, and a failing command does not stop the boot.
+    //
+
+    if (ready) {
+        spawn(ready);
+    }
+
+    //
+    // Stage 2: the full design.  If it cannot be loaded the static design
+    // is still serving, so that is what stays published.  The failure is
+    // reported on stderr and in the exit status.
+    //
+
+    rbf_image_t pr = rbf_image_t::open(pr_file);
+    if (!pr.valid()) {
+        return EXIT_FAILURE;
+    }
+    if (!rbf_format_t::valid_size(pr.size())) {
+        fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    rbf_buffer_t pr_buffer = pr.chunks();
+    if (fpga_loader.loadPR(pr_buffer, debug) != EXIT_SUCCESS) {
+        status.publish(fpga_status_t::user, base_hash);
+        fprintf(stderr, "%s: full design failed to load.  The static design is still running.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+    full_ns      = now_ns() - start_ns;
+    full_boot_ns = boottime_ns();
+    status.publish(fpga_status_t::user, fpga_loader.data_hash());
+
+    return EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    Report the time to first service and the time to full function.
+//!
+
+void fpga_boot_t::report(bool quiet) const {
+    if (first_ns && !quiet) {
+        printf("%s: time to first service %.3f ms (%.3f s after power on)\n", PROGNAME,
+               first_ns * 1e-6, first_boot_ns * 1e-9);
+    }
+    if (full_ns) {
+        printf("%s: time to full function %.3f ms (%.3f s after power on)\n", PROGNAME,
+               full_ns * 1e-6, full_boot_ns * 1e-9);
+    }
+}
+
+//!
+//! \brief
+//!    Boot command
+//!
+//! \param[in] argc
+//!    Number of arguments, starting with "boot".
+//!
+//! \param[in] argv
+//!    Arguments
+//!
+//! \returns
+//!    EXIT_SUCCESS if both designs were loaded.
+//!
+
+int fpga_boot_t::main(int argc, char *argv[]) {
+
+    uint64_t start_ns = now_ns();
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " boot [options] base.rbf full.rbf\n"
+        "\n"
+        "Load the static design base.rbf, enable the bridges and run the ready\n"
+        "command, then load full.rbf into the partial reconfiguration region of\n"
+        "the static design.  The time to first service and the time to full\n"
+        "function are reported separately.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --check         Check the configuration sequence (implies --simulate).\n"
+        "  --debug         Print debugging messages.\n"
+        "  --help          Print help message and exit.\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Give up if the FPGA is busy for longer than this.\n"
+        "  --quiet         Only report failures and the time to full function.\n"
+        "  --ready=command Start the command once the static design is running.\n"
+        "                  The full design is loaded without waiting for it.\n"
+        "  --simulate      Program a simulated FPGA instead of the hardware.\n"
+        "  --state-file=file\n"
+        "                  Record of the loaded image (default " STATEFILE ").\n"
+        "  --status-file=file\n"
+        "                  Status page that the load is published to (default\n"
+        "                  " STATUSFILE ").  See \"status\".\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"check",    no_argument,       0, 0},  // 1
+        {"debug",    no_argument,       0, 0},  // 2
+        {"lockfile", required_argument, 0, 0},  // 3
+        {"lock-timeout", required_argument, 0, 0}, // 4
+        {"quiet",    no_argument,       0, 0},  // 5
+        {"ready",    required_argument, 0, 0},  // 6
+        {"simulate", no_argument,       0, 0},  // 7
+        {"state-file", required_argument, 0, 0}, // 8
+        {"status-file", required_argument, 0, 0}, // 9
+        {0,          0,                 0, 0},  // 10
+    };
+
+    int index = 0;
+    bool check = false;
+    bool debug = false;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    bool quiet = false;
+    const char *ready = NULL;
+    bool simulate = false;
+    const char *statefile = NULL;
+    const char *statusfile = NULL;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    check = true;
+                    simulate = true;
+                    break;
+                case 2:
+                    debug = true;
+                    break;
+                case 3:
+                    lockfile = optarg;
+                    break;
+                case 4:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+                case 5:
+                    quiet = true;
+                    break;
+                case 6:
+                    ready = optarg;
+                    break;
+                case 7:
+                    simulate = true;
+                    break;
+                case 8:
+                    statefile = optarg;
+                    break;
+                case 9:
+                    statusfile = optarg;
+                    break;
+            }
+        }
+    }
+
+    if (argc - optind != 2) {
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    rbf_image_t base = rbf_image_t::open(argv[optind]);
+    if (!base.valid()) {
+        return EXIT_FAILURE;
+    }
+    if (!rbf_format_t::valid_size(base.size())) {
+        fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    fpga_io_t fpga_hw;
+    fpga_sim_t fpga_plain;
+    fpga_check_t fpga_check;
+    fpga_sim_t &fpga_sim = check ? fpga_check : fpga_plain;
+    fpga_io_t &fpga_io = simulate ? fpga_sim : fpga_hw;
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // Hold the device lock across both stages so nothing else reloads the
+    // static design under the PR load
+    //
+
+    device_lock_t device_lock;
+    if (!simulate && !device_lock.lock(lockfile, lock_timeout, quiet)) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // A simulated FPGA publishes only to the files it is given
+    //
+
+    if (!simulate && !statefile) {
+        statefile = STATEFILE;
+    }
+    if (!simulate && !statusfile) {
+        statusfile = STATUSFILE;
+    }
+
+    fpga_status_t fpga_status;
+    if (statefile) {
+        rbf_fingerprint_t::forget(statefile);
+    }
+    if (statusfile) {
+        fpga_status.open(statusfile, true);
+    }
+
+    fpga_boot_t boot(fpga_io, fpga_status, start_ns);
+    int ret = boot.run(base, argv[optind + 1], ready, debug, quiet);
+    device_lock.unlock();
+    boot.report(quiet);
+
+    if (check && fpga_check.violation_count()) {
+        fpga_check.report(stderr);
+        ret = EXIT_FAILURE;
+    } else if (check && !quiet) {
+        fpga_check.report(stdout);
+    }
+
+    if (simulate && debug) {
+        printf("%s: simulated FPGA received %zu bytes of PR data (hash %016llx)\n", PROGNAME,
+               fpga_sim.pr_size(), (unsigned long long)fpga_sim.pr_data_hash());
+    }
+
+    return ret;
+}
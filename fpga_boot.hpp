@@ -0,0 +1,91 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Two-stage boot header file
+//!
+//! \details
+//!    Load a small static design that brings up the bridges, signal that
+//!    the board is ready, and then load the full design into the partial
+//!    reconfiguration region of the static design.
+//!
+//! \file
+//!    fpga_boot.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_BOOT_H
+#define __FPGA_BOOT_H
+
+#include <stdint.h>
+
+#include "fpga_io.hpp"
+#include "fpga_status.hpp"
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Two-stage boot object
+//!
+//! \details
+//!    The static design is loaded with fpga_loader_t::loadFPGA() and the
+//!    full design with fpga_loader_t::loadPR().  The static design must
+//!    isolate its PR region, so the bridges and basic I/O keep working
+//!    while the full design is loaded behind them.  The ready command is
+//!    started between the two stages and runs while the full design is
+//!    being loaded.
+//!
+//!    The time to first service (the static design is running and the
+//!    bridges are enabled) and the time to full function (the full design
+//!    is running) are reported separately, both from the start of the
+//!    command and from power on.  Both stages are published to the status
+//!    page, so a subscriber sees the image change when the full design
+//!    comes up.
+//!
+
+class fpga_boot_t {
+
+    private:
+
+        fpga_io_t &io;                          //!< FPGA hardware or simulation
+        fpga_status_t &status;                  //!< Status page
+        uint64_t start_ns;                      //!< Start of the boot
+        uint64_t first_ns;                      //!< Time to first service
+        uint64_t full_ns;                       //!< Time to full function
+        uint64_t first_boot_ns;                 //!< First service since power on
+        uint64_t full_boot_ns;                  //!< Full function since power on
+
+    public:
+
+        fpga_boot_t(fpga_io_t &io, fpga_status_t &status, uint64_t start_ns);
+        int run(const rbf_image_t &base, const char *pr_file, const char *ready, bool debug, bool quiet);
+        void report(bool quiet) const;
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif
@@ -0,0 +1,329 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA Manager protocol checker
+//!
+//! \file
+//!    fpga_check.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fpga_check.hpp"
+#include "fpga_loader.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+fpga_check_t::fpga_check_t(void) {
+    clear();
+}
+
+//!
+//! \brief
+//!    Forget the accesses and the state of the sequence.
+//!
+
+void fpga_check_t::clear(void) {
+    accesses       = 0;
+    violations     = 0;
+    rule.clear();
+    evidence.clear();
+    loading        = false;
+    reset_seen     = false;
+    status_cleared = false;
+    conf_done_seen = false;
+    user_seen      = false;
+    pr_ready_seen  = false;
+}
+
+//!
+//! \brief
+//!    Start the simulated FPGA over and forget the accesses.
+//!
+
+void fpga_check_t::power_on(const timing_t &timing) {
+    fpga_sim_t::power_on(timing);
+    clear();
+}
+
+//!
+//! \brief
+//!    Physical address of a mapped register.
+//!
+
+uint32_t fpga_check_t::phys(volatile void *addr) const {
+    size_t offset = (volatile char *)addr - base_addr;
+    return (offset < hps_size) ? hps_base + offset : 0;
+}
+
+//!
+//! \brief
+//!    Name of a register.
+//!
+//! \returns
+//!    The name, or NULL if the register is not one the loader uses.
+//!
+
+const char *fpga_check_t::name(uint32_t addr) {
+    static const struct {
+        uint32_t addr;
+        const char *name;
+    } regs[] = {
+        {fpgamgr_addr + 0x000, "stat"},
+        {fpgamgr_addr + 0x004, "ctrl"},
+        {fpgamgr_addr + 0x008, "dclkcnt"},
+        {fpgamgr_addr + 0x00c, "dclkstat"},
+        {fpgamgr_addr + 0x010, "gpo"},
+        {fpgamgr_addr + 0x014, "gpi"},
+        {fpgamgr_addr + 0x84c, "gpio_porta_eoi"},
+        {fpgamgr_addr + 0x850, "gpio_ext_porta"},
+        {fpgadata_addr,        "data"},
+        {rstmgr_addr  + 0x01c, "brgmodrst"},
+        {sysmgr_addr  + 0x028, "module"},
+    };
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        if (regs[i].addr == addr) {
+            return regs[i].name;
+        }
+    }
+    return NULL;
+}
+
+//!
+//! \brief
+//!    Add an access to the trace.
+//!
+
+void fpga_check_t::record(char op, uint32_t addr, uint32_t value) {
+    access_t &access = trace[accesses % trace_size];
+    access.seq   = accesses++;
+    access.op    = op;
+    access.addr  = addr;
+    access.value = value;
+}
+
+//!
+//! \brief
+//!    Note a violation.  The trace is kept for the first one.
+//!
+
+void fpga_check_t::fail(const char *rule) {
+    if (violations++ == 0) {
+        this->rule = rule;
+        uint64_t first = (accesses > trace_size) ? accesses - trace_size : 0;
+        for (uint64_t seq = first; seq < accesses; seq++) {
+            evidence.push_back(trace[seq % trace_size]);
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Read a register and note the states the loader has seen.
+//!
+
+uint32_t fpga_check_t::read_reg(volatile void *addr) {
+
+    uint32_t value = fpga_sim_t::read_reg(addr);
+    record('r', phys(addr), value);
+
+    if (addr == &fpgamgr_regs->stat) {
+        uint32_t mode = value & fpga_loader_t::mode;
+        if ((mode == fpga_loader_t::mode_reset) && (read32(&fpgamgr_regs->ctrl) & fpga_loader_t::nconfigpull)) {
+            reset_seen = true;
+        } else if ((mode == fpga_loader_t::mode_user) && conf_done_seen) {
+            user_seen = true;
+        }
+    } else if (addr == &fpgamgr_regs->gpio_ext_porta) {
+        if (loading && ((value & (fpga_loader_t::cd | fpga_loader_t::ns)) == (fpga_loader_t::cd | fpga_loader_t::ns))) {
+            conf_done_seen = true;
+        }
+        if ((value & fpga_loader_t::prr) && (read32(&fpgamgr_regs->ctrl) & fpga_loader_t::prreq)) {
+            pr_ready_seen = true;
+        }
+    }
+
+    return value;
+}
+
+//!
+//! \brief
+//!    Check a register write against the sequence and pass it on.
+//!
+
+void fpga_check_t::write_reg(volatile void *addr, uint32_t val) {
+
+    record('w', phys(addr), val);
+    uint32_t mode = read32(&fpgamgr_regs->stat) & fpga_loader_t::mode;
+
+    if (addr == &fpgamgr_regs->ctrl) {
+
+        uint32_t old  = read32(addr);
+        uint32_t rose = val & ~old;
+        uint32_t fell = old & ~val;
+
+        if (rose & fpga_loader_t::nconfigpull) {
+            if (!(old & fpga_loader_t::en)) {
+                fail("nCONFIG pulled before en was set");
+            }
+            if (val & fpga_loader_t::nce) {
+                fail("nCONFIG pulled while nCE is negated");
+            }
+            if (read32(&sysmgr_regs->module) != 0) {
+                fail("nCONFIG pulled while the HPS-to-FPGA signals are enabled");
+            }
+            loading        = true;
+            reset_seen     = false;
+            status_cleared = false;
+            conf_done_seen = false;
+            user_seen      = false;
+        }
+        if ((fell & fpga_loader_t::nconfigpull) && !reset_seen) {
+            fail("nCONFIG released before the reset state was read back");
+        }
+        if (rose & fpga_loader_t::prreq) {
+            if ((mode != fpga_loader_t::mode_user) || !(old & fpga_loader_t::en)) {
+                fail("prreq set outside of the user mode state or before en was set");
+            }
+            status_cleared = false;
+            pr_ready_seen  = false;
+        }
+        if ((fell & fpga_loader_t::prreq) && (val & fpga_loader_t::axicfgen)) {
+            fail("prreq released while axicfgen is set");
+        }
+        if (rose & fpga_loader_t::axicfgen) {
+            if (val & fpga_loader_t::prreq) {
+                if (!pr_ready_seen) {
+                    fail("axicfgen set before PR_READY was read back");
+                }
+            } else if ((mode != fpga_loader_t::mode_config) || (val & fpga_loader_t::nconfigpull)) {
+                fail("axicfgen set outside of the configuration state");
+            }
+            if (!status_cleared) {
+                fail("axicfgen set before the status bits were cleared");
+            }
+        }
+        if (((old | val) & fpga_loader_t::axicfgen) &&
+            ((old ^ val) & (fpga_loader_t::cdratio | fpga_loader_t::cfgwdth))) {
+            fail("cdratio or cfgwdth changed while axicfgen is set");
+        }
+        if (fell & fpga_loader_t::en) {
+            if (val & (fpga_loader_t::axicfgen | fpga_loader_t::nconfigpull | fpga_loader_t::prreq)) {
+                fail("en released while axicfgen, nCONFIG or prreq is set");
+            }
+            if (loading && !user_seen) {
+                fail("en released before the user mode state was read back");
+            }
+            loading = false;
+        }
+
+    } else if (addr == &fpgamgr_regs->gpio_porta_eoi) {
+
+        if ((mode == fpga_loader_t::mode_config) ||
+            ((mode == fpga_loader_t::mode_user) && (read32(&fpgamgr_regs->ctrl) & fpga_loader_t::prreq))) {
+            status_cleared = true;
+        }
+
+    } else if ((addr == &fpgamgr_regs->dclkcnt) && (val != 0)) {
+
+        if (!conf_done_seen) {
+            fail("DCLK count written before CONF_DONE was read back");
+        }
+        if (read32(&fpgamgr_regs->ctrl) & fpga_loader_t::axicfgen) {
+            fail("DCLK count written while axicfgen is set");
+        }
+        if (read32(&fpgamgr_regs->dclkstat) & fpga_loader_t::dcntdone) {
+            fail("DCLK count written before dcntdone was cleared");
+        }
+    }
+
+    fpga_sim_t::write_reg(addr, val);
+}
+
+//!
+//! \brief
+//!    Check that configuration data is accepted and pass it on.
+//!
+
+void fpga_check_t::write_data(const uint32_t *data, size_t len) {
+
+    record('d', fpgadata_addr, len);
+
+    uint32_t mode = read32(&fpgamgr_regs->stat) & fpga_loader_t::mode;
+    uint32_t ctrl = read32(&fpgamgr_regs->ctrl) &
+        (fpga_loader_t::en | fpga_loader_t::axicfgen | fpga_loader_t::nconfigpull | fpga_loader_t::prreq);
+    if (ctrl & fpga_loader_t::prreq) {
+        if ((mode != fpga_loader_t::mode_user) ||
+            (ctrl != (fpga_loader_t::en | fpga_loader_t::axicfgen | fpga_loader_t::prreq)) || !pr_ready_seen) {
+            fail("PR data written without axicfgen = 1 after PR_READY");
+        }
+    } else if ((mode != fpga_loader_t::mode_config) ||
+               (ctrl != (fpga_loader_t::en | fpga_loader_t::axicfgen))) {
+        fail("configuration data written without axicfgen = 1 in the configuration state");
+    }
+
+    fpga_sim_t::write_data(data, len);
+}
+
+//!
+//! \brief
+//!    Print the result of the checks.
+//!
+//! \details
+//!    If a rule was broken, the first violation is printed with the
+//!    accesses that led up to it.  The last access is the one that broke
+//!    the rule.
+//!
+
+void fpga_check_t::report(FILE *fp) const {
+
+    if (violations == 0) {
+        fprintf(fp, "%s: check: %llu accesses, no violations\n", PROGNAME, (unsigned long long)accesses);
+        return;
+    }
+
+    fprintf(fp, "%s: check: %zu violation%s in %llu accesses.  First: %s\n", PROGNAME, violations,
+            (violations == 1) ? "" : "s", (unsigned long long)accesses, rule.c_str());
+    for (size_t i = 0; i < evidence.size(); i++) {
+        const access_t &access = evidence[i];
+        const char *reg = name(access.addr);
+        if (access.op == 'd') {
+            fprintf(fp, "  %8llu d 0x%08x %-15s %u words\n", (unsigned long long)access.seq, access.addr,
+                    reg, access.value);
+        } else {
+            fprintf(fp, "  %8llu %c 0x%08x %-15s 0x%08x\n", (unsigned long long)access.seq, access.op,
+                    access.addr, reg ? reg : "", access.value);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA Manager protocol checker header file
+//!
+//! \details
+//!    A simulated FPGA that checks the loader's register accesses against
+//!    the configuration sequence in the Cyclone V handbook.
+//!
+//! \file
+//!    fpga_check.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_CHECK_H
+#define __FPGA_CHECK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "fpga_sim.hpp"
+
+//!
+//! \brief
+//!    Protocol checking FPGA object
+//!
+//! \details
+//!    Every access the loader makes through fpga_io_t is checked against
+//!    the rules of the full configuration sequence (see
+//!    fpga_loader_t::loadFPGA()) before it is passed on to the simulated
+//!    FPGA:
+//!
+//!    - nCONFIG is only pulled while the HPS drives the configuration
+//!      inputs (en = 1, nCE asserted) and the HPS-to-FPGA signals are
+//!      disabled.
+//!    - nCONFIG is only released after the reset state has been read back.
+//!    - axicfgen is only set in the configuration state, after the status
+//!      bits have been cleared.
+//!    - Configuration data is only written while axicfgen = 1 in the
+//!      configuration state.
+//!    - cdratio and cfgwdth do not change while axicfgen = 1.
+//!    - The DCLK count is only written after CONF_DONE has been read back,
+//!      axicfgen has been cleared and dcntdone has been cleared.
+//!    - en is released last, after the user mode state has been read back.
+//!
+//!    and for partial reconfiguration (see fpga_loader_t::loadPR()):
+//!
+//!    - prreq is only set in the user mode state with en = 1.
+//!    - axicfgen is only set, and PR data only written, after PR_READY has
+//!      been read back and the status bits have been cleared.
+//!    - prreq is not released while axicfgen = 1, and en is not released
+//!      while prreq = 1.
+//!
+//!    The checks only look at the value being written and a few flags, so
+//!    the checker adds little to a simulated load.  The last accesses are
+//!    kept in a ring, and a copy is taken at the first violation so it can
+//!    be reported with the accesses that led up to it.
+//!
+
+class fpga_check_t : public fpga_sim_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    One access
+        //!
+
+        struct access_t {
+            uint64_t seq;                       //!< Access number
+            char     op;                        //!< 'r' read, 'w' write, 'd' data
+            uint32_t addr;                      //!< Physical address
+            uint32_t value;                     //!< Value, or words of data
+        };
+
+        static const size_t trace_size = 32;    //!< Accesses kept in the ring
+
+        access_t trace[trace_size];             //!< Last accesses
+        uint64_t accesses;                      //!< Accesses since power on
+        size_t violations;                      //!< Violations since power on
+        std::string rule;                       //!< First rule that was broken
+        std::vector<access_t> evidence;         //!< Accesses up to the first violation
+
+        bool loading;                           //!< nCONFIG has been pulled
+        bool reset_seen;                        //!< Reset state read back while nCONFIG is pulled
+        bool status_cleared;                    //!< Status bits cleared in the configuration state
+        bool conf_done_seen;                    //!< CONF_DONE read back
+        bool user_seen;                         //!< User mode state read back after the load
+        bool pr_ready_seen;                     //!< PR_READY read back while prreq is set
+
+        void clear(void);
+        uint32_t phys(volatile void *addr) const;
+        void record(char op, uint32_t addr, uint32_t value);
+        void fail(const char *rule);
+        static const char *name(uint32_t addr);
+
+    public:
+
+        fpga_check_t(void);
+        uint32_t read_reg(volatile void *addr);
+        void write_reg(volatile void *addr, uint32_t val);
+        void write_data(const uint32_t *data, size_t len);
+        void power_on(const timing_t &timing);
+        void report(FILE *fp) const;
+
+        //!
+        //! \brief
+        //!    Number of rule violations since power on.
+        //!
+
+        size_t violation_count(void) const {
+            return violations;
+        }
+
+        //!
+        //! \brief
+        //!    The first rule that was broken, or an empty string.
+        //!
+
+        const std::string &first_violation(void) const {
+            return rule;
+        }
+
+};
+
+#endif
@@ -0,0 +1,194 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    HPS register access
+//!
+//! \file
+//!    fpga_io.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "fpga_io.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+fpga_io_t::fpga_io_t(void) :
+    fd(-1),
+    base_addr(NULL),
+    fpgamgr_regs(NULL),
+    fpgamgr_data(NULL),
+    sysmgr_regs(NULL),
+    rstmgr_brgmodrst(NULL),
+    l3regs_remap(NULL),
+    lwh2f(NULL),
+    module(0) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+fpga_io_t::~fpga_io_t(void) {
+    close();
+}
+
+//!
+//! \brief
+//!    mmap() the HPS peripheral registers.
+//!
+//! \details
+//!    The FPGA Manager, System Manager, Reset Manager, L3 registers and the
+//!    lightweight HPS-to-FPGA bridge window all fall within a single 16 MB
+//!    region of the HPS address space.
+//!
+//! \returns
+//!    True if the registers were mapped successfully.
+//!
+
+bool fpga_io_t::open(void) {
+
+    fd = ::open("/dev/mem", (O_RDWR | O_SYNC | O_CLOEXEC));
+    if (fd < 0) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    void *addr = mmap(NULL, hps_size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, hps_base);
+
+    //
+    // Ensure the mmap() succeeded
+    //
+
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: unable to mmap() FPGA interface registers.\n", PROGNAME);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    base_addr        = (char *)addr;
+    fpgamgr_regs     = (fpgamgr_regs_t*)&base_addr[fpgamgr_addr  - hps_base];
+    fpgamgr_data     = (uint32_t      *)&base_addr[fpgadata_addr - hps_base];
+    sysmgr_regs      = (sysmgr_regs_t *)&base_addr[sysmgr_addr   - hps_base];
+    rstmgr_brgmodrst = (uint32_t      *)&base_addr[rstmgr_addr   - hps_base + 0x1c];
+    l3regs_remap     = (uint32_t      *)&base_addr[l3regs_addr   - hps_base];
+    lwh2f            = (uint8_t       *)&base_addr[lwh2f_addr    - hps_base];
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Unmap the HPS peripheral registers.
+//!
+
+void fpga_io_t::close(void) {
+    if (base_addr) {
+        munmap(base_addr, hps_size);
+        base_addr = NULL;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+//!
+//! \brief
+//!    mmap() part of the HPS-to-FPGA bridge window.
+//!
+//! \param[in] offset
+//!    Offset into the bridge window.
+//!
+//! \param[in] size
+//!    Number of bytes to map.
+//!
+//! \returns
+//!    Address of the offset in the bridge window or NULL on failure.
+//!
+
+uint8_t *fpga_io_t::map_h2f(uint32_t offset, size_t size) {
+
+    if ((offset >= h2f_size) || (size > h2f_size - offset)) {
+        fprintf(stderr, "%s: offset 0x%08x is outside of the hps2fpga window.\n", PROGNAME, offset);
+        return NULL;
+    }
+
+    uint32_t page = offset & ~(getpagesize() - 1);
+    void *addr = mmap(NULL, size + (offset - page), (PROT_READ | PROT_WRITE), MAP_SHARED, fd, h2f_addr + page);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: unable to mmap() the hps2fpga bridge.\n", PROGNAME);
+        return NULL;
+    }
+
+    return (uint8_t *)addr + (offset - page);
+}
+
+//!
+//! \brief
+//!    Unmap part of the HPS-to-FPGA bridge window.
+//!
+//! \param[in] addr
+//!    Address returned by map_h2f().
+//!
+//! \param[in] size
+//!    Size passed to map_h2f().
+//!
+
+void fpga_io_t::unmap_h2f(uint8_t *addr, size_t size) {
+    if (addr) {
+        size_t delta = (uintptr_t)addr & (getpagesize() - 1);
+        munmap(addr - delta, size + delta);
+    }
+}
+
+//!
+//! \brief
+//!    Enable the HPS-to-FPGA bridges after the FPGA has been configured.
+//!
+//! \details
+//!    This restores the SYSMGR module register that was cleared at Step 0.a
+//!    of the load, releases the bridges from reset and makes the bridge
+//!    windows visible to the MPU.
+//!
+
+void fpga_io_t::enable_bridges(void) {
+    write32(&sysmgr_regs->module, module);
+    write32(rstmgr_brgmodrst, read32(rstmgr_brgmodrst) & ~(hps2fpga | lwhps2fpga | fpga2hps));
+    write32(l3regs_remap, remap_mpuzero | remap_h2f | remap_lwh2f);
+}
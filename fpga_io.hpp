@@ -0,0 +1,233 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    HPS register access header file
+//!
+//! \details
+//!    This object maps the HPS peripheral registers and the HPS-to-FPGA
+//!    bridge windows through /dev/mem.
+//!
+//! \file
+//!    fpga_io.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_IO_H
+#define __FPGA_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "fpga_loader.hpp"
+
+//!
+//! \brief
+//!    HPS register access object
+//!
+//! \details
+//!    The loader accesses the FPGA Manager through the virtual functions of
+//!    this object so that a simulated device can be substituted for the
+//!    hardware (see fpga_sim_t).  read32() and write32() always access the
+//!    mapped registers directly.
+//!
+
+class fpga_io_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Physical addresses
+        //!
+
+        enum hps_addr_t : uint32_t {
+            hps_base     = 0xff000000,          //!< Base of the HPS peripheral mapping
+            hps_size     = 0x01000000,          //!< Size of the HPS peripheral mapping
+            lwh2f_addr   = 0xff200000,          //!< Lightweight HPS-to-FPGA bridge window
+            lwh2f_size   = 0x00200000,          //!< Size of the lightweight bridge window
+            fpgamgr_addr = 0xff706000,          //!< FPGA Manager registers
+            l3regs_addr  = 0xff800000,          //!< L3 (NIC-301) GPV registers
+            fpgadata_addr= 0xffb90000,          //!< FPGA Manager data port
+            rstmgr_addr  = 0xffd05000,          //!< Reset Manager registers
+            sysmgr_addr  = 0xffd08000,          //!< System Manager registers
+            h2f_addr     = 0xc0000000,          //!< HPS-to-FPGA bridge window
+            h2f_size     = 0x3c000000,          //!< Size of the HPS-to-FPGA bridge window
+        };
+
+        //!
+        //! \brief
+        //!    Bit definitions of the RSTMGR brgmodrst register (0x01c)
+        //!
+
+        enum rstmgr_brgmodrst_t : uint32_t {
+            hps2fpga     = 0x00000001,          //!< Holds the HPS-to-FPGA bridge in reset
+            lwhps2fpga   = 0x00000002,          //!< Holds the lightweight HPS-to-FPGA bridge in reset
+            fpga2hps     = 0x00000004,          //!< Holds the FPGA-to-HPS bridge in reset
+        };
+
+        //!
+        //! \brief
+        //!    Bit definitions of the L3 remap register (0x000)
+        //!
+
+        enum l3regs_remap_t : uint32_t {
+            remap_mpuzero = 0x00000001,         //!< Boot ROM or on-chip RAM at address zero
+            remap_h2f     = 0x00000008,         //!< Make the HPS-to-FPGA bridge visible to the MPU
+            remap_lwh2f   = 0x00000010,         //!< Make the lightweight bridge visible to the MPU
+        };
+
+    protected:
+
+        int fd;                                 //!< File descriptor of /dev/mem
+        char *base_addr;                        //!< mmap() of the HPS peripherals
+
+    public:
+
+        fpgamgr_regs_t *fpgamgr_regs;           //!< FPGA Manager registers
+        uint32_t       *fpgamgr_data;           //!< FPGA Manager data port
+        sysmgr_regs_t  *sysmgr_regs;            //!< System Manager registers
+        uint32_t       *rstmgr_brgmodrst;       //!< Reset Manager bridge reset register
+        uint32_t       *l3regs_remap;           //!< L3 remap register (write-only)
+        uint8_t        *lwh2f;                  //!< Lightweight HPS-to-FPGA bridge window
+        uint32_t        module;                 //!< SYSMGR module value before the load
+
+        fpga_io_t(void);
+        virtual ~fpga_io_t(void);
+        virtual bool open(void);
+        virtual void close(void);
+        virtual uint8_t *map_h2f(uint32_t offset, size_t size);
+        virtual void unmap_h2f(uint8_t *addr, size_t size);
+        virtual void enable_bridges(void);
+
+        //!
+        //! \brief
+        //!    Read an FPGA Manager or System Manager register.
+        //!
+        //! \param[in] addr
+        //!    Register address
+        //!
+
+        virtual uint32_t read_reg(volatile void *addr) {
+            return read32(addr);
+        }
+
+        //!
+        //! \brief
+        //!    Write an FPGA Manager or System Manager register.
+        //!
+        //! \param[in] addr
+        //!    Register address
+        //!
+        //! \param[in] val
+        //!    Data to be written to the register
+        //!
+
+        virtual void write_reg(volatile void *addr, uint32_t val) {
+            write32(addr, val);
+        }
+
+        //!
+        //! \brief
+        //!    Write configuration data to the FPGA Manager data port.
+        //!
+        //! \param[in] data
+        //!    Configuration data
+        //!
+        //! \param[in] len
+        //!    Number of 32-bit words
+        //!
+
+        virtual void write_data(const uint32_t *data, size_t len) {
+            volatile uint32_t *port = fpgamgr_data;
+            for (size_t i = 0; i < len; i++) {
+                *port = data[i];
+            }
+        }
+
+        //!
+        //! \brief
+        //!    Wait between polls of the FPGA Manager.
+        //!
+        //! \param[in] usecs
+        //!    Time to wait in microseconds
+        //!
+
+        virtual void wait_us(unsigned int usecs) {
+            usleep(usecs);
+        }
+
+        //!
+        //! \brief
+        //!    Time used by the loader for its measurements.
+        //!
+        //! \returns
+        //!    Monotonic time in nanoseconds.  A simulated device may keep
+        //!    its own clock.
+        //!
+
+        virtual uint64_t clock_ns(void) {
+            return now_ns();
+        }
+
+        //!
+        //! \brief
+        //!    Read a 32-bit word from IO
+        //!
+        //! \param[in] addr
+        //!    IO register address
+        //!
+        //! \note
+        //!    This is native endian.
+        //!
+
+        uint32_t read32(volatile void *addr) {
+            return *(volatile uint32_t*)addr;
+        }
+
+        //!
+        //! \brief
+        //!    Write a 32-bit word to IO
+        //!
+        //! \param[in] addr
+        //!    IO register address
+        //!
+        //! \param[in] val
+        //!    Data to be written to the IO location
+        //!
+        //! \note
+        //!    This is native endian.
+        //!
+
+        void write32(volatile void *addr, uint32_t val) {
+            *(volatile uint32_t*)addr = val;
+        }
+
+};
+
+#endif
@@ -44,17 +44,38 @@
 //
 //******************************************************************************
 
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <sys/mman.h>
 
+#include "fpga_io.hpp"
 #include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "rbf_probe.hpp"
 
 #define DEBUG(...) //printf(__VA_ARGS__)
 
+//!
+//! \brief
+//!    Read a 32-bit word from IO.  The access goes through the fpga_io_t
+//!    object so that it can be simulated.
+//!
+
+uint32_t fpga_loader_t::read32(volatile void *addr) {
+    return io.read_reg(addr);
+}
+
+//!
+//! \brief
+//!    Write a 32-bit word to IO.  The access goes through the fpga_io_t
+//!    object so that it can be simulated.
+//!
+
+void fpga_loader_t::write32(volatile void *addr, uint32_t val) {
+    io.write_reg(addr, val);
+}
+
 //!
 //! \brief
 //!    This function loads firmware into the on-board FPGA.
@@ -156,11 +177,9 @@
 //!       configuration input signals from being controlled by the HPS back to
 //!       being controlled by the device's external pins.
 //!
-//! \param [in] rbf_data
-//!    RBF data read from an `rbf` file.
-//!
-//! \param [in] rbf_size
-//!    Size of the RBF file in 32-bit words.
+//! \param [in] rbf_source
+//!    Source of the RBF data.  The data is written to the FPGA one chunk at
+//!    a time as the source supplies it.
 //!
 //! \param [in] debug
 //!    Enables debugging messages.
@@ -168,6 +187,7 @@
 //! \returns
 //!    <b>EXIT_FAILURE</b> if the FPGA will not transition to Reset Mode.<br>
 //!    <b>EXIT_FAILURE</b> if the FPGA will not transition to Configuration Mode.<br>
+//!    <b>EXIT_FAILURE</b> if the RBF source reports that the data was not intact.<br>
 //!    <b>EXIT_FAILURE</b> if the FPGA will not transition to Initialization Mode.<br>
 //!    <b>EXIT_FAILURE</b> if the FPGA will not send DCLKS.<br>
 //!    <b>EXIT_FAILURE</b> if the FPGA will not transition to User Mode.<br>
@@ -194,48 +214,30 @@
 //!    https://www.intel.com/content/www/us/en/programmable/quartushelp/13.0/mergedProjects/reference/glossary/def_rbf.htm
 //!
 
-int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debug) {
-
-    //
-    // mmap() the registers
-    //
-
-    int fd = open("/dev/mem", (O_RDWR | O_SYNC));
-
-#if 0
-
-    uint32_t       *fpgamgr_data = (uint32_t      *)mmap(NULL,      4, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0xffb90000);
-    fpgamgr_regs_t *fpgamgr_regs = (fpgamgr_regs_t*)mmap(NULL, 0x1000, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0xff706000);
-    sysmgr_regs_t  *sysmgr_regs  = (sysmgr_regs_t *)mmap(NULL, 0x1000, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0xffd08000);
-
-    //
-    // Ensure the mmap() succeeded
-    //
-
-    if (!fpgamgr_data || !fpgamgr_regs || !sysmgr_regs) {
-        fprintf(stderr, "%s: unable to mmap() FPGA interface registers.\n", PROGNAME);
-        exit(EXIT_FAILURE);
+int fpga_loader_t::loadFPGA(rbf_source_t &rbf_source, bool debug) {
+    hash = 0;
+    data_bytes = 0;
+    write_ns = 0;
+    int ret = load(rbf_source, debug);
+    if ((ret != EXIT_SUCCESS) && hooks) {
+        hooks->failure();
     }
+    return ret;
+}
 
-#else
+//!
+//! \brief
+//!    Load the FPGA.  This is the body of loadFPGA().
+//!
 
-    size_t len = 0x01000000;
-    char *base_addr = (char*)mmap(NULL, len, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0xff000000);
+int fpga_loader_t::load(rbf_source_t &rbf_source, bool debug) {
 
     //
-    // Ensure the mmap() succeeded
+    // The registers are mapped by the fpga_io_t object
     //
 
-    if (!base_addr) {
-        fprintf(stderr, "%s: unable to mmap() FPGA interface registers.\n", PROGNAME);
-        exit(EXIT_FAILURE);
-    }
-
-    fpgamgr_regs_t *fpgamgr_regs = (fpgamgr_regs_t*)&base_addr[0x00706000];
-    uint32_t       *fpgamgr_data = (uint32_t      *)&base_addr[0x00b90000];
-    sysmgr_regs_t  *sysmgr_regs  = (sysmgr_regs_t *)&base_addr[0x00d08000];
-
-#endif
+    fpgamgr_regs_t *fpgamgr_regs = io.fpgamgr_regs;
+    sysmgr_regs_t  *sysmgr_regs  = io.sysmgr_regs;
 
 #if 0
 
@@ -267,9 +269,13 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
 
     //
     // Step 0.a
-    //  Disable all signals from hps peripheral controller to fpga
+    //  Disable all signals from hps peripheral controller to fpga.  The
+    //  previous value is restored when the bridges are enabled.
     //
 
+    RBF_PROBE1(step, 0);
+
+    io.module = read32(&sysmgr_regs->module);
     write32(&sysmgr_regs->module, 0);
 
     //
@@ -297,6 +303,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  to match the characteristics of the configuration image.
     //
 
+    RBF_PROBE1(step, 1);
+
     write32(&fpgamgr_regs->ctrl, 0x01 | (read32(&fpgamgr_regs->ctrl) & 0x02c0));
 
     //
@@ -305,6 +313,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  enable the HPS to modify the FPGA configuration.
     //
 
+    RBF_PROBE1(step, 2);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::nce);
 
     //
@@ -314,14 +324,29 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  pins to being controlled by the HPS.
     //
 
+    RBF_PROBE1(step, 3);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::en);
 
+    //
+    // Let the old design save its state before it is reset
+    //
+
+    if (hooks && !hooks->pre_reset()) {
+        write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::en);
+        write32(&sysmgr_regs->module, io.module);
+        fprintf(stderr, "%s: load abandoned.  The old design is still running.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
     //
     // Step 4:
     //  Set the nCONFIG bit of the FPGA Manager Control Register  to 1. This
     //  will put the FPGA portion of the device into the reset state.
     //
 
+    RBF_PROBE1(step, 4);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::nconfigpull);
 
     //
@@ -330,12 +355,17 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  the FPGA enters the reset state.
     //
 
-    for (int i = 0; i < 1000; i++) {
+    RBF_PROBE1(step, 5);
+
+    int polls;
+    for (polls = 0; polls < 1000; polls++) {
         if (get_state(fpgamgr_regs) == fpgamgr_regs_stat_t::mode_reset)
             break;
-        usleep(10);
+        io.wait_us(10);
     }
 
+    RBF_PROBE3(wait_done, 5, polls, polls < 1000);
+
     if (get_state(fpgamgr_regs) != fpgamgr_regs_stat_t::mode_reset) {
         fprintf(stderr, "%s: reset state transition failed\n", PROGNAME);
         return EXIT_FAILURE;
@@ -351,6 +381,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  This will release the FPGA portion of the device from reset.
     //
 
+    RBF_PROBE1(step, 6);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::nconfigpull);
 
     //
@@ -359,12 +391,16 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  the configuration state.
     //
 
-    for (int i = 0; i < 1000; i++) {
+    RBF_PROBE1(step, 7);
+
+    for (polls = 0; polls < 1000; polls++) {
         if (get_state(fpgamgr_regs) == fpgamgr_regs_stat_t::mode_config)
             break;
-        usleep(10);
+        io.wait_us(10);
     }
 
+    RBF_PROBE3(wait_done, 7, polls, polls < 1000);
+
     if (get_state(fpgamgr_regs) != fpgamgr_regs_stat_t::mode_config) {
         printf("%s: configuration state transition failed\n", PROGNAME);
         return EXIT_FAILURE;
@@ -379,6 +415,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  Clear the status bits (interrupts) from the CB
     //
 
+    RBF_PROBE1(step, 8);
+
     write32(&fpgamgr_regs->gpio_porta_eoi, 0x00000fff);
 
     //
@@ -387,6 +425,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  This will permit the HPS to send configuration data to the FPGA.
     //
 
+    RBF_PROBE1(step, 9);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::axicfgen);
 
     //
@@ -395,8 +435,48 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  register one 32-bit word at a time until all data has been written.
     //
 
-    for (unsigned int i = 0; i < rbf_size; i++) {
-        write32(fpgamgr_data, *rbf_data++);
+    RBF_PROBE1(step, 10);
+
+    uint64_t start = io.clock_ns();
+
+    size_t words = 0;
+    const uint32_t *chunk;
+    hash64_t data_hash;
+    for (size_t len; (len = rbf_source.next(&chunk)) != 0; words += len) {
+        RBF_PROBE3(chunk, words * sizeof(uint32_t), len * sizeof(uint32_t), chunk);
+        io.write_data(chunk, len);
+        data_hash.update(chunk, len * sizeof(uint32_t));
+    }
+    hash = data_hash.digest();
+    data_bytes = words * sizeof(uint32_t);
+    write_ns = io.clock_ns() - start;
+
+    if (debug) {
+        double secs = write_ns * 1e-9;
+        printf("%s: wrote %zu bytes in %.3f ms (%.1f MB/s)\n", PROGNAME,
+               words * sizeof(uint32_t), secs * 1e3, words * sizeof(uint32_t) / secs / 1e6);
+    }
+
+    //
+    // Step 10a
+    //  If the source could not vouch for the data (e.g. an authentication
+    //  failure), hold the FPGA in reset so the design never runs.
+    //
+
+    if (!rbf_source.good()) {
+        write32(&fpgamgr_regs->ctrl, (read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::axicfgen) | fpgamgr_regs_ctrl_t::nconfigpull);
+        fprintf(stderr, "%s: configuration data failed verification.  FPGA held in reset.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    //
+    // All of the configuration data has been written
+    //
+
+    if (hooks && !hooks->post_transfer()) {
+        write32(&fpgamgr_regs->ctrl, (read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::axicfgen) | fpgamgr_regs_ctrl_t::nconfigpull);
+        fprintf(stderr, "%s: load stopped after the transfer.  FPGA held in reset.\n", PROGNAME);
+        return EXIT_FAILURE;
     }
 
     //
@@ -408,19 +488,24 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //    c. With any other combination except as listed above, continue polling.
     //
 
+    RBF_PROBE1(step, 11);
+
     uint32_t status;
-    for (int i = 0; i < 1000; i++) {
+    for (polls = 0; polls < 1000; polls++) {
         status = read32(&fpgamgr_regs->gpio_ext_porta) & (cd | ns);
         if (status == 0) {
+            RBF_PROBE3(wait_done, 11, polls, 0);
             printf("%s: initialization state transition failed.\n", PROGNAME);
             return EXIT_FAILURE;
         }
         if (status == (cd | ns)) {
             break;
         }
-        usleep(10);
+        io.wait_us(10);
     }
 
+    RBF_PROBE3(wait_done, 11, polls, polls < 1000);
+
     if (status != (cd | ns)) {
         printf("%s: initialization state transition failed.\n", PROGNAME);
         return EXIT_FAILURE;
@@ -436,6 +521,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  This will prohibit the HPS from sending configuration data to the FPGA.
     //
 
+    RBF_PROBE1(step, 12);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::axicfgen);
 
     //
@@ -443,6 +530,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  If the dcntdone bit of the DCLK Status Register is set, clear it.
     //
 
+    RBF_PROBE1(step, 13);
+
     if (read32(&fpgamgr_regs->dclkstat) != 0) {
 #if 0
         write32(&fpgamgr_regs->dclkstat, 0);
@@ -465,13 +554,17 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  changes to 1. This indicates that all the DCLKs have been sent.
     //
 
-    for (int i = 0; i < 100; i++) {
+    RBF_PROBE1(step, 14);
+
+    for (polls = 0; polls < 100; polls++) {
         status = read32(&fpgamgr_regs->dclkstat) & dcntdone;
         if (status == dcntdone)
             break;
-        usleep(10);
+        io.wait_us(10);
     }
 
+    RBF_PROBE3(wait_done, 14, polls, polls < 100);
+
     if (status != dcntdone) {
         printf("%s: time waiting for DCLKs to be sent.\n", PROGNAME);
         return EXIT_FAILURE;
@@ -483,6 +576,8 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  completed status flag.
     //
 
+    RBF_PROBE1(step, 15);
+
     write32(&fpgamgr_regs->dclkstat, 1);
 
     //
@@ -491,12 +586,16 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //  FPGA to enter the User Mode state.
     //
 
-    for (int i = 0; i < 1000; i++) {
+    RBF_PROBE1(step, 16);
+
+    for (polls = 0; polls < 1000; polls++) {
         if (get_state(fpgamgr_regs) == fpgamgr_regs_stat_t::mode_user)
             break;
-        usleep(10);
+        io.wait_us(10);
     }
 
+    RBF_PROBE3(wait_done, 16, polls, polls < 1000);
+
     if (get_state(fpgamgr_regs) != fpgamgr_regs_stat_t::mode_user) {
         printf("%s: user mode state transition failed\n", PROGNAME);
         return EXIT_FAILURE;
@@ -513,17 +612,257 @@ int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debu
     //   the HPS back to being controlled by the device's external pins.
     //
 
+    RBF_PROBE1(step, 17);
+
     write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::en);
 
+    if (hooks && !hooks->post_user_mode()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    This function loads firmware from memory into the on-board FPGA.
+//!
+//! \param [in] rbf_data
+//!    RBF data read from an `rbf` file.
+//!
+//! \param [in] rbf_size
+//!    Size of the RBF file in 32-bit words.
+//!
+//! \param [in] debug
+//!    Enables debugging messages.
+//!
+//! \returns
+//!    See loadFPGA(rbf_source_t &, bool).
+//!
+
+int fpga_loader_t::loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debug) {
+    rbf_buffer_t rbf_buffer(rbf_data, rbf_size);
+    return loadFPGA(rbf_buffer, debug);
+}
+
+//!
+//! \brief
+//!    This function loads a partial reconfiguration (PR) image into a PR
+//!    region of the design that is running.
+//!
+//! \details
+//!    The static part of the design keeps running throughout, so the
+//!    bridges stay enabled.  The static design must isolate the PR region
+//!    (for example with a freeze bridge) while PR_REQUEST is asserted.
+//!
+//!    The sequence is:
+//!
+//!    -# Check that the FPGA is in the User Mode state.
+//!
+//!    -# Set the \ref en bit of the FPGA Manager Control Register to 1 so
+//!       the HPS drives the configuration inputs.  \ref cdratio and
+//!       \ref cfgwdth are left as they were set for the full image.
+//!
+//!    -# Set the \ref prreq bit of the FPGA Manager Control Register to 1.
+//!
+//!    -# Poll the FPGA Monitor Register until PR_READY (\ref prr) is 1.
+//!
+//!    -# Clear the status bits (interrupts) from the CB.
+//!
+//!    -# Set the \ref axicfgen bit of the FPGA Manager Control Register to 1.
+//!
+//!    -# Write the PR data to the FPGA Manager Configuration Data register.
+//!
+//!    -# Poll the FPGA Monitor Register until PR_DONE (\ref prd) or
+//!       PR_ERROR (\ref pre) is 1.
+//!
+//!    -# Set the \ref axicfgen bit of the FPGA Manager Control Register to 0.
+//!
+//!    -# Set the \ref prreq bit of the FPGA Manager Control Register to 0.
+//!
+//!    -# Set the \ref en bit of the FPGA Manager Control Register to 0.
+//!
+//!    Steps 8 to 10 are also taken when the load fails so the static
+//!    design is left running.  The steps are numbered from 101 for the
+//!    probes.
+//!
+//! \param [in] rbf_source
+//!    Source of the PR data.
+//!
+//! \param [in] debug
+//!    Enables debugging messages.
+//!
+//! \returns
+//!    <b>EXIT_FAILURE</b> if the FPGA is not in User Mode.<br>
+//!    <b>EXIT_FAILURE</b> if PR_READY is not asserted.<br>
+//!    <b>EXIT_FAILURE</b> if the RBF source reports that the data was not intact.<br>
+//!    <b>EXIT_FAILURE</b> if PR_ERROR is asserted or PR_DONE is not.<br>
+//!    <b>EXIT_SUCCESS</b> if the PR region has been programmed.<br>
+//!
+
+int fpga_loader_t::loadPR(rbf_source_t &rbf_source, bool debug) {
+
+    hash = 0;
+    data_bytes = 0;
+    write_ns = 0;
+    fpgamgr_regs_t *fpgamgr_regs = io.fpgamgr_regs;
+
     //
-    // cleanup
+    // Step 1:
+    //  The static design must be running
     //
 
-#if 1
-    munmap(base_addr, len);
-#endif
+    RBF_PROBE1(step, 101);
 
-    close(fd);
+    if (get_state(fpgamgr_regs) != fpgamgr_regs_stat_t::mode_user) {
+        fprintf(stderr, "%s: partial reconfiguration needs a design in User state, not %s state.\n",
+                PROGNAME, print_state(fpgamgr_regs));
+        return EXIT_FAILURE;
+    }
 
-    return EXIT_SUCCESS;
+    //
+    // Step 2:
+    //  Let the HPS drive the configuration inputs
+    //
+
+    RBF_PROBE1(step, 102);
+
+    write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::en);
+
+    //
+    // Step 3:
+    //  Request partial reconfiguration
+    //
+
+    RBF_PROBE1(step, 103);
+
+    write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::prreq);
+
+    //
+    // Step 4:
+    //  Wait for PR_READY
+    //
+
+    RBF_PROBE1(step, 104);
+
+    int polls;
+    uint32_t status = 0;
+    for (polls = 0; polls < 1000; polls++) {
+        status = read32(&fpgamgr_regs->gpio_ext_porta);
+        if (status & (prr | pre)) {
+            break;
+        }
+        io.wait_us(10);
+    }
+
+    RBF_PROBE3(wait_done, 104, polls, (status & (prr | pre)) == prr);
+
+    bool ok = ((status & (prr | pre)) == prr);
+    if (!ok) {
+        fprintf(stderr, "%s: PR_READY was not asserted%s.\n", PROGNAME, (status & pre) ? " (PR_ERROR)" : "");
+    }
+
+    if (ok) {
+
+        //
+        // Step 5:
+        //  Clear the status bits (interrupts) from the CB
+        //
+
+        RBF_PROBE1(step, 105);
+
+        write32(&fpgamgr_regs->gpio_porta_eoi, 0x00000fff);
+
+        //
+        // Step 6:
+        //  Permit the HPS to send configuration data to the FPGA
+        //
+
+        RBF_PROBE1(step, 106);
+
+        write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) | fpgamgr_regs_ctrl_t::axicfgen);
+
+        //
+        // Step 7:
+        //  Write the PR data
+        //
+
+        RBF_PROBE1(step, 107);
+
+        uint64_t start = io.clock_ns();
+
+        size_t words = 0;
+        const uint32_t *chunk;
+        hash64_t data_hash;
+        for (size_t len; (len = rbf_source.next(&chunk)) != 0; words += len) {
+            RBF_PROBE3(chunk, words * sizeof(uint32_t), len * sizeof(uint32_t), chunk);
+            io.write_data(chunk, len);
+            data_hash.update(chunk, len * sizeof(uint32_t));
+        }
+        hash = data_hash.digest();
+        data_bytes = words * sizeof(uint32_t);
+        write_ns = io.clock_ns() - start;
+
+        if (debug) {
+            double secs = write_ns * 1e-9;
+            printf("%s: wrote %zu bytes of PR data in %.3f ms (%.1f MB/s)\n", PROGNAME,
+                   words * sizeof(uint32_t), secs * 1e3, words * sizeof(uint32_t) / secs / 1e6);
+        }
+
+        if (!rbf_source.good()) {
+            fprintf(stderr, "%s: PR data failed verification.\n", PROGNAME);
+            ok = false;
+        }
+    }
+
+    if (ok) {
+
+        //
+        // Step 8:
+        //  Wait for PR_DONE or PR_ERROR
+        //
+
+        RBF_PROBE1(step, 108);
+
+        for (polls = 0; polls < 1000; polls++) {
+            status = read32(&fpgamgr_regs->gpio_ext_porta);
+            if (status & (prd | pre)) {
+                break;
+            }
+            io.wait_us(10);
+        }
+
+        RBF_PROBE3(wait_done, 108, polls, (status & (prd | pre)) == prd);
+
+        ok = ((status & (prd | pre)) == prd);
+        if (!ok) {
+            fprintf(stderr, "%s: partial reconfiguration failed%s.\n", PROGNAME,
+                    (status & pre) ? " (PR_ERROR)" : " (no PR_DONE)");
+        }
+    }
+
+    //
+    // Step 9:
+    //  Stop the configuration data and end the request
+    //
+
+    RBF_PROBE1(step, 109);
+
+    write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::axicfgen);
+    write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::prreq);
+
+    //
+    // Step 10:
+    //  Give the configuration inputs back to the pins
+    //
+
+    RBF_PROBE1(step, 110);
+
+    write32(&fpgamgr_regs->ctrl, read32(&fpgamgr_regs->ctrl) & ~fpgamgr_regs_ctrl_t::en);
+
+    if (debug && ok) {
+        printf("%s: PR region programmed\n", PROGNAME);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -39,10 +39,25 @@
 #ifndef __FPGA_LOADER_H
 #define __FPGA_LOADER_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #define PROGNAME "fpga_loader"
 
+//!
+//! \brief
+//!    Monotonic time in nanoseconds
+//!
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+class fpga_io_t;
+
 //!
 //! \brief
 //!    The fpgamgr registers
@@ -97,6 +112,153 @@ struct sysmgr_regs_t {
     uint32_t pad3;                              //!< (0x030) Address space padding
 };
 
+//!
+//! \brief
+//!    Source of configuration data for the data phase (Step 10) of the load.
+//!
+//! \details
+//!    The loader pulls the configuration data from the source one chunk at a
+//!    time and writes each chunk to the FPGA Manager data port.  A chunk
+//!    remains valid until the next call to next().
+//!
+
+class rbf_source_t {
+
+    public:
+
+        virtual ~rbf_source_t(void) {}
+
+        //!
+        //! \brief
+        //!    Get the next chunk of configuration data.
+        //!
+        //! \param[out] chunk
+        //!    Set to point to the 32-bit words of the next chunk.
+        //!
+        //! \returns
+        //!    Number of 32-bit words in the chunk or zero at the end of data.
+        //!
+
+        virtual size_t next(const uint32_t **chunk) = 0;
+
+        //!
+        //! \brief
+        //!    Report whether the data that was supplied was intact.
+        //!
+        //! \details
+        //!    This is checked after the last chunk has been written.  A source
+        //!    that can detect corrupted data (e.g. a failed MAC) returns
+        //!    false and the loader holds the FPGA in reset.
+        //!
+
+        virtual bool good(void) {
+            return true;
+        }
+
+};
+
+//!
+//! \brief
+//!    Configuration data source for an image that is already in memory.
+//!
+//! \details
+//!    The image is supplied in chunks of the requested size, or all at once
+//!    if the chunk size is zero.
+//!
+
+class rbf_buffer_t : public rbf_source_t {
+
+    private:
+
+        const uint32_t *data;                   //!< Image data
+        size_t size;                            //!< Image size in 32-bit words
+        size_t chunk;                           //!< Chunk size in 32-bit words
+
+    public:
+
+        rbf_buffer_t(const uint32_t *data, size_t size, size_t chunk = 0) :
+            data(data),
+            size(size),
+            chunk(chunk) {
+        }
+
+        size_t next(const uint32_t **chunk) {
+            size_t ret = ((this->chunk == 0) || (size < this->chunk)) ? size : this->chunk;
+            *chunk = data;
+            data += ret;
+            size -= ret;
+            return ret;
+        }
+
+};
+
+//!
+//! \brief
+//!    Load phase hooks
+//!
+//! \details
+//!    The loader calls these at fixed points of the load.  A hook that
+//!    returns false stops the load.
+//!
+
+class fpga_hooks_t {
+
+    public:
+
+        virtual ~fpga_hooks_t(void) {}
+
+        //!
+        //! \brief
+        //!    Called just before Step 4 resets the FPGA.
+        //!
+        //! \details
+        //!    The old design is still running and its bridges still work.
+        //!    Returning false abandons the load and leaves the old design
+        //!    running.
+        //!
+
+        virtual bool pre_reset(void) {
+            return true;
+        }
+
+        //!
+        //! \brief
+        //!    Called after Step 10 has written all of the configuration
+        //!    data, before CONF_DONE is checked.
+        //!
+        //! \details
+        //!    Returning false holds the FPGA in reset so the new design
+        //!    never runs.
+        //!
+
+        virtual bool post_transfer(void) {
+            return true;
+        }
+
+        //!
+        //! \brief
+        //!    Called after Step 17 with the new design in user mode.
+        //!
+        //! \details
+        //!    The bridges have not been enabled.  Returning false fails the
+        //!    load.
+        //!
+
+        virtual bool post_user_mode(void) {
+            return true;
+        }
+
+        //!
+        //! \brief
+        //!    Called when the load fails for any reason, including a hook
+        //!    that returned false.
+        //!
+
+        virtual void failure(void) {
+        }
+
+};
+
 //!
 //! \brief
 //!    FPGA Loader object
@@ -104,7 +266,7 @@ struct sysmgr_regs_t {
 
 class fpga_loader_t  {
 
-    private:
+    public:
 
         //!
         //! \brief
@@ -165,6 +327,16 @@ class fpga_loader_t  {
             dcntdone     = 0x00000001,          //!< Asserted when DCLKCNT has decremented to zero
         };
 
+    private:
+
+        fpga_io_t &io;                          //!< HPS register access
+        fpga_hooks_t *hooks;                    //!< Load phase hooks or NULL
+        uint64_t hash;                          //!< hash64_t of the data last written
+        size_t data_bytes;                      //!< Bytes of data last written
+        uint64_t write_ns;                      //!< Time taken to write them
+
+        int load(rbf_source_t &rbf_source, bool debug);
+
         //!
         //! \brief
         //!    Read a 32-bit word from IO
@@ -176,9 +348,7 @@ class fpga_loader_t  {
         //!    This is native endian.
         //!
 
-        uint32_t read32(volatile void *addr) {
-            return *(uint32_t*)addr;
-        }
+        uint32_t read32(volatile void *addr);
 
         //!
         //! \brief
@@ -194,9 +364,7 @@ class fpga_loader_t  {
         //!    This is native endian.
         //!
 
-        void write32(volatile void *addr, uint32_t val) {
-            *(uint32_t*)addr = val;
-        }
+        void write32(volatile void *addr, uint32_t val);
 
         //!
         //! \brief
@@ -261,7 +429,63 @@ class fpga_loader_t  {
 
     public:
 
+        fpga_loader_t(fpga_io_t &io, fpga_hooks_t *hooks = NULL) :
+            io(io),
+            hooks(hooks),
+            hash(0),
+            data_bytes(0),
+            write_ns(0) {
+        }
+
         int loadFPGA(const uint32_t *rbf_data, size_t rbf_size, bool debug);
+        int loadFPGA(rbf_source_t &rbf_source, bool debug);
+        int loadPR(rbf_source_t &rbf_source, bool debug);
+
+        //!
+        //! \brief
+        //!    Get the hash of the data written by the last load.
+        //!
+        //! \details
+        //!    The data is hashed with hash64_t as it is written, while each
+        //!    chunk is still in the cache, so the hash is the same as that of
+        //!    the cleartext rbf file without a second pass over it.
+        //!
+        //! \returns
+        //!    The hash, or zero if no data has been written.
+        //!
+
+        uint64_t data_hash(void) const {
+            return hash;
+        }
+
+        //!
+        //! \brief
+        //!    Get the size of the data written by the last load.
+        //!
+        //! \returns
+        //!    Bytes written to the configuration data register.
+        //!
+
+        size_t data_size(void) const {
+            return data_bytes;
+        }
+
+        //!
+        //! \brief
+        //!    Get the time taken to write the data of the last load.
+        //!
+        //! \details
+        //!    This is the time of the data transfer only (Step 10 of a full
+        //!    load, Step 7 of a PR load), without the reset and the wait for
+        //!    user mode around it.
+        //!
+        //! \returns
+        //!    Time in nanoseconds.
+        //!
+
+        uint64_t data_ns(void) const {
+            return write_ns;
+        }
 
 };
 
@@ -0,0 +1,133 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA loader plugin interface
+//!
+//! \details
+//!    This is the binary interface between the loader and plugins that are
+//!    loaded with --plugin.  It is plain C so that plugins can be written in
+//!    C or C++ and built separately from the loader.
+//!
+//!    A plugin is a shared object that defines a struct fpga_plugin named
+//!    fpga_plugin:
+//!
+//!    \code
+//!    #include "fpga_plugin.h"
+//!
+//!    static int relay_off(struct fpga_plugin_context *context) {
+//!        ... 0 to continue, nonzero to stop the load ...
+//!    }
+//!
+//!    const struct fpga_plugin fpga_plugin = {
+//!        FPGA_PLUGIN_ABI_VERSION, sizeof(struct fpga_plugin), "relay",
+//!        NULL, relay_off, NULL, NULL, NULL, NULL,
+//!    };
+//!    \endcode
+//!
+//!    and is built with <tt>gcc -shared -fPIC -o relay.so relay.c</tt>.  In
+//!    C++, the definition must be <tt>extern "C"</tt> so that it is exported
+//!    under its C name.
+//!
+//!    Compatibility rules: members are only ever added to the end of both
+//!    structures.  Each side records the size of its structure, and the
+//!    other side does not use members beyond it.  A change that is not
+//!    compatible increments FPGA_PLUGIN_ABI_VERSION, and the loader refuses
+//!    plugins built for another version.
+//!
+//! \file
+//!    fpga_plugin.h
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_PLUGIN_H
+#define __FPGA_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FPGA_PLUGIN_ABI_VERSION 1               //!< Version of this interface
+#define FPGA_PLUGIN_SYMBOL      "fpga_plugin"   //!< Name of the struct fpga_plugin
+
+//!
+//! \brief
+//!    What the loader gives a plugin
+//!
+//! \details
+//!    The context is passed to every callback.  The register pointers are
+//!    the loader's mappings of the FPGA Manager (fpgamgr_regs_t in
+//!    fpga_loader.hpp) and the System Manager (sysmgr_regs_t).  Accessing
+//!    them through read_reg() and write_reg() also works with --simulate
+//!    and --check.
+//!
+
+struct fpga_plugin_context {
+    uint32_t abi_version;                       //!< FPGA_PLUGIN_ABI_VERSION of the loader
+    uint32_t size;                              //!< Size of this structure in the loader
+    volatile void *fpgamgr_regs;                //!< FPGA Manager registers
+    volatile void *sysmgr_regs;                 //!< System Manager registers
+    const char *argument;                       //!< Text after the ':' in --plugin=file:argument, or ""
+    int simulated;                              //!< Non-zero if the FPGA is simulated
+    void *data;                                 //!< Private to the plugin
+    uint32_t (*read_reg)(struct fpga_plugin_context *context, volatile void *addr);
+    void (*write_reg)(struct fpga_plugin_context *context, volatile void *addr, uint32_t value);
+};
+
+//!
+//! \brief
+//!    What a plugin gives the loader
+//!
+//! \details
+//!    Any callback may be NULL.  The callbacks that return int return zero
+//!    to continue and non-zero to stop: a failing init() stops the loader
+//!    before the FPGA is touched, and a failing phase callback fails the
+//!    load as described for fpga_hooks_t.  failure() is called when the load
+//!    fails for any reason.  fini() is called when the loader exits, if
+//!    init() succeeded or was NULL.
+//!
+
+struct fpga_plugin {
+    uint32_t abi_version;                       //!< FPGA_PLUGIN_ABI_VERSION of the plugin
+    uint32_t size;                              //!< sizeof(struct fpga_plugin) in the plugin
+    const char *name;                           //!< Name used in messages
+    int  (*init)(struct fpga_plugin_context *context);
+    int  (*pre_reset)(struct fpga_plugin_context *context);
+    int  (*post_transfer)(struct fpga_plugin_context *context);
+    int  (*post_user_mode)(struct fpga_plugin_context *context);
+    void (*failure)(struct fpga_plugin_context *context);
+    void (*fini)(struct fpga_plugin_context *context);
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
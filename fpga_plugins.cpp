@@ -0,0 +1,336 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Plugin host
+//!
+//! \file
+//!    fpga_plugins.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fpga_plugins.hpp"
+
+const char *const fpga_plugins_t::names[phases] = {
+    "pre-reset",
+    "post-transfer",
+    "post-user-mode",
+    "failure",
+};
+
+//
+// Check that a plugin's struct fpga_plugin includes a member
+//
+
+#define HAS_MEMBER(ops, member) \
+    ((ops)->size >= offsetof(struct fpga_plugin, member) + sizeof((ops)->member))
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] io
+//!    HPS register access.
+//!
+//! \param[in] simulated
+//!    The FPGA is simulated.  This is passed on to the plugins.
+//!
+
+fpga_plugins_t::fpga_plugins_t(fpga_io_t &io, bool simulated) :
+    io(io),
+    simulated(simulated),
+    next(NULL) {
+}
+
+//!
+//! \brief
+//!    Destructor.  This finishes and unloads the plugins in reverse order.
+//!
+
+fpga_plugins_t::~fpga_plugins_t(void) {
+    for (size_t i = plugins.size(); i-- > 0; ) {
+        plugin_t &plugin = plugins[i];
+        if (plugin.started && HAS_MEMBER(plugin.ops, fini) && plugin.ops->fini) {
+            plugin.ops->fini(&plugin.binding.context);
+        }
+        dlclose(plugin.handle);
+    }
+}
+
+//!
+//! \brief
+//!    Load a plugin.
+//!
+//! \details
+//!    The plugin is loaded and checked, but not started.  Problems are found
+//!    before the FPGA is touched.
+//!
+//! \param[in] spec
+//!    <tt>file</tt> or <tt>file:argument</tt>.  A file name without a '/'
+//!    is searched for by dlopen().
+//!
+//! \returns
+//!    True if the plugin was loaded.
+//!
+
+bool fpga_plugins_t::add(const char *spec) {
+
+    plugin_t plugin;
+    memset(&plugin.binding, 0, sizeof(plugin.binding));
+    memset(plugin.calls, 0, sizeof(plugin.calls));
+    memset(plugin.ns, 0, sizeof(plugin.ns));
+    plugin.path    = spec;
+    plugin.ops     = NULL;
+    plugin.started = false;
+
+    const char *slash = strrchr(spec, '/');
+    const char *colon = strchr(slash ? slash : spec, ':');
+    if (colon) {
+        plugin.path     = std::string(spec, colon);
+        plugin.argument = colon + 1;
+    }
+
+    plugin.handle = dlopen(plugin.path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (plugin.handle == NULL) {
+        fprintf(stderr, "%s: %s\n", PROGNAME, dlerror());
+        return false;
+    }
+
+    plugin.ops = (const fpga_plugin *)dlsym(plugin.handle, FPGA_PLUGIN_SYMBOL);
+    if (plugin.ops == NULL) {
+        fprintf(stderr, "%s: %s: not a plugin (no \"" FPGA_PLUGIN_SYMBOL "\" symbol)\n", PROGNAME,
+                plugin.path.c_str());
+        dlclose(plugin.handle);
+        return false;
+    }
+
+    if ((plugin.ops->abi_version != FPGA_PLUGIN_ABI_VERSION) || !HAS_MEMBER(plugin.ops, name)) {
+        fprintf(stderr, "%s: %s: plugin was built for interface version %u, not %u\n", PROGNAME,
+                plugin.path.c_str(), plugin.ops->abi_version, FPGA_PLUGIN_ABI_VERSION);
+        dlclose(plugin.handle);
+        return false;
+    }
+
+    plugins.push_back(plugin);
+    return true;
+}
+
+//!
+//! \brief
+//!    Start the plugins.
+//!
+//! \details
+//!    This is called once the registers are mapped and before the FPGA is
+//!    touched.  If a plugin fails to start, the plugins that have started
+//!    are finished by the destructor.
+//!
+//! \returns
+//!    True if every plugin started.
+//!
+
+bool fpga_plugins_t::start(void) {
+    for (size_t i = 0; i < plugins.size(); i++) {
+        plugin_t &plugin = plugins[i];
+        fpga_plugin_context &context = plugin.binding.context;
+        context.abi_version  = FPGA_PLUGIN_ABI_VERSION;
+        context.size         = sizeof(context);
+        context.fpgamgr_regs = io.fpgamgr_regs;
+        context.sysmgr_regs  = io.sysmgr_regs;
+        context.argument     = plugin.argument.c_str();
+        context.simulated    = simulated;
+        context.read_reg     = read_reg;
+        context.write_reg    = write_reg;
+        plugin.binding.io    = &io;
+
+        if (HAS_MEMBER(plugin.ops, init) && plugin.ops->init && (plugin.ops->init(&context) != 0)) {
+            fprintf(stderr, "%s: plugin %s failed to start\n", PROGNAME, plugin.ops->name);
+            return false;
+        }
+        plugin.started = true;
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Chain other hooks.
+//!
+//! \param[in] hooks
+//!    Hooks to call along with the plugins, or NULL.
+//!
+
+void fpga_plugins_t::chain(fpga_hooks_t *hooks) {
+    next = hooks;
+}
+
+//!
+//! \brief
+//!    Read a register for a plugin.
+//!
+
+uint32_t fpga_plugins_t::read_reg(fpga_plugin_context *context, volatile void *addr) {
+    return ((binding_t *)context)->io->read_reg(addr);
+}
+
+//!
+//! \brief
+//!    Write a register for a plugin.
+//!
+
+void fpga_plugins_t::write_reg(fpga_plugin_context *context, volatile void *addr, uint32_t value) {
+    ((binding_t *)context)->io->write_reg(addr, value);
+}
+
+//!
+//! \brief
+//!    Call every plugin at a phase and time it.
+//!
+//! \param[in] phase
+//!    Load phase.
+//!
+//! \returns
+//!    False if a plugin stopped the load.  The remaining plugins are not
+//!    called.
+//!
+
+bool fpga_plugins_t::call(phase_t phase) {
+    for (size_t i = 0; i < plugins.size(); i++) {
+        plugin_t &plugin = plugins[i];
+        const fpga_plugin *ops = plugin.ops;
+        fpga_plugin_context *context = &plugin.binding.context;
+
+        int (*hook)(fpga_plugin_context *) = NULL;
+        void (*failure)(fpga_plugin_context *) = NULL;
+        switch (phase) {
+            case pre_reset_phase:
+                hook = HAS_MEMBER(ops, pre_reset) ? ops->pre_reset : NULL;
+                break;
+            case post_transfer_phase:
+                hook = HAS_MEMBER(ops, post_transfer) ? ops->post_transfer : NULL;
+                break;
+            case post_user_mode_phase:
+                hook = HAS_MEMBER(ops, post_user_mode) ? ops->post_user_mode : NULL;
+                break;
+            default:
+                failure = HAS_MEMBER(ops, failure) ? ops->failure : NULL;
+                break;
+        }
+        if (!hook && !failure) {
+            continue;
+        }
+
+        uint64_t start = now_ns();
+        int ret = 0;
+        if (hook) {
+            ret = hook(context);
+        } else {
+            failure(context);
+        }
+        plugin.ns[phase] += now_ns() - start;
+        plugin.calls[phase]++;
+
+        if (ret != 0) {
+            fprintf(stderr, "%s: plugin %s stopped the load at %s\n", PROGNAME, ops->name, names[phase]);
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Pre-reset phase.  The plugins run before the chained hooks.
+//!
+
+bool fpga_plugins_t::pre_reset(void) {
+    if (!call(pre_reset_phase)) {
+        return false;
+    }
+    return !next || next->pre_reset();
+}
+
+//!
+//! \brief
+//!    Post-transfer phase.  The plugins run after the chained hooks.
+//!
+
+bool fpga_plugins_t::post_transfer(void) {
+    if (next && !next->post_transfer()) {
+        return false;
+    }
+    return call(post_transfer_phase);
+}
+
+//!
+//! \brief
+//!    Post-user-mode phase.  The plugins run after the chained hooks.
+//!
+
+bool fpga_plugins_t::post_user_mode(void) {
+    if (next && !next->post_user_mode()) {
+        return false;
+    }
+    return call(post_user_mode_phase);
+}
+
+//!
+//! \brief
+//!    Failure.  The plugins run after the chained hooks.
+//!
+
+void fpga_plugins_t::failure(void) {
+    if (next) {
+        next->failure();
+    }
+    call(failure_phase);
+}
+
+//!
+//! \brief
+//!    Print the time spent in each plugin at each phase.
+//!
+
+void fpga_plugins_t::report(void) const {
+    for (size_t i = 0; i < plugins.size(); i++) {
+        const plugin_t &plugin = plugins[i];
+        printf("%s: plugin %s:", PROGNAME, plugin.ops->name);
+        const char *sep = "";
+        for (int phase = 0; phase < phases; phase++) {
+            if (plugin.calls[phase]) {
+                printf("%s %s %.3f ms", sep, names[phase], plugin.ns[phase] * 1e-6);
+                sep = ",";
+            }
+        }
+        printf("%s\n", *sep ? "" : " not called");
+    }
+}
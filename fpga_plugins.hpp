@@ -0,0 +1,152 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Plugin host header file
+//!
+//! \details
+//!    Load plugins with dlopen() and call them at the phases of the load.
+//!
+//! \file
+//!    fpga_plugins.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_PLUGINS_H
+#define __FPGA_PLUGINS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fpga_io.hpp"
+#include "fpga_loader.hpp"
+#include "fpga_plugin.h"
+
+//!
+//! \brief
+//!    Plugin host object
+//!
+//! \details
+//!    The plugins are load phase hooks (see fpga_hooks_t) that run in the
+//!    loader process, so a site-specific action costs a function call
+//!    rather than a fork() and exec() of a script.  Other hooks, such as
+//!    fabric_state_t, are chained: the plugins run before them at
+//!    pre-reset, and after them at the later phases, so the old design is
+//!    quiesced just before the reset and restored before the plugins see
+//!    the new design.
+//!
+//!    Each callback is timed, and report() prints the time spent in each
+//!    plugin at each phase.
+//!
+
+class fpga_plugins_t : public fpga_hooks_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Load phases
+        //!
+
+        enum phase_t {
+            pre_reset_phase,                    //!< fpga_plugin::pre_reset
+            post_transfer_phase,                //!< fpga_plugin::post_transfer
+            post_user_mode_phase,               //!< fpga_plugin::post_user_mode
+            failure_phase,                      //!< fpga_plugin::failure
+            phases,                             //!< Number of phases
+        };
+
+    private:
+
+        //!
+        //! \brief
+        //!    Context with the loader's side attached
+        //!
+        //! \details
+        //!    The context must be the first member: the register access
+        //!    callbacks find the fpga_io_t from the context.
+        //!
+
+        struct binding_t {
+            fpga_plugin_context context;        //!< Context passed to the callbacks
+            fpga_io_t *io;                      //!< HPS register access
+        };
+
+        //!
+        //! \brief
+        //!    A loaded plugin
+        //!
+
+        struct plugin_t {
+            binding_t binding;                  //!< Context passed to the callbacks
+            std::string path;                   //!< Shared object
+            std::string argument;               //!< Plugin argument
+            void *handle;                       //!< dlopen() handle
+            const fpga_plugin *ops;             //!< Callbacks
+            bool started;                       //!< init() succeeded
+            unsigned int calls[phases];         //!< Callbacks made
+            uint64_t ns[phases];                //!< Time spent in the callbacks
+        };
+
+        static const char *const names[phases]; //!< Phase names
+
+        fpga_io_t &io;                          //!< HPS register access
+        bool simulated;                         //!< The FPGA is simulated
+        fpga_hooks_t *next;                     //!< Chained hooks or NULL
+        std::vector<plugin_t> plugins;          //!< Loaded plugins
+
+        static uint32_t read_reg(fpga_plugin_context *context, volatile void *addr);
+        static void write_reg(fpga_plugin_context *context, volatile void *addr, uint32_t value);
+        bool call(phase_t phase);
+
+    public:
+
+        fpga_plugins_t(fpga_io_t &io, bool simulated);
+        ~fpga_plugins_t(void);
+        bool add(const char *spec);
+        bool start(void);
+        void chain(fpga_hooks_t *hooks);
+        void report(void) const;
+
+        bool pre_reset(void);
+        bool post_transfer(void);
+        bool post_user_mode(void);
+        void failure(void);
+
+        //!
+        //! \brief
+        //!    Check whether any plugins were added.
+        //!
+
+        bool empty(void) const {
+            return plugins.empty();
+        }
+
+};
+
+#endif
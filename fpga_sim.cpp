@@ -0,0 +1,395 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Simulated FPGA
+//!
+//! \file
+//!    fpga_sim.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "fpga_loader.hpp"
+#include "fpga_sim.hpp"
+
+//
+// MSEL[4:0] as set on the DE10-Nano
+//
+
+static const uint32_t msel = 0x0a;
+
+//
+// Virtual time of an event that is not pending
+//
+
+static const uint64_t forever = ~0ULL;
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+fpga_sim_t::fpga_sim_t(void) :
+    words(0),
+    pr_words(0),
+    h2f(NULL),
+    timing(),
+    virtual_time(false),
+    clock(0),
+    next_mode(0),
+    mode_ns(forever),
+    dclk_ns(forever) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+fpga_sim_t::~fpga_sim_t(void) {
+    close();
+}
+
+//!
+//! \brief
+//!    Allocate the simulated HPS peripherals.
+//!
+//! \details
+//!    The memory has the same layout as the 16 MB HPS peripheral region so
+//!    the register pointers are set up exactly as they are for the hardware.
+//!    The simulated FPGA starts in user mode with its bridges enabled.
+//!
+//! \returns
+//!    True if the memory was allocated.
+//!
+
+bool fpga_sim_t::open(void) {
+
+    base_addr = (char *)calloc(1, hps_size);
+    if (!base_addr) {
+        fprintf(stderr, "%s: unable to allocate simulated FPGA.\n", PROGNAME);
+        return false;
+    }
+
+    fpgamgr_regs     = (fpgamgr_regs_t*)&base_addr[fpgamgr_addr  - hps_base];
+    fpgamgr_data     = (uint32_t      *)&base_addr[fpgadata_addr - hps_base];
+    sysmgr_regs      = (sysmgr_regs_t *)&base_addr[sysmgr_addr   - hps_base];
+    rstmgr_brgmodrst = (uint32_t      *)&base_addr[rstmgr_addr   - hps_base + 0x1c];
+    l3regs_remap     = (uint32_t      *)&base_addr[l3regs_addr   - hps_base];
+    lwh2f            = (uint8_t       *)&base_addr[lwh2f_addr    - hps_base];
+
+    //
+    // The HPS-to-FPGA window is only backed where it is written.  If it
+    // cannot be reserved, each mapping gets its own memory instead.
+    //
+
+    void *addr = mmap(NULL, h2f_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    h2f = (addr != MAP_FAILED) ? (uint8_t *)addr : NULL;
+
+    set_mode(fpga_loader_t::mode_user);
+    return true;
+}
+
+//!
+//! \brief
+//!    Release the simulated HPS peripherals.
+//!
+
+void fpga_sim_t::close(void) {
+    free(base_addr);
+    base_addr = NULL;
+    if (h2f) {
+        munmap(h2f, h2f_size);
+        h2f = NULL;
+    }
+}
+
+//!
+//! \brief
+//!    Map memory that stands in for part of the HPS-to-FPGA bridge.
+//!
+
+uint8_t *fpga_sim_t::map_h2f(uint32_t offset, size_t size) {
+    if ((offset >= h2f_size) || (size > h2f_size - offset)) {
+        fprintf(stderr, "%s: offset 0x%08x is outside of the hps2fpga window.\n", PROGNAME, offset);
+        return NULL;
+    }
+    return h2f ? h2f + offset : (uint8_t *)calloc(1, size);
+}
+
+//!
+//! \brief
+//!    Release memory returned by map_h2f().
+//!
+
+void fpga_sim_t::unmap_h2f(uint8_t *addr, size_t) {
+    if (!h2f) {
+        free(addr);
+    }
+}
+
+//!
+//! \brief
+//!    Set the mode bits of the FPGA Manager Status Register and the
+//!    nSTATUS and CONF_DONE signals that go with them.
+//!
+
+void fpga_sim_t::set_mode(uint32_t mode) {
+    uint32_t porta = 0;
+    switch (mode) {
+        case fpga_loader_t::mode_config:
+            porta = fpga_loader_t::ns;
+            break;
+        case fpga_loader_t::mode_init:
+        case fpga_loader_t::mode_user:
+            porta = fpga_loader_t::ns | fpga_loader_t::cd | fpga_loader_t::id;
+            break;
+    }
+    fpgamgr_regs->stat = (msel << 3) | mode;
+    fpgamgr_regs->gpio_ext_porta = porta;
+}
+
+//!
+//! \brief
+//!    Schedule a mode change.
+//!
+//! \param[in] mode
+//!    New mode
+//!
+//! \param[in] from_ns
+//!    Virtual time the delay starts.
+//!
+//! \param[in] delay_us
+//!    Delay in microseconds, or <tt>never</tt>.
+//!
+
+void fpga_sim_t::schedule(uint32_t mode, uint64_t from_ns, uint32_t delay_us) {
+    next_mode = mode;
+    mode_ns   = (delay_us == never) ? forever : from_ns + delay_us * 1000ULL;
+    update();
+}
+
+//!
+//! \brief
+//!    Apply the events that are due at the current virtual time.
+//!
+
+void fpga_sim_t::update(void) {
+    if (mode_ns <= clock) {
+        set_mode(next_mode);
+        next_mode = 0;
+        mode_ns   = forever;
+    }
+    if (dclk_ns <= clock) {
+        uint64_t at = dclk_ns;
+        dclk_ns = forever;
+        write32(&fpgamgr_regs->dclkstat, fpga_loader_t::dcntdone);
+        if ((fpgamgr_regs->stat & fpga_loader_t::mode) == fpga_loader_t::mode_init) {
+            schedule(fpga_loader_t::mode_user, at, timing.user_us);
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Read a simulated register.
+//!
+//! \details
+//!    CONF_DONE is asserted once configuration data has been written, and
+//!    PR_DONE once PR data has been written.  GPI follows GPO in user mode.
+//!
+
+uint32_t fpga_sim_t::read_reg(volatile void *addr) {
+    update();
+    if (addr == &fpgamgr_regs->gpi) {
+        bool user = (fpgamgr_regs->stat & fpga_loader_t::mode) == fpga_loader_t::mode_user;
+        return user ? read32(&fpgamgr_regs->gpo) : 0;
+    }
+    if ((addr == &fpgamgr_regs->gpio_ext_porta) &&
+        ((fpgamgr_regs->stat & fpga_loader_t::mode) == fpga_loader_t::mode_config) && words && !next_mode) {
+        schedule(fpga_loader_t::mode_init, clock, timing.init_us);
+    }
+    if ((addr == &fpgamgr_regs->gpio_ext_porta) && (fpgamgr_regs->gpio_ext_porta & fpga_loader_t::prr) &&
+        pr_words) {
+        fpgamgr_regs->gpio_ext_porta |= fpga_loader_t::prd;
+    }
+    return read32(addr);
+}
+
+//!
+//! \brief
+//!    Write a simulated register.
+//!
+
+void fpga_sim_t::write_reg(volatile void *addr, uint32_t val) {
+
+    update();
+    uint32_t mode = fpgamgr_regs->stat & fpga_loader_t::mode;
+
+    if (addr == &fpgamgr_regs->ctrl) {
+
+        //
+        // nCONFIG resets the FPGA and releasing it starts configuration
+        //
+
+        write32(addr, val);
+        if (val & fpga_loader_t::en) {
+            if (val & fpga_loader_t::nconfigpull) {
+                hash    = hash64_t();
+                words   = 0;
+                dclk_ns = forever;
+                if (h2f) {
+                    madvise(h2f, h2f_size, MADV_DONTNEED);
+                }
+                if ((mode != fpga_loader_t::mode_reset) && (next_mode != fpga_loader_t::mode_reset)) {
+                    schedule(fpga_loader_t::mode_reset, clock, timing.reset_us);
+                }
+            } else if ((mode == fpga_loader_t::mode_reset) && !next_mode) {
+                schedule(fpga_loader_t::mode_config, clock, timing.config_us);
+            }
+        }
+
+        //
+        // prreq starts partial reconfiguration of the design in user mode
+        //
+
+        uint32_t porta = fpgamgr_regs->gpio_ext_porta;
+        if ((mode == fpga_loader_t::mode_user) && (val & fpga_loader_t::en) && (val & fpga_loader_t::prreq)) {
+            if (!(porta & fpga_loader_t::prr)) {
+                pr_hash  = hash64_t();
+                pr_words = 0;
+                fpgamgr_regs->gpio_ext_porta = (porta & ~(fpga_loader_t::prd | fpga_loader_t::pre)) | fpga_loader_t::prr;
+            }
+        } else if (!(val & fpga_loader_t::prreq)) {
+            fpgamgr_regs->gpio_ext_porta = porta & ~(fpga_loader_t::prr | fpga_loader_t::prd | fpga_loader_t::pre);
+        }
+
+    } else if (addr == &fpgamgr_regs->dclkcnt) {
+
+        //
+        // The DCLKs complete initialization
+        //
+
+        write32(addr, 0);
+        if (val != 0) {
+            dclk_ns = (timing.dclk_us == never) ? forever : clock + timing.dclk_us * 1000ULL;
+            update();
+        }
+
+    } else if (addr == &fpgamgr_regs->dclkstat) {
+
+        //
+        // dcntdone is write-one-to-clear
+        //
+
+        write32(addr, read32(addr) & ~val);
+
+    } else if (addr != &fpgamgr_regs->gpio_porta_eoi) {
+        write32(addr, val);
+    }
+}
+
+//!
+//! \brief
+//!    Count and hash configuration data.
+//!
+//! \details
+//!    Data is ignored unless the FPGA is in configuration mode, or in user
+//!    mode with PR_READY asserted, and the AXI configuration interface is
+//!    enabled, as it would be by the hardware.
+//!
+
+void fpga_sim_t::write_data(const uint32_t *data, size_t len) {
+    update();
+    if (((fpgamgr_regs->stat & fpga_loader_t::mode) == fpga_loader_t::mode_config) &&
+        (fpgamgr_regs->ctrl & fpga_loader_t::axicfgen)) {
+        hash.update(data, len * sizeof(uint32_t));
+        words += len;
+    } else if (((fpgamgr_regs->stat & fpga_loader_t::mode) == fpga_loader_t::mode_user) &&
+               (fpgamgr_regs->ctrl & fpga_loader_t::axicfgen) &&
+               (fpgamgr_regs->gpio_ext_porta & fpga_loader_t::prr)) {
+        pr_hash.update(data, len * sizeof(uint32_t));
+        pr_words += len;
+    }
+    if (timing.rate > 0) {
+        clock += (uint64_t)(len * sizeof(uint32_t) * 1000 / timing.rate);
+    }
+}
+
+//!
+//! \brief
+//!    Advance the virtual clock instead of waiting.
+//!
+
+void fpga_sim_t::wait_us(unsigned int usecs) {
+    clock += usecs * 1000ULL;
+    update();
+}
+
+//!
+//! \brief
+//!    The virtual clock once power_on() has been called, otherwise the real
+//!    one.
+//!
+
+uint64_t fpga_sim_t::clock_ns(void) {
+    return virtual_time ? clock : now_ns();
+}
+
+//!
+//! \brief
+//!    Start the simulated FPGA over in user mode with new timing.
+//!
+//! \details
+//!    The FPGA Manager registers are cleared and the virtual clock restarts
+//!    at zero, so one simulated FPGA can be used for many loads without
+//!    the cost of open().  The loader's measurements use the virtual clock
+//!    from now on.
+//!
+//! \param[in] timing
+//!    State change delays
+//!
+
+void fpga_sim_t::power_on(const timing_t &timing) {
+    this->timing = timing;
+    virtual_time = true;
+    clock        = 0;
+    next_mode    = 0;
+    mode_ns      = forever;
+    dclk_ns      = forever;
+    hash         = hash64_t();
+    words        = 0;
+    pr_hash      = hash64_t();
+    pr_words     = 0;
+    memset((void *)fpgamgr_regs, 0, sizeof(*fpgamgr_regs));
+    set_mode(fpga_loader_t::mode_user);
+}
@@ -0,0 +1,177 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Simulated FPGA header file
+//!
+//! \details
+//!    This object stands in for the HPS registers so that the loader can be
+//!    exercised on a machine without an FPGA.
+//!
+//! \file
+//!    fpga_sim.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_SIM_H
+#define __FPGA_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fpga_io.hpp"
+#include "hash64.hpp"
+
+//!
+//! \brief
+//!    Simulated FPGA object
+//!
+//! \details
+//!    The registers are ordinary memory.  Writes to the FPGA Manager control
+//!    and DCLK registers move a model of the configuration block through the
+//!    reset, configuration, initialization and user mode states the way the
+//!    hardware does.  The configuration data is counted and hashed instead
+//!    of being programmed.
+//!
+//!    The bridge windows are ordinary memory too, so the bridge self-test
+//!    passes against a simulated device.  The HPS-to-FPGA window is one
+//!    sparse mapping that is cleared when the FPGA is reset, like the
+//!    memories of a real design.  The simulated FPGA starts in user mode
+//!    with its bridges enabled, and in user mode GPI follows GPO as it
+//!    would for a design with a loopback.
+//!
+//!    The simulation runs in virtual time.  State changes are events that
+//!    happen after the delays given to power_on(), and waiting advances
+//!    the virtual clock instead of sleeping, so a load that takes hundreds
+//!    of milliseconds on the hardware, or one that times out, runs as fast
+//!    as the loader can poll.  With the default timing every state change
+//!    is immediate.
+//!
+//!    Partial reconfiguration is modeled in user mode: PR_READY follows
+//!    prreq, and PR_DONE is asserted once PR data has been written.  The PR
+//!    data is counted and hashed separately.
+//!
+
+class fpga_sim_t : public fpga_io_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Timing of the simulated configuration block
+        //!
+        //! \details
+        //!    Delays are in microseconds of virtual time.  A delay of
+        //!    <tt>never</tt> keeps the state change from happening.
+        //!
+
+        struct timing_t {
+            uint32_t reset_us;                  //!< nCONFIG asserted to the reset state
+            uint32_t config_us;                 //!< nCONFIG released to the configuration state
+            uint32_t init_us;                   //!< CONF_DONE polled to the initialization state
+            uint32_t dclk_us;                   //!< DCLK count written to dcntdone
+            uint32_t user_us;                   //!< dcntdone to the user mode state
+            double   rate;                      //!< Configuration data rate in MB/s, or 0 for no delay
+        };
+
+        static const uint32_t never = 0xffffffff;
+
+    private:
+
+        hash64_t hash;                          //!< Hash of the configuration data
+        size_t words;                           //!< Configuration data written
+        hash64_t pr_hash;                       //!< Hash of the PR data
+        size_t pr_words;                        //!< PR data written
+        uint8_t *h2f;                           //!< HPS-to-FPGA window or NULL
+        timing_t timing;                        //!< State change delays
+        bool virtual_time;                      //!< clock_ns() returns the virtual clock
+        uint64_t clock;                         //!< Virtual clock in nanoseconds
+        uint32_t next_mode;                     //!< Pending mode, or 0
+        uint64_t mode_ns;                       //!< Virtual time of the pending mode
+        uint64_t dclk_ns;                       //!< Virtual time dcntdone is set
+
+        void set_mode(uint32_t mode);
+        void schedule(uint32_t mode, uint64_t from_ns, uint32_t delay_us);
+        void update(void);
+
+    public:
+
+        fpga_sim_t(void);
+        ~fpga_sim_t(void);
+        bool open(void);
+        void close(void);
+        uint8_t *map_h2f(uint32_t offset, size_t size);
+        void unmap_h2f(uint8_t *addr, size_t size);
+        uint32_t read_reg(volatile void *addr);
+        void write_reg(volatile void *addr, uint32_t val);
+        void write_data(const uint32_t *data, size_t len);
+        void wait_us(unsigned int usecs);
+        uint64_t clock_ns(void);
+        virtual void power_on(const timing_t &timing);
+
+        //!
+        //! \brief
+        //!    Number of bytes of configuration data written since the FPGA
+        //!    was last reset.
+        //!
+
+        size_t data_size(void) const {
+            return words * sizeof(uint32_t);
+        }
+
+        //!
+        //! \brief
+        //!    hash64_t of the configuration data written since the FPGA was
+        //!    last reset.
+        //!
+
+        uint64_t data_hash(void) const {
+            return hash.digest();
+        }
+
+        //!
+        //! \brief
+        //!    Number of bytes of PR data written since PR was last
+        //!    requested.
+        //!
+
+        size_t pr_size(void) const {
+            return pr_words * sizeof(uint32_t);
+        }
+
+        //!
+        //! \brief
+        //!    hash64_t of the PR data written since PR was last requested.
+        //!
+
+        uint64_t pr_data_hash(void) const {
+            return pr_hash.digest();
+        }
+
+};
+
+#endif
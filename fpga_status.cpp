@@ -0,0 +1,551 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA status
+//!
+//! \file
+//!    fpga_status.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "fpga_io.hpp"
+#include "fpga_loader.hpp"
+#include "fpga_status.hpp"
+
+const char fpga_status_t::magic[8] = {'K', 'S', '1', '0', 'F', 'P', 'G', 'S'};
+
+const char *const fpga_status_t::names[states] = {
+    "unknown",
+    "reset",
+    "configuring",
+    "user mode",
+    "failed",
+    "CRC error",
+};
+
+//
+// Size of the status file
+//
+
+static const size_t page_size = 4096;
+
+//!
+//! \brief
+//!    Wait on or wake a futex in a shared mapping.
+//!
+
+static long futex(uint32_t *addr, int op, uint32_t val, const struct timespec *timeout) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+//!
+//! \brief
+//!    Constructor.  Nothing is published until open() is called.
+//!
+
+fpga_status_t::fpga_status_t(void) :
+    fd(-1),
+    page(NULL),
+    writable(false) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+fpga_status_t::~fpga_status_t(void) {
+    if (page) {
+        munmap(page, page_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+//!
+//! \brief
+//!    Open the status page.
+//!
+//! \details
+//!    The file is created if it does not exist.  A process that cannot
+//!    write it maps it read-only and can only subscribe.
+//!
+//! \param[in] filename
+//!    Status file.
+//!
+//! \param[in] quiet
+//!    Do not report why the page could not be opened.
+//!
+//! \returns
+//!    True if the page is open.
+//!
+
+bool fpga_status_t::open(const char *filename, bool quiet) {
+
+    writable = true;
+    fd = ::open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        writable = false;
+        fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        if (!quiet) {
+            fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        }
+        return false;
+    }
+
+    //
+    // The first publisher initializes the page
+    //
+
+    struct stat st;
+    if (writable) {
+        flock(fd, LOCK_EX);
+        if ((fstat(fd, &st) == 0) && ((size_t)st.st_size < page_size) && (ftruncate(fd, page_size) != 0)) {
+            writable = false;
+        }
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < page_size)) {
+        if (!quiet) {
+            fprintf(stderr, "%s: %s: status page has not been created\n", PROGNAME, filename);
+        }
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    void *addr = mmap(NULL, page_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        if (!quiet) {
+            fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        }
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    page = (fpga_status_page_t *)addr;
+
+    if (writable && ((memcmp(page->magic, magic, sizeof(magic)) != 0) || (page->version != version))) {
+        memset(page, 0, sizeof(*page));
+        memcpy(page->magic, magic, sizeof(magic));
+        page->version = version;
+    }
+    if (writable) {
+        flock(fd, LOCK_UN);
+    }
+
+    if ((memcmp(page->magic, magic, sizeof(magic)) != 0) || (page->version != version)) {
+        if (!quiet) {
+            fprintf(stderr, "%s: %s: not a status page\n", PROGNAME, filename);
+        }
+        munmap(page, page_size);
+        page = NULL;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Publish a change and wake the subscribers.
+//!
+//! \param[in] state
+//!    New state.
+//!
+//! \param[in] hash
+//!    hash64_t of the image that is loaded, or zero if it is not known.
+//!
+
+void fpga_status_t::publish(state_t state, uint64_t hash) {
+
+    if (!page || !writable) {
+        return;
+    }
+
+    //
+    // Take the seqlock.  An odd sequence number belongs to another
+    // publisher for the few stores below.
+    //
+
+    uint32_t seq;
+    for (;;) {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+        if ((seq & 1) == 0) {
+            if (__atomic_compare_exchange_n(&page->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else {
+            sched_yield();
+        }
+    }
+
+    __atomic_store_n(&page->state, (uint32_t)state, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->pid, (uint32_t)getpid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&page->hash, hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->time_ns, now_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+
+    futex(&page->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+//!
+//! \brief
+//!    Publish a change and keep the image hash.
+//!
+//! \param[in] state
+//!    New state.
+//!
+
+void fpga_status_t::publish(state_t state) {
+    publish(state, read().hash);
+}
+
+//!
+//! \brief
+//!    Read a consistent copy of the page.
+//!
+//! \returns
+//!    The snapshot.  The state is unknown if the page is not open.
+//!
+
+fpga_status_t::snapshot_t fpga_status_t::read(void) const {
+
+    snapshot_t snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (!page) {
+        return snapshot;
+    }
+
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            sched_yield();
+            continue;
+        }
+        uint32_t state   = __atomic_load_n(&page->state, __ATOMIC_RELAXED);
+        snapshot.pid     = __atomic_load_n(&page->pid, __ATOMIC_RELAXED);
+        snapshot.hash    = __atomic_load_n(&page->hash, __ATOMIC_RELAXED);
+        snapshot.time_ns = __atomic_load_n(&page->time_ns, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+            snapshot.seq   = seq;
+            snapshot.state = (state < states) ? (state_t)state : unknown;
+            return snapshot;
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Block until the page changes.
+//!
+//! \param[in] seq
+//!    Sequence number of the last snapshot that was seen.
+//!
+//! \param[in] timeout_ms
+//!    Maximum time to wait in milliseconds, or -1 to wait forever.
+//!
+//! \param[out] snapshot
+//!    The new snapshot.
+//!
+//! \returns
+//!    True if the page changed, false on timeout.
+//!
+
+bool fpga_status_t::wait(uint32_t seq, int timeout_ms, snapshot_t &snapshot) const {
+
+    if (!page) {
+        return false;
+    }
+
+    uint64_t deadline = now_ns() + (uint64_t)timeout_ms * 1000000;
+    for (;;) {
+        uint32_t now = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if ((now != seq) && ((now & 1) == 0)) {
+            snapshot = read();
+            return true;
+        }
+
+        struct timespec ts;
+        struct timespec *timeout = NULL;
+        if (timeout_ms >= 0) {
+            uint64_t t = now_ns();
+            if (t >= deadline) {
+                return false;
+            }
+            ts.tv_sec  = (deadline - t) / 1000000000;
+            ts.tv_nsec = (deadline - t) % 1000000000;
+            timeout = &ts;
+        }
+        futex(&page->seq, FUTEX_WAIT, now, timeout);
+    }
+}
+
+//!
+//! \brief
+//!    Print a snapshot.
+//!
+//! \param[in] snapshot
+//!    Snapshot to print.
+//!
+//! \param[in] last_hash
+//!    Hash of the image that was last seen, or zero.  A change of image is
+//!    reported.
+//!
+
+void fpga_status_t::print(const snapshot_t &snapshot, uint64_t last_hash) {
+    if (snapshot.seq == 0) {
+        printf("%s: %s\n", PROGNAME, names[unknown]);
+    } else {
+        printf("%s: %s", PROGNAME, names[snapshot.state]);
+        if (snapshot.hash) {
+            printf(", image %016llx", (unsigned long long)snapshot.hash);
+            if (last_hash && (last_hash != snapshot.hash)) {
+                printf(" (changed)");
+            }
+        }
+        printf(", published by pid %d %.3f ms ago\n", (int)snapshot.pid, (now_ns() - snapshot.time_ns) * 1e-6);
+    }
+    fflush(stdout);
+}
+
+//!
+//! \brief
+//!    Poll the FPGA Manager and publish the changes that the loader did not
+//!    make.
+//!
+//! \details
+//!    Nothing is published while another process is loading the FPGA.  A
+//!    failed load is not overwritten until the FPGA reaches user mode.
+//!    When the FPGA is reset behind the loader's back the image hash is
+//!    cleared, because the image that comes up is not known.
+//!
+
+int fpga_status_t::watch(fpga_status_t &status, unsigned int interval_ms, bool quiet) {
+
+    if (!status.writable) {
+        fprintf(stderr, "%s: the status page is read-only\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    fpga_io_t fpga_io;
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    for (;;) {
+        uint32_t mode  = fpga_io.read_reg(&fpga_io.fpgamgr_regs->stat) & fpga_loader_t::mode;
+        uint32_t porta = fpga_io.read_reg(&fpga_io.fpgamgr_regs->gpio_ext_porta);
+
+        state_t state;
+        switch (mode) {
+            case fpga_loader_t::mode_reset:
+                state = reset;
+                break;
+            case fpga_loader_t::mode_config:
+            case fpga_loader_t::mode_init:
+                state = configuring;
+                break;
+            case fpga_loader_t::mode_user:
+                state = (porta & fpga_loader_t::crc) ? crc_error : user;
+                break;
+            default:
+                state = unknown;
+                break;
+        }
+
+        snapshot_t snapshot = status.read();
+        bool loading = (snapshot.state == configuring) && ((pid_t)snapshot.pid != getpid()) &&
+            ((kill(snapshot.pid, 0) == 0) || (errno == EPERM));
+        bool keep_failed = (snapshot.state == failed) && (state != user) && (state != crc_error);
+
+        if ((state != snapshot.state) && !loading && !keep_failed) {
+            if ((state == user) || (state == crc_error)) {
+                status.publish(state);
+            } else {
+                status.publish(state, 0);
+            }
+            if (!quiet) {
+                print(status.read(), snapshot.hash);
+            }
+        }
+
+        usleep(interval_ms * 1000);
+    }
+}
+
+//!
+//! \brief
+//!    Status command
+//!
+//! \param[in] argc
+//!    Number of arguments, starting with "status".
+//!
+//! \param[in] argv
+//!    Arguments
+//!
+//! \returns
+//!    Without options, EXIT_SUCCESS if the FPGA is in user mode.  With
+//!    --wait, EXIT_SUCCESS if the state changed before the timeout.
+//!
+
+int fpga_status_t::main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " status [options]\n"
+        "\n"
+        "Print the FPGA state that was published by the loader, without reading\n"
+        "the FPGA Manager.  The exit status is zero if the FPGA is in user mode.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --follow        Print every change until interrupted.\n"
+        "  --help          Print help message and exit.\n"
+        "  --quiet         With --watch, do not print the changes.\n"
+        "  --status-file=file\n"
+        "                  Status page (default " STATUSFILE ").\n"
+        "  --timeout=ms    With --wait, give up after this long.\n"
+        "  --wait          Wait for the next change, print it and exit.\n"
+        "  --watch=ms      Poll the FPGA Manager every ms milliseconds and publish\n"
+        "                  the changes the loader did not make (CRC errors, and\n"
+        "                  reconfiguration through nCONFIG or JTAG).  Run one of\n"
+        "                  these at most.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"follow",   no_argument,       0, 0},  // 1
+        {"quiet",    no_argument,       0, 0},  // 2
+        {"status-file", required_argument, 0, 0}, // 3
+        {"timeout",  required_argument, 0, 0},  // 4
+        {"wait",     no_argument,       0, 0},  // 5
+        {"watch",    required_argument, 0, 0},  // 6
+        {0,          0,                 0, 0},  // 7
+    };
+
+    int index = 0;
+    bool follow = false;
+    bool quiet = false;
+    const char *statusfile = STATUSFILE;
+    int timeout_ms = -1;
+    bool wait = false;
+    unsigned int watch_ms = 0;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    follow = true;
+                    break;
+                case 2:
+                    quiet = true;
+                    break;
+                case 3:
+                    statusfile = optarg;
+                    break;
+                case 4:
+                    timeout_ms = strtol(optarg, NULL, 0);
+                    break;
+                case 5:
+                    wait = true;
+                    break;
+                case 6:
+                    watch_ms = strtoul(optarg, NULL, 0);
+                    if (watch_ms == 0) {
+                        fprintf(stderr, "%s: --watch requires an interval in milliseconds\n", PROGNAME);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+            }
+        }
+    }
+
+    fpga_status_t status;
+    if (!status.open(statusfile, false)) {
+        return EXIT_FAILURE;
+    }
+
+    if (watch_ms) {
+        return watch(status, watch_ms, quiet);
+    }
+
+    snapshot_t snapshot = status.read();
+    if (!wait && !follow) {
+        print(snapshot, 0);
+        return (snapshot.state == user) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    uint64_t last_hash = snapshot.hash;
+    for (;;) {
+        snapshot_t next;
+        if (!status.wait(snapshot.seq, timeout_ms, next)) {
+            fprintf(stderr, "%s: no change after %d ms\n", PROGNAME, timeout_ms);
+            return EXIT_FAILURE;
+        }
+        print(next, last_hash);
+        snapshot = next;
+        if (snapshot.hash) {
+            last_hash = snapshot.hash;
+        }
+        if (!follow) {
+            return EXIT_SUCCESS;
+        }
+    }
+}
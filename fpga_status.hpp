@@ -0,0 +1,144 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    FPGA status header file
+//!
+//! \details
+//!    Publish FPGA state changes to other processes through a shared page
+//!    that they can block on.
+//!
+//! \file
+//!    fpga_status.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_STATUS_H
+#define __FPGA_STATUS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATUSFILE "/run/fpga_loader.status"
+
+//!
+//! \brief
+//!    Shared status page
+//!
+//! \details
+//!    seq is a seqlock and a futex.  It is odd while a publisher is
+//!    updating the page and is incremented by two for each change.
+//!
+
+struct fpga_status_page_t {
+    char     magic[8];                          //!< (0x000) "KS10FPGS"
+    uint32_t version;                           //!< (0x008) Page version
+    uint32_t seq;                               //!< (0x00c) Change sequence number
+    uint32_t state;                             //!< (0x010) fpga_status_t::state_t
+    uint32_t pid;                               //!< (0x014) Process that published the change
+    uint64_t hash;                              //!< (0x018) hash64_t of the loaded image, or zero
+    uint64_t time_ns;                           //!< (0x020) CLOCK_MONOTONIC time of the change
+};
+
+//!
+//! \brief
+//!    FPGA status object
+//!
+//! \details
+//!    Every process that programs the FPGA publishes its progress to a page
+//!    in a file in /run: configuring when the load starts, then user mode
+//!    with the hash of the image, or failed.  Subscribers map the same
+//!    page and block on it with a futex, so they are woken within
+//!    microseconds of a change and never read the FPGA Manager registers
+//!    themselves.  "status --watch" is the one process that polls the
+//!    registers, for changes that the loader does not make: a CRC error,
+//!    or a reconfiguration through nCONFIG or JTAG.
+//!
+//!    Publishing is a no-op when the page is not open, so a loader that
+//!    cannot create the page still programs the FPGA.
+//!
+
+class fpga_status_t {
+
+    public:
+
+        static const char     magic[8];         //!< Page magic number
+        static const uint32_t version = 1;      //!< Page version
+
+        //!
+        //! \brief
+        //!    FPGA states
+        //!
+
+        enum state_t {
+            unknown,                            //!< Nothing has been published
+            reset,                              //!< FPGA is in the reset state
+            configuring,                        //!< FPGA is being programmed
+            user,                               //!< FPGA is in user mode
+            failed,                             //!< The last load failed
+            crc_error,                          //!< User mode with CRC_ERROR asserted
+            states,                             //!< Number of states
+        };
+
+        //!
+        //! \brief
+        //!    Consistent copy of the page
+        //!
+
+        struct snapshot_t {
+            uint32_t seq;                       //!< Change sequence number
+            state_t  state;                     //!< FPGA state
+            pid_t    pid;                       //!< Process that published the change
+            uint64_t hash;                      //!< hash64_t of the loaded image, or zero
+            uint64_t time_ns;                   //!< CLOCK_MONOTONIC time of the change
+        };
+
+        static const char *const names[states]; //!< State names
+
+    private:
+
+        int fd;                                 //!< Status file descriptor
+        fpga_status_page_t *page;               //!< mmap() of the status file
+        bool writable;                          //!< Page is mapped for writing
+
+        static int watch(fpga_status_t &status, unsigned int interval_ms, bool quiet);
+
+    public:
+
+        fpga_status_t(void);
+        ~fpga_status_t(void);
+        bool open(const char *filename, bool quiet);
+        void publish(state_t state, uint64_t hash);
+        void publish(state_t state);
+        snapshot_t read(void) const;
+        bool wait(uint32_t seq, int timeout_ms, snapshot_t &snapshot) const;
+        static void print(const snapshot_t &snapshot, uint64_t last_hash);
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif
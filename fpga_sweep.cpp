@@ -0,0 +1,357 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Virtual-time load sweep
+//!
+//! \file
+//!    fpga_sweep.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "fpga_loader.hpp"
+#include "fpga_sweep.hpp"
+#include "rbf_format.hpp"
+
+//
+// Parameter names, which are also the option names
+//
+
+const char *const fpga_sweep_t::names[axes] = {
+    "reset", "config", "init", "dclk", "user", "rate",
+};
+
+//!
+//! \brief
+//!    Constructor.  Every parameter starts with the single value 0, which
+//!    is no delay.
+//!
+
+fpga_sweep_t::fpga_sweep_t(void) {
+    for (int i = 0; i < axes; i++) {
+        values[i].push_back(0);
+    }
+}
+
+//!
+//! \brief
+//!    Set the values of a parameter.
+//!
+//! \param[in] axis
+//!    Parameter
+//!
+//! \param[in] list
+//!    Comma separated list of values.  Each item is a number, a range
+//!    <tt>first:last:step</tt>, or <tt>never</tt> for a delay that never
+//!    ends.
+//!
+//! \returns
+//!    True if the list is valid.
+//!
+
+bool fpga_sweep_t::set(int axis, const char *list) {
+
+    values[axis].clear();
+
+    const char *p = list;
+    for (;;) {
+        char *end;
+        if ((strncmp(p, "never", 5) == 0) && (axis != rate)) {
+            values[axis].push_back(-1);
+            end = (char *)p + 5;
+        } else {
+            double first = strtod(p, &end);
+            double last  = first;
+            double step  = 1;
+            if ((end != p) && (*end == ':')) {
+                last = strtod(end + 1, &end);
+                if (*end != ':') {
+                    break;
+                }
+                step = strtod(end + 1, &end);
+            }
+            if ((end == p) || (first < 0) || (last < first) || (step <= 0)) {
+                break;
+            }
+            for (double v = first; v <= last + step * 1e-9; v += step) {
+                values[axis].push_back(v);
+            }
+        }
+        if (*end == 0) {
+            return true;
+        }
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+
+    fprintf(stderr, "%s: invalid %s values: %s\n", PROGNAME, names[axis], list);
+    return false;
+}
+
+//!
+//! \brief
+//!    Set one timing parameter.
+//!
+
+void fpga_sweep_t::apply(fpga_sim_t::timing_t &timing, int axis, double value) {
+    uint32_t delay = (value < 0) ? fpga_sim_t::never : (uint32_t)value;
+    switch (axis) {
+        case reset:
+            timing.reset_us = delay;
+            break;
+        case config:
+            timing.config_us = delay;
+            break;
+        case init:
+            timing.init_us = delay;
+            break;
+        case dclk:
+            timing.dclk_us = delay;
+            break;
+        case user:
+            timing.user_us = delay;
+            break;
+        case rate:
+            timing.rate = value;
+            break;
+    }
+}
+
+//!
+//! \brief
+//!    Load the image once for every combination of the parameters.
+//!
+//! \param[in] image
+//!    RBF image
+//!
+//! \param[in] check
+//!    Check the register accesses against the configuration sequence.
+//!    The accesses that led to the first violation are printed.
+//!
+//! \param[in] quiet
+//!    Only report the cases that fail.
+//!
+//! \returns
+//!    EXIT_SUCCESS if every case loaded.
+//!
+
+int fpga_sweep_t::run(const rbf_image_t &image, bool check, bool quiet) {
+
+    fpga_sim_t fpga_plain;
+    fpga_check_t fpga_check;
+    fpga_sim_t &fpga_sim = check ? fpga_check : fpga_plain;
+    if (!fpga_sim.open()) {
+        return EXIT_FAILURE;
+    }
+
+    fpga_loader_t fpga_loader(fpga_sim);
+    size_t index[axes] = {};
+    size_t cases  = 0;
+    size_t failed = 0;
+    size_t broken = 0;
+    uint64_t start = now_ns();
+
+    for (;;) {
+
+        fpga_sim_t::timing_t timing = {};
+        for (int i = 0; i < axes; i++) {
+            apply(timing, i, values[i][index[i]]);
+        }
+        fpga_sim.power_on(timing);
+
+        rbf_buffer_t rbf_buffer = image.chunks();
+        uint64_t t0 = fpga_sim.clock_ns();
+        bool ok = (fpga_loader.loadFPGA(rbf_buffer, false) == EXIT_SUCCESS) &&
+                  (fpga_sim.data_size() == image.size());
+        double msecs = (fpga_sim.clock_ns() - t0) * 1e-6;
+        bool violated = check && fpga_check.violation_count();
+        if (violated) {
+            ok = false;
+        }
+
+        cases++;
+        if (!ok) {
+            failed++;
+        }
+        if (!ok || !quiet) {
+            for (int i = 0; i < axes; i++) {
+                if (values[i][index[i]] < 0) {
+                    printf("%s=never ", names[i]);
+                } else {
+                    printf("%s=%g ", names[i], values[i][index[i]]);
+                }
+            }
+            printf("%s %.3f ms", ok ? "ok" : "failed", msecs);
+            if (violated) {
+                printf(" (%s)", fpga_check.first_violation().c_str());
+            }
+            printf("\n");
+        }
+        if (violated && (broken++ == 0)) {
+            fpga_check.report(stdout);
+        }
+
+        //
+        // Next combination
+        //
+
+        int i;
+        for (i = 0; i < axes; i++) {
+            if (++index[i] < values[i].size()) {
+                break;
+            }
+            index[i] = 0;
+        }
+        if (i == axes) {
+            break;
+        }
+    }
+
+    double secs = (now_ns() - start) * 1e-9;
+    printf("%s: %zu cases, %zu failed, in %.3f s (%.0f cases/s)\n", PROGNAME, cases, failed, secs,
+           cases / secs);
+    if (check) {
+        printf("%s: %zu cases broke the configuration sequence\n", PROGNAME, broken);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    The <tt>sweep</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int fpga_sweep_t::main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " sweep [options] file.rbf\n"
+        "\n"
+        "Load an rbf file into the simulated FPGA in virtual time for every\n"
+        "combination of the device timing values.  Each option takes a comma\n"
+        "separated list of values or first:last:step ranges.  Delays are in\n"
+        "microseconds and may be \"never\".  The default for each is 0.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --check         Check the register accesses against the configuration\n"
+        "                  sequence.  A case that breaks it fails.\n"
+        "  --config=list   nCONFIG released to the configuration state.\n"
+        "  --dclk=list     DCLK count written to DCLKs sent.\n"
+        "  --help          Print help message and exit.\n"
+        "  --init=list     CONF_DONE polled to the initialization state.\n"
+        "  --quiet         Only print the cases that fail.\n"
+        "  --rate=list     Configuration data rate in MB/s, or 0 for no delay.\n"
+        "  --reset=list    nCONFIG asserted to the reset state.\n"
+        "  --user=list     DCLKs sent to the user mode state.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"reset",    required_argument, 0, 0},  // 0
+        {"config",   required_argument, 0, 0},  // 1
+        {"init",     required_argument, 0, 0},  // 2
+        {"dclk",     required_argument, 0, 0},  // 3
+        {"user",     required_argument, 0, 0},  // 4
+        {"rate",     required_argument, 0, 0},  // 5
+        {"help",     no_argument,       0, 0},  // 6
+        {"quiet",    no_argument,       0, 0},  // 7
+        {"check",    no_argument,       0, 0},  // 8
+        {0,          0,                 0, 0},  // 9
+    };
+
+    int index = 0;
+    bool quiet = false;
+    bool check = false;
+    fpga_sweep_t sweep;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                case 1:
+                case 2:
+                case 3:
+                case 4:
+                case 5:
+                    if (!sweep.set(index, optarg)) {
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 6:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 7:
+                    quiet = true;
+                    break;
+                case 8:
+                    check = true;
+                    break;
+            }
+        }
+    }
+
+    if (argv[optind] == NULL) {
+        printf("%s: missing rbf file\n", PROGNAME);
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    rbf_image_t image = rbf_image_t::open(argv[optind]);
+    if (!image.valid()) {
+        return EXIT_FAILURE;
+    }
+    if (!rbf_format_t::valid_size(image.size())) {
+        fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    return sweep.run(image, check, quiet);
+}
@@ -0,0 +1,100 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Virtual-time load sweep header file
+//!
+//! \details
+//!    Runs the loader against the simulated FPGA for every combination of
+//!    a set of timing parameters.
+//!
+//! \file
+//!    fpga_sweep.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __FPGA_SWEEP_H
+#define __FPGA_SWEEP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "fpga_check.hpp"
+#include "fpga_sim.hpp"
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Load sweep object
+//!
+//! \details
+//!    Each timing parameter of fpga_sim_t has a list of values.  Every
+//!    combination is a case, and each case powers on the simulated FPGA
+//!    with that timing and loads the image in virtual time.  The result and the virtual load time
+//!    of each case are reported, so the loader's timeouts can be checked
+//!    against thousands of device timings in a fraction of a second.  With
+//!    fpga_check_t, a case also fails if the loader breaks the
+//!    configuration sequence.
+//!
+
+class fpga_sweep_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Timing parameters
+        //!
+
+        enum axis_t {
+            reset,                              //!< fpga_sim_t::timing_t::reset_us
+            config,                             //!< fpga_sim_t::timing_t::config_us
+            init,                               //!< fpga_sim_t::timing_t::init_us
+            dclk,                               //!< fpga_sim_t::timing_t::dclk_us
+            user,                               //!< fpga_sim_t::timing_t::user_us
+            rate,                               //!< fpga_sim_t::timing_t::rate
+            axes,                               //!< Number of parameters
+        };
+
+    private:
+
+        static const char *const names[axes];   //!< Parameter names
+        std::vector<double> values[axes];       //!< Values of each parameter, -1 for never
+
+        static void apply(fpga_sim_t::timing_t &timing, int axis, double value);
+
+    public:
+
+        fpga_sweep_t(void);
+        bool set(int axis, const char *list);
+        int run(const rbf_image_t &image, bool check, bool quiet);
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif
@@ -0,0 +1,222 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    64-bit hash
+//!
+//! \file
+//!    hash64.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hash64.hpp"
+
+static const uint64_t prime1 = 0x9e3779b185ebca87ULL;
+static const uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+static const uint64_t prime3 = 0x165667b19e3779f9ULL;
+static const uint64_t prime4 = 0x85ebca77c2b2ae63ULL;
+static const uint64_t prime5 = 0x27d4eb2f165667c5ULL;
+
+static inline uint64_t rotl(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+//
+// Unaligned little-endian loads
+//
+
+static inline uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * prime2;
+    acc  = rotl(acc, 31);
+    return acc * prime1;
+}
+
+static inline uint64_t merge(uint64_t acc, uint64_t val) {
+    acc ^= round64(0, val);
+    return acc * prime1 + prime4;
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] seed
+//!    Hash seed.
+//!
+
+hash64_t::hash64_t(uint64_t seed) :
+    seed(seed),
+    total(0),
+    used(0) {
+    v[0] = seed + prime1 + prime2;
+    v[1] = seed + prime2;
+    v[2] = seed;
+    v[3] = seed - prime1;
+}
+
+//!
+//! \brief
+//!    Add data to the hash.
+//!
+//! \param[in] data
+//!    Data to hash.
+//!
+//! \param[in] size
+//!    Number of bytes.
+//!
+
+void hash64_t::update(const void *data, size_t size) {
+
+    const uint8_t *p   = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    total += size;
+
+    //
+    // Complete a partial stripe from the last call
+    //
+
+    if (used) {
+        size_t len = (size < sizeof(buf) - used) ? size : sizeof(buf) - used;
+        memcpy(buf + used, p, len);
+        used += len;
+        p    += len;
+        if (used < sizeof(buf)) {
+            return;
+        }
+        v[0] = round64(v[0], load64(buf +  0));
+        v[1] = round64(v[1], load64(buf +  8));
+        v[2] = round64(v[2], load64(buf + 16));
+        v[3] = round64(v[3], load64(buf + 24));
+        used = 0;
+    }
+
+    //
+    // Whole stripes
+    //
+
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    while (end - p >= 32) {
+        v0 = round64(v0, load64(p +  0));
+        v1 = round64(v1, load64(p +  8));
+        v2 = round64(v2, load64(p + 16));
+        v3 = round64(v3, load64(p + 24));
+        p += 32;
+    }
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+
+    //
+    // Keep the tail for the next call
+    //
+
+    memcpy(buf, p, end - p);
+    used = end - p;
+}
+
+//!
+//! \brief
+//!    Hash of the data added so far.
+//!
+//! \returns
+//!    64-bit hash.
+//!
+
+uint64_t hash64_t::digest(void) const {
+
+    uint64_t h;
+    if (total >= 32) {
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        h = merge(h, v[0]);
+        h = merge(h, v[1]);
+        h = merge(h, v[2]);
+        h = merge(h, v[3]);
+    } else {
+        h = seed + prime5;
+    }
+    h += total;
+
+    const uint8_t *p   = buf;
+    const uint8_t *end = buf + used;
+    while (end - p >= 8) {
+        h ^= round64(0, load64(p));
+        h  = rotl(h, 27) * prime1 + prime4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= load32(p) * prime1;
+        h  = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * prime5;
+        h  = rotl(h, 11) * prime1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+//!
+//! \brief
+//!    Hash a buffer.
+//!
+//! \param[in] data
+//!    Data to hash.
+//!
+//! \param[in] size
+//!    Number of bytes.
+//!
+//! \param[in] seed
+//!    Hash seed.
+//!
+//! \returns
+//!    64-bit hash.
+//!
+
+uint64_t hash64_t::hash(const void *data, size_t size, uint64_t seed) {
+    hash64_t h(seed);
+    h.update(data, size);
+    return h.digest();
+}
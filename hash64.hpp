@@ -0,0 +1,77 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    64-bit hash header file
+//!
+//! \details
+//!    A fast non-cryptographic hash used to check that an rbf image was
+//!    not damaged in memory or in transit.
+//!
+//! \file
+//!    hash64.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __HASH64_H
+#define __HASH64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//!
+//! \brief
+//!    64-bit hash object
+//!
+//! \details
+//!    This is XXH64.  It processes 32 bytes per round with four independent
+//!    lanes and is much faster than a CRC on the ARM.  It only detects
+//!    damage; it is not a MAC.  The hash can be computed incrementally
+//!    as chunks arrive and gives the same result as hashing the whole image
+//!    at once.
+//!
+
+class hash64_t {
+
+    private:
+
+        uint64_t v[4];                          //!< Lane accumulators
+        uint64_t seed;                          //!< Seed
+        uint64_t total;                         //!< Bytes hashed
+        uint8_t  buf[32];                       //!< Partial stripe
+        size_t   used;                          //!< Bytes in the partial stripe
+
+    public:
+
+        hash64_t(uint64_t seed = 0);
+        void update(const void *data, size_t size);
+        uint64_t digest(void) const;
+        static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+
+};
+
+#endif
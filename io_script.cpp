@@ -0,0 +1,562 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Batched register access
+//!
+//! \file
+//!    io_script.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "device_lock.hpp"
+#include "fpga_loader.hpp"
+#include "fpga_sim.hpp"
+#include "io_script.hpp"
+
+//
+// Size of the FPGA Manager register space
+//
+
+static const uint32_t mgr_size = 0x1000;
+
+//!
+//! \brief
+//!    Parse a 32-bit number.
+//!
+
+static bool number(const char *text, uint32_t &value) {
+    char *end;
+    unsigned long long n = strtoull(text, &end, 0);
+    value = n;
+    return (end != text) && (*end == 0) && (n <= 0xffffffffULL);
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+io_script_t::io_script_t(fpga_io_t &io) :
+    io(io),
+    h2f(NULL) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+io_script_t::~io_script_t(void) {
+    io.unmap_h2f(h2f, fpga_io_t::h2f_size);
+}
+
+//!
+//! \brief
+//!    Resolve an address.
+//!
+//! \param[in] spec
+//!    <tt>space:offset</tt>
+//!
+//! \param[in,out] op
+//!    The address fields are set.
+//!
+//! \param[in] bytes
+//!    Bytes that will be accessed from the address.
+//!
+//! \returns
+//!    True if the address is valid.
+//!
+
+bool io_script_t::address(const char *spec, op_t &op, size_t bytes) {
+
+    const char *colon = strchr(spec, ':');
+    if (!colon || !number(colon + 1, op.offset)) {
+        return false;
+    }
+
+    std::string name(spec, colon);
+    uint8_t *base;
+    uint32_t size;
+    if (name == "lw") {
+        op.space = "lw";
+        base = io.lwh2f;
+        size = fpga_io_t::lwh2f_size;
+    } else if (name == "h2f") {
+        if (!h2f && !(h2f = io.map_h2f(0, fpga_io_t::h2f_size))) {
+            return false;
+        }
+        op.space = "h2f";
+        base = h2f;
+        size = fpga_io_t::h2f_size;
+    } else if (name == "mgr") {
+        op.space = "mgr";
+        base = (uint8_t *)io.fpgamgr_regs;
+        size = mgr_size;
+    } else {
+        return false;
+    }
+
+    if (((op.offset & 3) != 0) || (op.offset >= size) || (bytes > size - op.offset)) {
+        return false;
+    }
+
+    op.addr = (volatile uint32_t *)(base + op.offset);
+    return true;
+}
+
+//!
+//! \brief
+//!    Parse one line of the script and append its operations.
+//!
+//! \param[in] line
+//!    Text of the line.  It is modified.
+//!
+//! \param[in] lineno
+//!    Line number.
+//!
+//! \param[in] name
+//!    Script name for messages.
+//!
+//! \returns
+//!    True if the line is valid.
+//!
+
+bool io_script_t::parse_line(char *line, int lineno, const char *name) {
+
+    char *comment = strchr(line, '#');
+    if (comment) {
+        *comment = 0;
+    }
+
+    char *argv[260];
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && (argc < 260); tok = strtok(NULL, " \t\r\n")) {
+        argv[argc++] = tok;
+    }
+    if (argc == 0) {
+        return true;
+    }
+
+    op_t op;
+    memset(&op, 0, sizeof(op));
+    op.line    = lineno;
+    op.mask    = 0xffffffff;
+    op.timeout = 1000;
+
+    bool ok;
+    if ((strcmp(argv[0], "r") == 0) && ((argc == 2) || (argc == 3))) {
+        uint32_t count = 1;
+        ok = ((argc == 2) || (number(argv[2], count) && (count != 0))) &&
+             address(argv[1], op, count * (size_t)4);
+        op.opcode = op_read;
+        for (uint32_t i = 0; ok && (i < count); i++) {
+            ops.push_back(op);
+            op.addr   += 1;
+            op.offset += 4;
+        }
+    } else if ((strcmp(argv[0], "w") == 0) && (argc >= 3)) {
+        ok = address(argv[1], op, (argc - 2) * (size_t)4);
+        op.opcode = op_write;
+        for (int i = 2; ok && (i < argc); i++) {
+            ok = number(argv[i], op.value);
+            ops.push_back(op);
+            op.addr   += 1;
+            op.offset += 4;
+        }
+    } else if ((strcmp(argv[0], "m") == 0) && (argc == 4)) {
+        op.opcode = op_modify;
+        ok = address(argv[1], op, 4) && number(argv[2], op.mask) && number(argv[3], op.value);
+        ops.push_back(op);
+    } else if ((strcmp(argv[0], "p") == 0) && ((argc == 4) || (argc == 5))) {
+        op.opcode = op_poll;
+        ok = address(argv[1], op, 4) && number(argv[2], op.mask) && number(argv[3], op.value) &&
+             ((argc == 4) || number(argv[4], op.timeout));
+        ops.push_back(op);
+    } else if ((strcmp(argv[0], "s") == 0) && (argc == 2)) {
+        op.opcode = op_sleep;
+        ok = number(argv[1], op.timeout);
+        ops.push_back(op);
+    } else {
+        ok = false;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "%s: %s:%d: invalid operation.\n", PROGNAME, name, lineno);
+    }
+    return ok;
+}
+
+//!
+//! \brief
+//!    Read and check the script.
+//!
+//! \param[in] filename
+//!    Script file, or "-" for stdin.
+//!
+//! \returns
+//!    True if the script is valid.
+//!
+
+bool io_script_t::parse(const char *filename) {
+
+    bool stdin_script = (strcmp(filename, "-") == 0);
+    FILE *fp = stdin_script ? stdin : fopen(filename, "r");
+    if (!fp) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    char line[1024];
+    bool ok = true;
+    for (int lineno = 1; ok && fgets(line, sizeof(line), fp); lineno++) {
+        ok = parse_line(line, lineno, stdin_script ? "stdin" : filename);
+    }
+
+    if (!stdin_script) {
+        fclose(fp);
+    }
+    return ok;
+}
+
+//!
+//! \brief
+//!    Check that the bridges used by the script are out of reset.
+//!
+//! \details
+//!    This is called with the FPGA locked, so the bridges cannot be put
+//!    back into reset by a load before the script runs.
+//!
+//! \param[in] first
+//!    First operation to check.
+//!
+//! \returns
+//!    True if the operations can be run.
+//!
+
+bool io_script_t::check(size_t first) const {
+    uint32_t brgmodrst = io.read_reg(io.rstmgr_brgmodrst);
+    for (size_t i = first; i < ops.size(); i++) {
+        const op_t &op = ops[i];
+        if (!op.space) {
+            continue;
+        }
+        if ((strcmp(op.space, "lw") == 0) && (brgmodrst & fpga_io_t::lwhps2fpga)) {
+            fprintf(stderr, "%s: line %u: the lwhps2fpga bridge is in reset.\n", PROGNAME, op.line);
+            return false;
+        }
+        if ((strcmp(op.space, "h2f") == 0) && (brgmodrst & fpga_io_t::hps2fpga)) {
+            fprintf(stderr, "%s: line %u: the hps2fpga bridge is in reset.\n", PROGNAME, op.line);
+            return false;
+        }
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Run one operation and write its result.
+//!
+//! \param[in] op
+//!    Operation.
+//!
+//! \param[in] start
+//!    Time the script started.
+//!
+//! \param[in] binary
+//!    Write an io_record_t result instead of text.
+//!
+//! \returns
+//!    False if a poll timed out.
+//!
+
+bool io_script_t::execute(const op_t &op, uint64_t start, bool binary) {
+
+    static const char names[] = "rwmps";
+    uint32_t value = 0;
+    bool timeout = false;
+
+    switch (op.opcode) {
+        case op_read:
+            value = io.read_reg(op.addr);
+            break;
+        case op_write:
+            io.write_reg(op.addr, op.value);
+            return true;
+        case op_modify:
+            io.write_reg(op.addr, (io.read_reg(op.addr) & ~op.mask) | (op.value & op.mask));
+            return true;
+        case op_poll: {
+            uint64_t t0 = now_ns();
+            while (((value = io.read_reg(op.addr)) & op.mask) != op.value) {
+                if (now_ns() - t0 > op.timeout * 1000ULL) {
+                    timeout = true;
+                    break;
+                }
+            }
+            break;
+        }
+        case op_sleep:
+            io.wait_us(op.timeout);
+            return true;
+    }
+
+    uint64_t ns = now_ns() - start;
+    if (binary) {
+        io_record_t record;
+        record.ns    = ns;
+        record.line  = op.line | (timeout ? 0x80000000 : 0);
+        record.value = value;
+        fwrite(&record, sizeof(record), 1, stdout);
+    } else {
+        printf("%llu %c %s:0x%08x 0x%08x%s\n", (unsigned long long)ns, names[op.opcode], op.space,
+               op.offset, value, timeout ? " timeout" : "");
+    }
+    return !timeout;
+}
+
+//!
+//! \brief
+//!    Print the operation rate and the poll result.
+//!
+
+static int summary(size_t count, uint64_t start, bool timed_out) {
+
+    fflush(stdout);
+    double secs = (now_ns() - start) * 1e-9;
+    fprintf(stderr, "%s: %zu operations in %.3f ms (%.2f M ops/s)\n", PROGNAME, count, secs * 1e3,
+            secs ? count / secs / 1e6 : 0.0);
+
+    if (timed_out) {
+        fprintf(stderr, "%s: a poll timed out.\n", PROGNAME);
+    }
+
+    return timed_out ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    Run the script.
+//!
+//! \param[in] repeat
+//!    Number of times to run the script.
+//!
+//! \param[in] binary
+//!    Write io_record_t results instead of text.
+//!
+//! \returns
+//!    EXIT_SUCCESS unless a poll timed out.
+//!
+
+int io_script_t::run(unsigned int repeat, bool binary) {
+
+    if (!check(0)) {
+        return EXIT_FAILURE;
+    }
+
+    bool timed_out = false;
+    uint64_t start = now_ns();
+
+    for (unsigned int r = 0; r < repeat; r++) {
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (!execute(ops[i], start, binary)) {
+                timed_out = true;
+            }
+        }
+    }
+
+    return summary(ops.size() * (size_t)repeat, start, timed_out);
+}
+
+//!
+//! \brief
+//!    Run a script line by line as it is read.
+//!
+//! \details
+//!    The results of each line are flushed before the next line is read.
+//!    The script stops at the first invalid line.
+//!
+//! \param[in] fp
+//!    Script stream.
+//!
+//! \param[in] binary
+//!    Write io_record_t results instead of text.
+//!
+//! \returns
+//!    EXIT_SUCCESS unless a line was invalid or a poll timed out.
+//!
+
+int io_script_t::stream(FILE *fp, bool binary) {
+
+    bool timed_out = false;
+    size_t count = 0;
+    uint64_t start = now_ns();
+
+    char line[1024];
+    for (int lineno = 1; fgets(line, sizeof(line), fp); lineno++) {
+        ops.clear();
+        if (!parse_line(line, lineno, "stdin") || !check(0)) {
+            summary(count, start, timed_out);
+            return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < ops.size(); i++) {
+            if (!execute(ops[i], start, binary)) {
+                timed_out = true;
+            }
+        }
+        count += ops.size();
+        fflush(stdout);
+    }
+
+    return summary(count, start, timed_out);
+}
+
+//!
+//! \brief
+//!    The <tt>io</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int io_script_t::main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " io [options] [script]\n"
+        "\n"
+        "Run a script of register reads, writes, masked writes and polls against\n"
+        "the bridge windows (lw:offset, h2f:offset) and the FPGA Manager\n"
+        "(mgr:offset).  The script is read from stdin if no file is given.\n"
+        "\n"
+        "  r addr [count]              read words\n"
+        "  w addr value [value...]     write words\n"
+        "  m addr mask value           write the bits in the mask\n"
+        "  p addr mask value [timeout] poll until (word & mask) == value\n"
+        "  s usecs                     sleep\n"
+        "\n"
+        "Valid options are:\n"
+        "  --binary        Write 16-byte binary records (ns, line, value).\n"
+        "  --help          Print help message and exit.\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Give up if the FPGA is busy for longer than this.\n"
+        "  --repeat=n      Run the script n times.\n"
+        "  --simulate      Use a simulated FPGA instead of the hardware.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"binary",   no_argument,       0, 0},  // 1
+        {"lockfile", required_argument, 0, 0},  // 2
+        {"lock-timeout", required_argument, 0, 0}, // 3
+        {"repeat",   required_argument, 0, 0},  // 4
+        {"simulate", no_argument,       0, 0},  // 5
+        {0,          0,                 0, 0},  // 6
+    };
+
+    int index = 0;
+    bool binary = false;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    unsigned int repeat = 1;
+    bool simulate = false;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    binary = true;
+                    break;
+                case 2:
+                    lockfile = optarg;
+                    break;
+                case 3:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+                case 4:
+                    repeat = strtoul(optarg, NULL, 0);
+                    break;
+                case 5:
+                    simulate = true;
+                    break;
+            }
+        }
+    }
+
+    fpga_io_t fpga_hw;
+    fpga_sim_t fpga_sim;
+    fpga_io_t &fpga_io = simulate ? fpga_sim : fpga_hw;
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // A script on stdin is run as it arrives unless it has to be repeated
+    //
+
+    const char *filename = argv[optind] ? argv[optind] : "-";
+    bool streamed = (strcmp(filename, "-") == 0) && (repeat == 1);
+
+    io_script_t script(fpga_io);
+    if (!streamed && !script.parse(filename)) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // Keep the FPGA from being reconfigured under the script
+    //
+
+    device_lock_t device_lock;
+    if (!simulate && !device_lock.lock(lockfile, lock_timeout, true)) {
+        return EXIT_FAILURE;
+    }
+
+    return streamed ? script.stream(stdin, binary) : script.run(repeat, binary);
+}
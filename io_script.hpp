@@ -0,0 +1,145 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Batched register access header file
+//!
+//! \details
+//!    This object runs a script of reads, writes, masked writes and polls
+//!    against the bridge windows and the FPGA Manager with one mapping.
+//!
+//! \file
+//!    io_script.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __IO_SCRIPT_H
+#define __IO_SCRIPT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fpga_io.hpp"
+
+//!
+//! \brief
+//!    Binary result record
+//!
+//! \details
+//!    With --binary, each result is one of these in native byte order.
+//!
+
+struct io_record_t {
+    uint64_t ns;                                //!< (0x000) Time since the script started
+    uint32_t line;                              //!< (0x008) Script line, with bit 31 set for a poll timeout
+    uint32_t value;                             //!< (0x00c) Value read
+};
+
+//!
+//! \brief
+//!    Batched register access object
+//!
+//! \details
+//!    The script has one operation per line.  Blank lines and text
+//!    following a '#' are ignored.  An address is <tt>space:offset</tt>,
+//!    where the space is <tt>lw</tt> (the lightweight HPS-to-FPGA bridge),
+//!    <tt>h2f</tt> (the HPS-to-FPGA bridge) or <tt>mgr</tt> (the FPGA
+//!    Manager registers).  Offsets are word aligned.
+//!
+//!    - <tt>r addr [count]</tt> reads count consecutive words.
+//!    - <tt>w addr value [value...]</tt> writes consecutive words.
+//!    - <tt>m addr mask value</tt> writes the bits in the mask.
+//!    - <tt>p addr mask value [timeout_us]</tt> polls until the bits in the
+//!      mask equal the value (default timeout 1000 us).
+//!    - <tt>s usecs</tt> sleeps.
+//!
+//!    A script file is read and checked before it runs, so parsing does
+//!    not slow the accesses.  A script on stdin is run line by line as it
+//!    arrives, so a pipeline or an interactive client gets each result as
+//!    soon as its line is run; it is only read ahead when it is repeated.
+//!    Reads and polls produce results; writes do not.  Text results are
+//!    <tt>ns op space:offset value</tt>.  The bridges must be out of reset
+//!    to use the bridge windows.  That is checked once the FPGA is locked.
+//!
+
+class io_script_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    Operations
+        //!
+
+        enum opcode_t {
+            op_read,                            //!< Read a word
+            op_write,                           //!< Write a word
+            op_modify,                          //!< Write the bits in a mask
+            op_poll,                            //!< Wait for the bits in a mask
+            op_sleep,                           //!< Sleep
+        };
+
+        //!
+        //! \brief
+        //!    One operation
+        //!
+
+        struct op_t {
+            opcode_t opcode;                    //!< Operation
+            volatile uint32_t *addr;            //!< Address in the mapping
+            const char *space;                  //!< Name of the address space
+            uint32_t offset;                    //!< Offset into the space
+            uint32_t mask;                      //!< Bits to write or compare
+            uint32_t value;                     //!< Value to write or compare
+            uint32_t timeout;                   //!< Poll timeout or sleep in microseconds
+            uint32_t line;                      //!< Script line
+        };
+
+        fpga_io_t &io;                          //!< HPS register access
+        std::vector<op_t> ops;                  //!< Script
+        uint8_t *h2f;                           //!< HPS-to-FPGA window, mapped when used
+
+        bool address(const char *spec, op_t &op, size_t bytes);
+        bool parse_line(char *line, int lineno, const char *name);
+        bool check(size_t first) const;
+        bool execute(const op_t &op, uint64_t start, bool binary);
+
+    public:
+
+        io_script_t(fpga_io_t &io);
+        ~io_script_t(void);
+        bool parse(const char *filename);
+        int run(unsigned int repeat, bool binary);
+        int stream(FILE *fp, bool binary);
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif
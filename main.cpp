@@ -35,9 +35,36 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
+#include <vector>
 
+#include "fpga_io.hpp"
+#include "fpga_boot.hpp"
+#include "fpga_check.hpp"
+#include "fpga_plugins.hpp"
+#include "fpga_sim.hpp"
+#include "fpga_status.hpp"
+#include "fpga_sweep.hpp"
 #include "fpga_loader.hpp"
+#include "rbf_crypt.hpp"
+#include "rbf_image.hpp"
+#include "rbf_embed.hpp"
+#include "rbf_fingerprint.hpp"
+#include "rbf_format.hpp"
+#include "rbf_resident.hpp"
+#include "rbf_throttle.hpp"
+#include "rbf_corpus.hpp"
+#include "rbf_net.hpp"
+#include "rbf_pool.hpp"
+#include "sequence.hpp"
+#include "bridge_test.hpp"
+#include "fabric_mem.hpp"
+#include "fabric_state.hpp"
+#include "io_script.hpp"
+#include "mmio_profile.hpp"
+#include "pm_latency.hpp"
+#include "device_lock.hpp"
 
 //!
 //! \brief
@@ -61,15 +88,136 @@ int main(int argc, char *argv[]) {
         "device to load its own FPGA firmware.\n"
         "\n"
         "usage: " PROGNAME " [options] \"raw_binary_file.rbf\"\n"
+        "       " PROGNAME " command [options]\n"
+        "\n"
+        "Valid commands are:\n"
+        "  bench-crypt     Measure plain, decrypt-only and pipelined load throughput.\n"
+        "  bench-pool      Stress the chunk pool with unbalanced pipeline stages.\n"
+        "  boot            Load a static design, signal ready, then load the full design.\n"
+        "  gen-rbf         Generate synthetic rbf files from a profile.\n"
+        "  io              Run a script of bridge and FPGA Manager register accesses.\n"
+        "  profile-mmio    Measure FPGA Manager and System Manager register latency.\n"
+        "  profile-rbf     Print the size, run and entropy profile of an rbf file.\n"
+        "  push            Send an rbf file to a board that is running \"serve\".\n"
+        "  sequence        Run a matrix of tests, programming each image once.\n"
+        "  serve           Receive rbf files over the network and program them.\n"
+        "  status          Print or wait for FPGA state changes published by the loader.\n"
+        "  sweep           Load an rbf file into the simulated FPGA across device timings.\n"
         "\n"
         "Valid options are:\n"
+        "  --check         Program a simulated FPGA that checks every register access\n"
+        "                  against the configuration sequence.  Implies --simulate.\n"
         "  --debug         Print debug messages.\n"
+        "  --encrypt=file  Write the rbf file to an encrypted container and exit.\n"
         "  --help          Print help message and exit.\n"
+        "  --keyfile=file  Key for encrypted containers (32 bytes or 64 hex digits).\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Give up if the FPGA is busy for longer than this. The\n"
+        "                  default is to wait until it is free.\n"
+        "  --mem=offset:file\n"
+        "                  After the load, enable the bridges and write the file into\n"
+        "                  the design at the offset into the hps2fpga window.  May\n"
+        "                  be given more than once.\n"
+        "  --plugin=file[:argument]\n"
+        "                  Load a plugin (see fpga_plugin.h) and call it before the\n"
+        "                  reset, after the transfer, in user mode and on failure.\n"
+        "                  The time spent in each plugin is reported.  May be given\n"
+        "                  more than once.\n"
+        "  --pm-latency    Keep the CPU out of deep idle states and at full speed\n"
+        "                  while the FPGA is programmed, and report the effect.\n"
+        "  --quiesce=request:acknowledge[:timeout_ms]\n"
+        "                  Before the FPGA is reset, set the request bits in GPO and\n"
+        "                  wait for the acknowledge bits on GPI.  The request bits\n"
+        "                  are cleared when the new design has been restored.\n"
         "  --quiet         Suppress messages.\n"
+        "  --resident=address:size\n"
+        "  --resident=file Keep the rbf file in reserved physical memory (or in a\n"
+        "                  file that stands in for it).  Without an rbf file, the\n"
+        "                  resident image is programmed.\n"
+        "  --save=offset:size\n"
+        "                  Save a region of the hps2fpga window before the FPGA is\n"
+        "                  reset and write it back into the new design.  May be\n"
+        "                  given more than once.\n"
+        "  --selftest=file Enable the bridges after the load and check them against\n"
+        "                  the test regions and thresholds in the file.\n"
+        "  --simulate      Program a simulated FPGA instead of the hardware.\n"
+        "  --skip-if-loaded\n"
+        "                  Do nothing if the rbf file is the image that is already\n"
+        "                  loaded.  The decision reads a few pages of the file; the\n"
+        "                  full file is checked afterwards in the background.\n"
+        "  --state-file=file\n"
+        "                  Record of the loaded image (default " STATEFILE ").\n"
+        "                  Required with --skip-if-loaded and --simulate.\n"
+        "  --stats         Print load time statistics.\n"
+        "  --status-file=file\n"
+        "                  Status page that the load is published to (default\n"
+        "                  " STATUSFILE ").  See \"status\".\n"
+        "  --throttle=profile\n"
+        "                  Read the rbf file at the speed of a slow storage device:\n"
+        "                  sd-slow, sd, sd-fast, usb, or MB/s[:latency_ms[:jitter_ms]].\n"
         "\n"
         "Note: The FPGA firmware must be in Raw Binary File (RBF) format.\n"
+        "      Encrypted containers are recognized automatically and are\n"
+        "      decrypted while the FPGA is being programmed.\n"
+#ifdef RBF_EMBED
+        "      When no file is given, the rbf file that is embedded in this\n"
+        "      executable is programmed.\n"
+#endif
         "\n";
 
+    //
+    // Commands
+    //
+
+    if ((argc > 1) && (strcmp(argv[1], "profile-mmio") == 0)) {
+        return mmio_profile_t::main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "profile-rbf") == 0)) {
+        return rbf_corpus_t::profile_main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "gen-rbf") == 0)) {
+        return rbf_corpus_t::generate_main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "bench-crypt") == 0)) {
+        return rbf_crypt_t::bench(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "bench-pool") == 0)) {
+        return rbf_pool_t::bench(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "boot") == 0)) {
+        return fpga_boot_t::main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "io") == 0)) {
+        return io_script_t::main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "status") == 0)) {
+        return fpga_status_t::main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "sweep") == 0)) {
+        return fpga_sweep_t::main(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "serve") == 0)) {
+        return rbf_net_t::serve(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "push") == 0)) {
+        return rbf_net_t::push(argc - 1, argv + 1);
+    }
+
+    if ((argc > 1) && (strcmp(argv[1], "sequence") == 0)) {
+        return sequence_t::main(argc - 1, argv + 1);
+    }
+
     //
     // Sort command line
     //
@@ -79,12 +227,49 @@ int main(int argc, char *argv[]) {
         {"debug",  no_argument,       0, 0},  // 1
         {"q",      no_argument,       0, 0},  // 2
         {"quiet",  no_argument,       0, 0},  // 3
-        {0,        0,                 0, 0},  // 4
+        {"keyfile", required_argument, 0, 0}, // 4
+        {"encrypt", required_argument, 0, 0}, // 5
+        {"selftest", required_argument, 0, 0},// 6
+        {"lockfile", required_argument, 0, 0},// 7
+        {"lock-timeout", required_argument, 0, 0}, // 8
+        {"stats",  no_argument,       0, 0},  // 9
+        {"resident", required_argument, 0, 0},// 10
+        {"simulate", no_argument,     0, 0},  // 11
+        {"throttle", required_argument, 0, 0},// 12
+        {"pm-latency", no_argument,   0, 0},  // 13
+        {"mem",    required_argument, 0, 0},  // 14
+        {"save",   required_argument, 0, 0},  // 15
+        {"quiesce", required_argument, 0, 0}, // 16
+        {"check",  no_argument,       0, 0},  // 17
+        {"skip-if-loaded", no_argument, 0, 0},// 18
+        {"state-file", required_argument, 0, 0}, // 19
+        {"status-file", required_argument, 0, 0}, // 20
+        {"plugin", required_argument, 0, 0},  // 21
+        {0,        0,                 0, 0},  // 22
     };
 
     int index = 0;
     bool debug = false;
     bool quiet = false;
+    const char *keyfile = NULL;
+    const char *encrypt = NULL;
+    const char *selftest = NULL;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    bool stats = false;
+    const char *resident = NULL;
+    bool simulate = false;
+    bool check = false;
+    const char *throttle = NULL;
+    rbf_throttle_t::profile_t throttle_profile = {};
+    bool pm = false;
+    std::vector<const char *> mems;
+    std::vector<const char *> saves;
+    const char *quiesce = NULL;
+    bool skip_if_loaded = false;
+    const char *statefile = NULL;
+    const char *statusfile = NULL;
+    std::vector<const char *> plugins;
     opterr = 0;
     for (;;) {
         int ret = getopt_long(argc, argv, "", options, &index);
@@ -106,6 +291,64 @@ int main(int argc, char *argv[]) {
                 case 3:
                     quiet = true;
                     break;
+                case 4:
+                    keyfile = optarg;
+                    break;
+                case 5:
+                    encrypt = optarg;
+                    break;
+                case 6:
+                    selftest = optarg;
+                    break;
+                case 7:
+                    lockfile = optarg;
+                    break;
+                case 8:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+                case 9:
+                    stats = true;
+                    break;
+                case 10:
+                    resident = optarg;
+                    break;
+                case 11:
+                    simulate = true;
+                    break;
+                case 12:
+                    throttle = optarg;
+                    if (!rbf_throttle_t::parse(throttle, throttle_profile)) {
+                        return EXIT_FAILURE;
+                    }
+                    break;
+                case 13:
+                    pm = true;
+                    break;
+                case 14:
+                    mems.push_back(optarg);
+                    break;
+                case 15:
+                    saves.push_back(optarg);
+                    break;
+                case 16:
+                    quiesce = optarg;
+                    break;
+                case 17:
+                    check    = true;
+                    simulate = true;
+                    break;
+                case 18:
+                    skip_if_loaded = true;
+                    break;
+                case 19:
+                    statefile = optarg;
+                    break;
+                case 20:
+                    statusfile = optarg;
+                    break;
+                case 21:
+                    plugins.push_back(optarg);
+                    break;
             }
         }
     }
@@ -114,69 +357,385 @@ int main(int argc, char *argv[]) {
     // Check that the program arguments are correct
     //
 
-    if (argv[optind] == NULL) {
+#ifndef RBF_EMBED
+    if ((argv[optind] == NULL) && !resident) {
         printf("%s: missing filename\n", PROGNAME);
         printf(usage);
         return EXIT_FAILURE;
     }
+#endif
 
     //
-    // Open the firmware file
+    // Skip the load if the FPGA already has this image.  A simulated FPGA
+    // only has an image if a state file was given for it.
     //
 
-    FILE *fd = fopen(argv[optind], "r");
-    if (!fd) {
-        perror(PROGNAME);
+    if (!simulate && !statefile) {
+        statefile = STATEFILE;
+    }
+    if (!simulate && !statusfile) {
+        statusfile = STATUSFILE;
+    }
+
+    fpga_io_t fpga_hw;
+    fpga_sim_t fpga_plain;
+    fpga_check_t fpga_check;
+    fpga_sim_t &fpga_sim = check ? fpga_check : fpga_plain;
+    fpga_io_t &fpga_io = simulate ? fpga_sim : fpga_hw;
+    device_lock_t device_lock;
+
+    rbf_fingerprint_t fingerprint;
+    if (skip_if_loaded) {
+        if ((argv[optind] == NULL) || encrypt) {
+            fprintf(stderr, "%s: --skip-if-loaded requires an rbf file to program\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+        if (!statefile) {
+            fprintf(stderr, "%s: --skip-if-loaded with --simulate requires --state-file\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+        uint64_t start = now_ns();
+        if (!fingerprint.sample(argv[optind])) {
+            return EXIT_FAILURE;
+        }
+
+        //
+        // The record is only trusted while no other loader can change the
+        // FPGA, and only if the FPGA is still running a design
+        //
+
+        if (!fpga_io.open()) {
+            return EXIT_FAILURE;
+        }
+        if (!simulate && !device_lock.lock(lockfile, lock_timeout, quiet)) {
+            return EXIT_FAILURE;
+        }
+        bool user = (fpga_io.read_reg(&fpga_io.fpgamgr_regs->stat) & fpga_loader_t::mode) == fpga_loader_t::mode_user;
+        if (user && fingerprint.matches(statefile)) {
+            device_lock.unlock();
+            if (!quiet) {
+                printf("%s: \"%s\" is already loaded (%zu pages sampled in %.3f ms).\n", PROGNAME,
+                       argv[optind], fingerprint.pages(), (now_ns() - start) * 1e-6);
+            }
+            fingerprint.confirm(statefile);
+            return EXIT_SUCCESS;
+        }
+        device_lock.unlock();
+        fpga_io.close();
+        if (debug) {
+            printf("%s: \"%s\" is not the loaded image (%zu pages sampled in %.3f ms%s).\n", PROGNAME,
+                   argv[optind], fingerprint.pages(), (now_ns() - start) * 1e-6,
+                   user ? "" : ", the FPGA is not in user mode");
+        }
+    }
+
+    //
+    // Read the key
+    //
+
+    uint8_t key[rbf_crypt_t::key_size];
+    if (keyfile && !rbf_crypt_t::read_keyfile(keyfile, key)) {
+        return EXIT_FAILURE;
+    }
+
+    if (encrypt && !keyfile) {
+        printf("%s: --encrypt requires --keyfile\n", PROGNAME);
         return EXIT_FAILURE;
     }
 
     //
-    // Read the rbf file
+    // Read the memory images and the self-test configuration before
+    // touching the FPGA
     //
 
-    uint32_t *buf = (uint32_t*)malloc(8*1024*1024);
-    size_t size = fread(buf, 1, 8*1024*1024, fd);
-    if (size == 0) {
-        perror(PROGNAME);
+    fabric_mem_t fabric_mem(fpga_io);
+    for (size_t i = 0; i < mems.size(); i++) {
+        if (!fabric_mem.add(mems[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    fabric_state_t fabric_state(fpga_io);
+    for (size_t i = 0; i < saves.size(); i++) {
+        if (!fabric_state.add(saves[i])) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (quiesce && !fabric_state.handshake(quiesce)) {
+        return EXIT_FAILURE;
+    }
+
+    bridge_test_t bridge_test(fpga_io);
+    if (selftest && !bridge_test.configure(selftest)) {
         return EXIT_FAILURE;
     }
 
-    if (!quiet) {
-        printf("%s: Successfully read file \"%s\" (%d bytes).\n", PROGNAME, argv[optind], size);
+    fpga_plugins_t fpga_plugins(fpga_io, simulate);
+    for (size_t i = 0; i < plugins.size(); i++) {
+        if (!fpga_plugins.add(plugins[i])) {
+            return EXIT_FAILURE;
+        }
     }
 
     //
-    // Check input buffer alignment
+    // Encrypted containers are decrypted as they are programmed so that the
+    // cleartext image is never held in memory.
     //
 
-    uint32_t addr = (uint32_t)buf;
-    if ((addr & 0x03) != 0) {
-        fprintf(stderr, "%s: rbf data buffer is not aligned properly.\n", PROGNAME);
-        exit(EXIT_FAILURE);
+    rbf_decrypt_t rbf_decrypt;
+    rbf_buffer_t rbf_buffer(NULL, 0);
+    rbf_source_t *rbf_source = &rbf_buffer;
+    rbf_image_t rbf_image;
+    rbf_resident_t rbf_resident;
+
+    if (resident && !rbf_resident.open(resident)) {
+        return EXIT_FAILURE;
+    }
+
+    if ((argv[optind] == NULL) && resident) {
+
+        //
+        // Program the image that was left in the resident region.  It is
+        // checked against its hash as it is programmed.
+        //
+
+        if (encrypt) {
+            printf("%s: --encrypt requires a filename\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+
+        if (!rbf_resident.load(quiet)) {
+            return EXIT_FAILURE;
+        }
+
+        rbf_source = &rbf_resident;
+
+    } else
+#ifdef RBF_EMBED
+    if (argv[optind] == NULL) {
+
+        //
+        // The embedded image was checked when the loader was built and is
+        // streamed directly from the executable.
+        //
+
+        rbf_image = rbf_image_t::borrow(rbf_embed_data, rbf_embed_size);
+        if (!rbf_image.valid()) {
+            return EXIT_FAILURE;
+        }
+
+        if (!quiet) {
+            printf("%s: Using embedded file \"%s\" (%zu bytes).\n", PROGNAME, rbf_embed_name, rbf_image.size());
+        }
+
+        if (encrypt) {
+            printf("%s: --encrypt requires a filename\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+
+        rbf_buffer = rbf_image.chunks();
+
+    } else
+#endif
+    if (!encrypt && rbf_crypt_t::is_encrypted(argv[optind])) {
+        if (resident) {
+            fprintf(stderr, "%s: encrypted files cannot be made resident.\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+
+        if (!keyfile) {
+            fprintf(stderr, "%s: \"%s\" is encrypted. A --keyfile is required.\n", PROGNAME, argv[optind]);
+            return EXIT_FAILURE;
+        }
+
+        if (!rbf_decrypt.open(argv[optind], key)) {
+            return EXIT_FAILURE;
+        }
+
+        if (!quiet) {
+            printf("%s: Decrypting file \"%s\" (%zu bytes).\n", PROGNAME, argv[optind], rbf_decrypt.size());
+        }
+
+        rbf_source = &rbf_decrypt;
+
+    } else {
+
+        //
+        // Open the rbf file.  Regular files are mapped, not copied.
+        //
+
+        rbf_image = rbf_image_t::open(argv[optind]);
+        if (!rbf_image.valid()) {
+            return EXIT_FAILURE;
+        }
+
+        if (!quiet) {
+            printf("%s: Successfully read file \"%s\" (%zu bytes).\n", PROGNAME, argv[optind], rbf_image.size());
+        }
+
+        //
+        // Check file length alignment
+        //
+
+        if (!rbf_format_t::valid_size(rbf_image.size())) {
+            fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+            exit(EXIT_FAILURE);
+        }
+
+        if (!quiet && !rbf_format_t::has_preamble(rbf_image.bytes(), rbf_image.size())) {
+            printf("%s: warning: \"%s\" does not begin with the rbf preamble.\n", PROGNAME, argv[optind]);
+        }
+
+        //
+        // Write the encrypted container instead of programming the FPGA
+        //
+
+        if (encrypt) {
+            bool ok = rbf_crypt_t::encrypt(key, rbf_image.words(), rbf_image.word_count(), encrypt);
+            if (ok && !quiet) {
+                printf("%s: Wrote encrypted file \"%s\".\n", PROGNAME, encrypt);
+            }
+            return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        rbf_buffer = rbf_image.chunks();
     }
 
     //
-    // Check file length alignment
+    // Program the FPGA
     //
 
-    if ((size & 0x03) != 0) {
-        fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
-        exit(EXIT_FAILURE);
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
     }
 
     //
-    // size is the number of 32-bit words
+    // Measure the effect of --pm-latency for the report before another
+    // loader can be kept waiting for it
     //
 
-    size /= sizeof(uint32_t);
+    pm_latency_t pm_latency;
+    if (pm && !quiet) {
+        pm_latency.calibrate();
+    }
 
     //
-    // Program the FPGA
+    // Only one process may drive the FPGA Manager at a time
+    //
+
+    if (!simulate && !device_lock.lock(lockfile, lock_timeout, quiet)) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // Keep a copy of the rbf file in the resident region for recovery.  The
+    // region is shared with other loaders, so it is written under the lock.
+    //
+
+    if (resident && (argv[optind] != NULL) && rbf_image.valid() && !rbf_resident.store(rbf_image, quiet)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!fpga_plugins.start()) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // Emulate slow storage
+    //
+
+    rbf_throttle_t rbf_throttle(throttle_profile);
+    if (throttle) {
+        rbf_throttle.attach(*rbf_source);
+        rbf_source = &rbf_throttle;
+    }
+
+    //
+    // Hold the CPU at low latency for the load only
+    //
+
+    if (pm) {
+        pm_latency.hold(quiet);
+    }
+
+    if (statefile) {
+        rbf_fingerprint_t::forget(statefile);
+    }
+
+    //
+    // Tell the subscribers that the FPGA is going down
+    //
+
+    fpga_status_t fpga_status;
+    if (statusfile) {
+        fpga_status.open(statusfile, !debug);
+    }
+    fpga_status.publish(fpga_status_t::configuring, 0);
+
+    uint64_t start = now_ns();
+    fpga_hooks_t *hooks = fabric_state.empty() ? NULL : &fabric_state;
+    if (!fpga_plugins.empty()) {
+        fpga_plugins.chain(hooks);
+        hooks = &fpga_plugins;
+    }
+    fpga_loader_t fpga_loader(fpga_io, hooks);
+    int ret = fpga_loader.loadFPGA(*rbf_source, debug);
+    uint64_t program_ns = now_ns() - start;
+    pm_latency.release();
+
     //
+    // Initialize the memories of the new design while the FPGA is still
+    // locked and before it is published as loaded
+    //
+
+    if (!fabric_mem.empty() && (ret == EXIT_SUCCESS)) {
+        fpga_io.enable_bridges();
+        ret = fabric_mem.run(quiet);
+    }
+
+    if (ret != EXIT_SUCCESS) {
+        fpga_status.publish(fpga_status_t::failed, 0);
+    } else {
+        fpga_status.publish(fpga_status_t::user, fpga_loader.data_hash());
+    }
+
+    bool recorded = skip_if_loaded && (ret == EXIT_SUCCESS) && fingerprint.record(statefile);
+
+    if (pm && !quiet) {
+        pm_latency.report(fpga_loader.data_size(), fpga_loader.data_ns());
+    }
+
+    if (!fpga_plugins.empty() && !quiet) {
+        fpga_plugins.report();
+    }
+
+    if (!fabric_state.empty() && !quiet && (ret == EXIT_SUCCESS)) {
+        fabric_state.report();
+    }
+
+    if (check && fpga_check.violation_count()) {
+        fpga_check.report(stderr);
+        ret = EXIT_FAILURE;
+    } else if (check && !quiet) {
+        fpga_check.report(stdout);
+    }
+
+    if (simulate && debug) {
+        printf("%s: simulated FPGA received %zu bytes (hash %016llx)\n", PROGNAME,
+               fpga_sim.data_size(), (unsigned long long)fpga_sim.data_hash());
+    }
 
-    fpga_loader_t fpga_loader;
-    int ret = fpga_loader.loadFPGA(buf, size, debug);
-    free(buf);
+    if (stats) {
+        printf("%s: waited %.3f ms for the FPGA", PROGNAME, device_lock.wait_time() * 1e-6);
+        if (device_lock.waited_for()) {
+            printf(" (held by pid %d)", (int)device_lock.waited_for());
+        }
+        printf(", programmed in %.3f ms", program_ns * 1e-6);
+        if (throttle) {
+            printf(" (%.3f ms waiting for %s storage)", rbf_throttle.throttled_ns() * 1e-6, throttle);
+        }
+        printf("\n");
+    }
 
     //
     // Cleanup
@@ -186,5 +745,28 @@ int main(int argc, char *argv[]) {
         printf("%s: FPGA progammed successfully\n", PROGNAME);
     }
 
+    //
+    // Check the bridges of the new design
+    //
+
+    if (selftest && (ret == EXIT_SUCCESS)) {
+        fpga_io.enable_bridges();
+        ret = bridge_test.run(quiet);
+    }
+
+    //
+    // The bridges and the memories belong to the new design until here
+    //
+
+    device_lock.unlock();
+
+    //
+    // Check the whole file in the background now that the lock is free
+    //
+
+    if (recorded) {
+        fingerprint.confirm(statefile);
+    }
+
     return ret;
 }
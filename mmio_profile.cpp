@@ -0,0 +1,434 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    MMIO register latency profiler
+//!
+//! \file
+//!    mmio_profile.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <stdio.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <algorithm>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "fpga_loader.hpp"
+#include "device_lock.hpp"
+#include "mmio_profile.hpp"
+
+//!
+//! \brief
+//!    Registers that are profiled
+//!
+
+static const struct {
+    const char *block;                          //!< Register block
+    const char *name;                           //!< Register name
+    size_t      offset;                         //!< Offset into the register block
+    bool        write;                          //!< Register can be rewritten with its current value
+} registers[] = {
+    {"fpgamgr", "stat",               offsetof(fpgamgr_regs_t, stat),               false},
+    {"fpgamgr", "ctrl",               offsetof(fpgamgr_regs_t, ctrl),               true },
+    {"fpgamgr", "dclkcnt",            offsetof(fpgamgr_regs_t, dclkcnt),            false},
+    {"fpgamgr", "dclkstat",           offsetof(fpgamgr_regs_t, dclkstat),           false},
+    {"fpgamgr", "gpo",                offsetof(fpgamgr_regs_t, gpo),                true },
+    {"fpgamgr", "gpi",                offsetof(fpgamgr_regs_t, gpi),                false},
+    {"fpgamgr", "misci",              offsetof(fpgamgr_regs_t, misci),              false},
+    {"fpgamgr", "gpio_inten",         offsetof(fpgamgr_regs_t, gpio_inten),         true },
+    {"fpgamgr", "gpio_intmask",       offsetof(fpgamgr_regs_t, gpio_intmask),       true },
+    {"fpgamgr", "gpio_inttype_level", offsetof(fpgamgr_regs_t, gpio_inttype_level), true },
+    {"fpgamgr", "gpio_int_polarity",  offsetof(fpgamgr_regs_t, gpio_int_polarity),  true },
+    {"fpgamgr", "gpio_intstatus",     offsetof(fpgamgr_regs_t, gpio_intstatus),     false},
+    {"fpgamgr", "gpio_raw_intstatus", offsetof(fpgamgr_regs_t, gpio_raw_intstatus), false},
+    {"fpgamgr", "gpio_ext_porta",     offsetof(fpgamgr_regs_t, gpio_ext_porta),     false},
+    {"fpgamgr", "gpio_1s_sync",       offsetof(fpgamgr_regs_t, gpio_1s_sync),       true },
+    {"fpgamgr", "gpio_ver_id_code",   offsetof(fpgamgr_regs_t, gpio_ver_id_code),   false},
+    {"fpgamgr", "gpio_config_reg2",   offsetof(fpgamgr_regs_t, gpio_config_reg2),   false},
+    {"fpgamgr", "gpio_config_reg1",   offsetof(fpgamgr_regs_t, gpio_config_reg1),   false},
+    {"sysmgr",  "siliconid1",         offsetof(sysmgr_regs_t,  siliconid1),         false},
+    {"sysmgr",  "siliconid2",         offsetof(sysmgr_regs_t,  siliconid2),         false},
+    {"sysmgr",  "wddbg",              offsetof(sysmgr_regs_t,  wddbg),              true },
+    {"sysmgr",  "bootinfo",           offsetof(sysmgr_regs_t,  bootinfo),           false},
+    {"sysmgr",  "hpsinfo",            offsetof(sysmgr_regs_t,  hpsinfo),            false},
+    {"sysmgr",  "parityinj",          offsetof(sysmgr_regs_t,  parityinj),          false},
+    {"sysmgr",  "gbl",                offsetof(sysmgr_regs_t,  gbl),                true },
+    {"sysmgr",  "indiv",              offsetof(sysmgr_regs_t,  indiv),              true },
+    {"sysmgr",  "module",             offsetof(sysmgr_regs_t,  module),             true },
+};
+
+#if defined(__arm__)
+
+static sigjmp_buf sigill_env;
+
+//!
+//! \brief
+//!    SIGILL handler used to probe for user access to the cycle counter.
+//!
+
+static void sigill_handler(int) {
+    siglongjmp(sigill_env, 1);
+}
+
+//!
+//! \brief
+//!    Read the ARMv7 PMU cycle counter (PMCCNTR).
+//!
+
+static inline uint32_t read_pmccntr(void) {
+    uint32_t val;
+    __asm__ __volatile__("mrc p15, 0, %0, c9, c13, 0" : "=r"(val));
+    return val;
+}
+
+#endif
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] io
+//!    HPS register access.
+//!
+//! \param[in] count
+//!    Number of samples per register.
+//!
+
+mmio_profile_t::mmio_profile_t(fpga_io_t &io, unsigned count) :
+    io(io),
+    count(count),
+    batch(1),
+    cycles(false),
+    ns_per_tick(1.0),
+    overhead(0) {
+}
+
+//!
+//! \brief
+//!    Read the timer.
+//!
+//! \returns
+//!    Cycle counter or nanoseconds, truncated to 32 bits.  Only differences
+//!    are used.
+//!
+
+uint32_t mmio_profile_t::ticks(void) {
+    if (cycles) {
+#if defined(__arm__)
+        return read_pmccntr();
+#elif defined(__i386__) || defined(__x86_64__)
+        return (uint32_t)__rdtsc();
+#endif
+    }
+    return (uint32_t)now_ns();
+}
+
+//!
+//! \brief
+//!    Select the timer and measure its resolution and overhead.
+//!
+
+void mmio_profile_t::calibrate(void) {
+
+#if defined(__arm__)
+
+    //
+    // PMCCNTR is only readable from user space if the kernel has set
+    // PMUSERENR.  Otherwise the read traps.
+    //
+
+    struct sigaction sa, old;
+    sa.sa_handler = sigill_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGILL, &sa, &old);
+    if (sigsetjmp(sigill_env, 1) == 0) {
+        uint32_t t0 = read_pmccntr();
+        for (volatile int i = 0; i < 1000; i++) {
+        }
+        cycles = (read_pmccntr() != t0);
+    }
+    sigaction(SIGILL, &old, NULL);
+
+#elif defined(__i386__) || defined(__x86_64__)
+
+    cycles = true;
+
+#endif
+
+    //
+    // Convert ticks to nanoseconds over a 10 ms interval
+    //
+
+    if (cycles) {
+        uint64_t ns0 = now_ns();
+        uint32_t t0  = ticks();
+        while (now_ns() - ns0 < 10000000) {
+        }
+        uint32_t t1  = ticks();
+        uint64_t ns1 = now_ns();
+        ns_per_tick = (double)(ns1 - ns0) / (uint32_t)(t1 - t0);
+        batch = 1;
+    } else {
+        ns_per_tick = 1.0;
+        batch = 16;
+    }
+
+    //
+    // Timer overhead is the median of back-to-back reads
+    //
+
+    samples.clear();
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t t0 = ticks();
+        uint32_t t1 = ticks();
+        samples.push_back(t1 - t0);
+    }
+    std::sort(samples.begin(), samples.end());
+    overhead = samples[samples.size() / 2];
+}
+
+//!
+//! \brief
+//!    Print the latency distribution of the current register.
+//!
+
+void mmio_profile_t::report(const char *block, const char *name, const char *op) {
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+
+    double scale = ns_per_tick / batch;
+    printf("%-8s %-19s %-5s %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n", block, name, op,
+           samples[0] * scale,
+           samples[n * 50 / 100] * scale,
+           samples[n * 90 / 100] * scale,
+           samples[n * 99 / 100] * scale,
+           samples[n - 1] * scale,
+           sum / n * scale);
+}
+
+//!
+//! \brief
+//!    Profile one register.
+//!
+//! \param[in] block
+//!    Name of the register block.
+//!
+//! \param[in] name
+//!    Name of the register.
+//!
+//! \param[in] addr
+//!    Register address.
+//!
+//! \param[in] write
+//!    Profile writes rather than reads.  The register is rewritten with its
+//!    current value.
+//!
+
+void mmio_profile_t::profile(const char *block, const char *name, volatile uint32_t *addr, bool write) {
+
+    uint32_t value = io.read32(addr);
+
+    samples.clear();
+    for (unsigned i = 0; i < count; i++) {
+        uint32_t t0 = ticks();
+        if (write) {
+            for (unsigned j = 0; j < batch; j++) {
+                io.write32(addr, value);
+            }
+        } else {
+            for (unsigned j = 0; j < batch; j++) {
+                io.read32(addr);
+            }
+        }
+        uint32_t t1 = ticks();
+        uint32_t delta = t1 - t0;
+        samples.push_back(delta > overhead ? delta - overhead : 0);
+    }
+
+    report(block, name, write ? "write" : "read");
+}
+
+//!
+//! \brief
+//!    Profile all of the registers.
+//!
+//! \returns
+//!    <b>EXIT_SUCCESS</b>
+//!
+
+int mmio_profile_t::run(void) {
+
+    calibrate();
+
+    printf("%s: %u samples of %u access%s per register, timer is %s (%.3f ns/tick, overhead %u ticks)\n",
+           PROGNAME, count, batch, (batch == 1) ? "" : "es", cycles ? "cycle counter" : "clock_gettime()",
+           ns_per_tick, overhead);
+    printf("%-8s %-19s %-5s %8s %8s %8s %8s %8s %8s\n",
+           "block", "register", "op", "min", "p50", "p90", "p99", "max", "mean");
+
+    for (size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++) {
+        uint8_t *base = (registers[i].block[0] == 'f') ? (uint8_t *)io.fpgamgr_regs : (uint8_t *)io.sysmgr_regs;
+        volatile uint32_t *addr = (volatile uint32_t *)(base + registers[i].offset);
+        profile(registers[i].block, registers[i].name, addr, false);
+        if (registers[i].write) {
+            profile(registers[i].block, registers[i].name, addr, true);
+        }
+    }
+
+    //
+    // The data port is only safe to write when AXI configuration is
+    // disabled.  The data is then discarded.
+    //
+
+    uint32_t ctrl = io.read32(&io.fpgamgr_regs->ctrl);
+    if ((ctrl & (fpga_loader_t::axicfgen | fpga_loader_t::en)) == 0) {
+        samples.clear();
+        for (unsigned i = 0; i < count; i++) {
+            uint32_t t0 = ticks();
+            for (unsigned j = 0; j < batch; j++) {
+                io.write32(io.fpgamgr_data, 0);
+            }
+            uint32_t t1 = ticks();
+            uint32_t delta = t1 - t0;
+            samples.push_back(delta > overhead ? delta - overhead : 0);
+        }
+        report("fpgamgr", "data", "write");
+    } else {
+        printf("%s: skipped the data port because the FPGA is being configured.\n", PROGNAME);
+    }
+
+    printf("(all times in ns per access)\n");
+    return EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    The <tt>profile-mmio</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int mmio_profile_t::main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " profile-mmio [options]\n"
+        "\n"
+        "Measure the latency of reads and writes to the FPGA Manager and System\n"
+        "Manager registers.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --count=n       Number of samples per register (default 10000).\n"
+        "  --help          Print help message and exit.\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Give up if the FPGA is busy for longer than this.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",   no_argument,       0, 0},  // 0
+        {"count",  required_argument, 0, 0},  // 1
+        {"lockfile", required_argument, 0, 0},  // 2
+        {"lock-timeout", required_argument, 0, 0}, // 3
+        {0,        0,                 0, 0},  // 4
+    };
+
+    int index = 0;
+    unsigned count = 10000;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    count = strtoul(optarg, NULL, 0);
+                    break;
+                case 2:
+                    lockfile = optarg;
+                    break;
+                case 3:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+            }
+        }
+    }
+
+    if (count == 0) {
+        printf("%s: count must be at least one\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    fpga_io_t fpga_io;
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // The profile writes ctrl, gpo and the module registers, so keep the
+    // FPGA from being reconfigured under it
+    //
+
+    device_lock_t device_lock;
+    if (!device_lock.lock(lockfile, lock_timeout, true)) {
+        return EXIT_FAILURE;
+    }
+
+    mmio_profile_t mmio_profile(fpga_io, count);
+    return mmio_profile.run();
+}
@@ -0,0 +1,90 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    MMIO register latency profiler header file
+//!
+//! \details
+//!    This object measures the latency of uncached reads and writes to the
+//!    FPGA Manager and System Manager registers.
+//!
+//! \file
+//!    mmio_profile.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __MMIO_PROFILE_H
+#define __MMIO_PROFILE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "fpga_io.hpp"
+
+//!
+//! \brief
+//!    MMIO register latency profiler object
+//!
+//! \details
+//!    Every register that can be read without side effects is read
+//!    repeatedly, and every register that can safely be rewritten with its
+//!    current value is written repeatedly.  The FPGA Manager data port is
+//!    written only when AXI configuration is disabled, in which case the
+//!    writes are discarded.
+//!
+//!    Each access is timed with the CPU cycle counter when user space can
+//!    read it (PMCCNTR on ARMv7 when PMUSERENR is set, the TSC on x86).
+//!    Otherwise batches of accesses are timed with the monotonic clock.
+//!    The timer overhead is measured and subtracted.
+//!
+
+class mmio_profile_t {
+
+    private:
+
+        fpga_io_t &io;                          //!< HPS register access
+        unsigned count;                         //!< Samples per register
+        unsigned batch;                         //!< Accesses per sample
+        bool cycles;                            //!< Cycle counter is available
+        double ns_per_tick;                     //!< Timer resolution
+        uint32_t overhead;                      //!< Timer overhead in ticks
+        std::vector<uint32_t> samples;          //!< Samples of the current register
+
+        uint32_t ticks(void);
+        void calibrate(void);
+        void report(const char *block, const char *name, const char *op);
+        void profile(const char *block, const char *name, volatile uint32_t *addr, bool write);
+
+    public:
+
+        mmio_profile_t(fpga_io_t &io, unsigned count);
+        int run(void);
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif
@@ -0,0 +1,326 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Power management latency
+//!
+//! \file
+//!    pm_latency.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "pm_latency.hpp"
+
+pm_latency_t *pm_latency_t::active = NULL;
+
+//!
+//! \brief
+//!    Read the first line of a sysfs file.
+//!
+
+static bool read_sysfs(const std::string &path, std::string &value) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[64];
+    bool ok = fgets(buf, sizeof(buf), fp) != NULL;
+    fclose(fp);
+    if (ok) {
+        buf[strcspn(buf, "\n")] = 0;
+        value = buf;
+    }
+    return ok;
+}
+
+//!
+//! \brief
+//!    Write a sysfs file.
+//!
+
+static bool write_sysfs(const std::string &path, const std::string &value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, value.c_str(), value.size()) == (ssize_t)value.size();
+    close(fd);
+    return ok;
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+pm_latency_t::pm_latency_t(void) :
+    fd(-1),
+    before_us(0),
+    after_us(0),
+    before_mbps(0),
+    after_mbps(0) {
+}
+
+//!
+//! \brief
+//!    Destructor.  This restores the power management settings.
+//!
+
+pm_latency_t::~pm_latency_t(void) {
+    release();
+}
+
+//!
+//! \brief
+//!    Measure how late usleep() wakes up.
+//!
+//! \details
+//!    The loader polls the FPGA Manager with short sleeps, so this is the
+//!    latency that the governor and the idle states add to each poll.
+//!
+//! \returns
+//!    Mean time past the requested 10 us, in microseconds.
+//!
+
+double pm_latency_t::wake_latency(void) {
+    const int samples = 200;
+    uint64_t total = 0;
+    for (int i = 0; i < samples; i++) {
+        uint64_t start = now_ns();
+        usleep(10);
+        total += now_ns() - start;
+    }
+    return total / 1e3 / samples - 10.0;
+}
+
+//!
+//! \brief
+//!    Measure how fast the CPU hashes a buffer.
+//!
+//! \details
+//!    The loader hashes each chunk as it writes it to the FPGA, so this is
+//!    the CPU side of the Step 10 transfer.  It cannot write to the FPGA
+//!    itself outside a load, so the transfer is not measured here.
+//!
+//! \returns
+//!    Hash rate in MB/s.
+//!
+
+double pm_latency_t::hash_rate(void) {
+    static uint32_t buf[64 * 1024];
+    const int passes = 16;
+    for (size_t i = 0; i < sizeof(buf) / sizeof(buf[0]); i++) {
+        buf[i] = i * 0x9e3779b1;
+    }
+    hash64_t hash;
+    uint64_t start = now_ns();
+    for (int i = 0; i < passes; i++) {
+        hash.update(buf, sizeof(buf));
+    }
+    uint64_t ns = now_ns() - start;
+    volatile uint64_t digest = hash.digest();
+    (void)digest;
+    return (ns > 0) ? sizeof(buf) * passes * 1e3 / ns : 0.0;
+}
+
+//!
+//! \brief
+//!    Restore the frequencies and exit on SIGINT or SIGTERM.
+//!
+//! \details
+//!    Only open(), write() and close() are used, which are safe in a signal
+//!    handler.  The signal is raised again with its default action so that
+//!    the exit status is the same as without the hold.
+//!
+
+void pm_latency_t::signal_handler(int sig) {
+    pm_latency_t *pm = active;
+    if (pm) {
+        for (size_t i = 0; i < pm->policies.size(); i++) {
+            write_sysfs(pm->policies[i].path, pm->policies[i].min_freq);
+        }
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+//!
+//! \brief
+//!    Measure the wake latency and the hash rate with and without the hold.
+//!
+//! \details
+//!    This takes about 30 ms, so it is only done when the result will be
+//!    reported, and before the FPGA is locked.  The hold is released again
+//!    afterwards.
+//!
+
+void pm_latency_t::calibrate(void) {
+    before_us = wake_latency();
+    before_mbps = hash_rate();
+    hold(true);
+    after_us = wake_latency();
+    after_mbps = hash_rate();
+    release();
+}
+
+//!
+//! \brief
+//!    Hold the CPU at low latency.
+//!
+//! \param[in] quiet
+//!    Do not report settings that could not be changed.
+//!
+//! \returns
+//!    True if at least one of the settings was changed.
+//!
+
+bool pm_latency_t::hold(bool quiet) {
+
+    //
+    // Restore the frequencies if the loader is interrupted.  The signals
+    // are blocked while the policies are changed so that the handler
+    // never misses a policy that has been written.
+    //
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    active = this;
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    sigset_t block, old_mask;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old_mask);
+
+    //
+    // Keep cpuidle out of the deep states
+    //
+
+    fd = open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        int32_t latency = 0;
+        if (write(fd, &latency, sizeof(latency)) != sizeof(latency)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if ((fd < 0) && !quiet) {
+        fprintf(stderr, "%s: /dev/cpu_dma_latency: %s\n", PROGNAME, strerror(errno));
+    }
+
+    //
+    // Pin each cpufreq policy to its maximum frequency
+    //
+
+    glob_t gl;
+    if (glob("/sys/devices/system/cpu/cpufreq/policy*", 0, NULL, &gl) == 0) {
+        for (size_t i = 0; i < gl.gl_pathc; i++) {
+            policy_t policy;
+            std::string max_freq;
+            policy.path = std::string(gl.gl_pathv[i]) + "/scaling_min_freq";
+            if (!read_sysfs(policy.path, policy.min_freq) ||
+                !read_sysfs(std::string(gl.gl_pathv[i]) + "/scaling_max_freq", max_freq)) {
+                continue;
+            }
+            if (write_sysfs(policy.path, max_freq)) {
+                policies.push_back(policy);
+            } else if (!quiet) {
+                fprintf(stderr, "%s: %s: %s\n", PROGNAME, policy.path.c_str(), strerror(errno));
+            }
+        }
+        globfree(&gl);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    return (fd >= 0) || !policies.empty();
+}
+
+//!
+//! \brief
+//!    Restore the power management settings.
+//!
+
+void pm_latency_t::release(void) {
+    if (active != this) {
+        return;
+    }
+    for (size_t i = 0; i < policies.size(); i++) {
+        write_sysfs(policies[i].path, policies[i].min_freq);
+    }
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    active = NULL;
+    policies.clear();
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+//!
+//! \brief
+//!    Print the wake latency and the hash rate before and during the hold,
+//!    and the rate of the transfer that was made under it.
+//!
+//! \details
+//!    Only one load is made, so the transfer rate has no figure without
+//!    the hold to compare with.  The report says so rather than let the
+//!    wake latency stand for the load.
+//!
+//! \param[in] data_size
+//!    Bytes written by the load.
+//!
+//! \param[in] data_ns
+//!    Time taken to write them, in nanoseconds.
+//!
+
+void pm_latency_t::report(size_t data_size, uint64_t data_ns) const {
+    printf("%s: usleep(10) wakes %.1f us late (%.1f us without --pm-latency, %.1fx)\n", PROGNAME,
+           after_us, before_us, (after_us > 0) ? before_us / after_us : 0.0);
+    printf("%s: hashing runs at %.1f MB/s (%.1f MB/s without --pm-latency, %.2fx)\n", PROGNAME,
+           after_mbps, before_mbps, (before_mbps > 0) ? after_mbps / before_mbps : 0.0);
+    if (data_ns > 0) {
+        printf("%s: the load wrote %zu bytes at %.1f MB/s (only measured with --pm-latency)\n",
+               PROGNAME, data_size, data_size * 1e3 / data_ns);
+    }
+}
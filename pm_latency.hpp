@@ -0,0 +1,100 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Power management latency header file
+//!
+//! \details
+//!    This object keeps the CPU out of deep idle states and at its highest
+//!    frequency while the FPGA is being programmed.
+//!
+//! \file
+//!    pm_latency.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __PM_LATENCY_H
+#define __PM_LATENCY_H
+
+#include <signal.h>
+#include <string>
+#include <vector>
+
+//!
+//! \brief
+//!    Power management latency object
+//!
+//! \details
+//!    A PM QoS request of zero is held on /dev/cpu_dma_latency, which keeps
+//!    cpuidle in its shallowest state, and the minimum frequency of each
+//!    cpufreq policy is raised to its maximum.  Both are restored by
+//!    release() or by the destructor, so every return path from the load
+//!    undoes them.  The kernel drops the PM QoS request by itself if the
+//!    process dies; the frequencies are restored by a SIGINT and SIGTERM
+//!    handler while the hold is in place.
+//!
+
+class pm_latency_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    A cpufreq policy that was changed
+        //!
+
+        struct policy_t {
+            std::string path;                   //!< scaling_min_freq file
+            std::string min_freq;               //!< Value to restore
+        };
+
+        int fd;                                 //!< /dev/cpu_dma_latency or -1
+        std::vector<policy_t> policies;         //!< Policies to restore
+        double before_us;                       //!< Wake latency before the hold
+        double after_us;                        //!< Wake latency during the hold
+        double before_mbps;                     //!< Hash rate before the hold
+        double after_mbps;                      //!< Hash rate during the hold
+        struct sigaction old_int;               //!< SIGINT action before the hold
+        struct sigaction old_term;              //!< SIGTERM action before the hold
+        static pm_latency_t *active;            //!< Hold restored by the signal handler
+
+        static double wake_latency(void);
+        static double hash_rate(void);
+        static void signal_handler(int sig);
+
+    public:
+
+        pm_latency_t(void);
+        ~pm_latency_t(void);
+        void calibrate(void);
+        bool hold(bool quiet);
+        void release(void);
+        void report(size_t data_size, uint64_t data_ns) const;
+
+};
+
+#endif
@@ -0,0 +1,581 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Synthetic rbf corpus
+//!
+//! \file
+//!    rbf_corpus.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <algorithm>
+#include <string>
+
+#include "rbf_corpus.hpp"
+#include "rbf_format.hpp"
+
+//!
+//! \brief
+//!    Seeded random number generator (SplitMix64).
+//!
+
+static uint64_t random64(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+//!
+//! \brief
+//!    Power-of-two bucket of a length.
+//!
+
+static int bucket(uint64_t length) {
+    return 63 - __builtin_clzll(length);
+}
+
+//!
+//! \brief
+//!    Draw a length from a histogram.
+//!
+//! \returns
+//!    A length in the bucket, or zero if the histogram is empty.
+//!
+
+static uint64_t draw(const uint64_t *histogram, uint64_t &state) {
+    uint64_t total = 0;
+    for (int i = 0; i < rbf_corpus_t::buckets; i++) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t r = random64(state) % total;
+    int i = 0;
+    while (r >= histogram[i]) {
+        r -= histogram[i++];
+    }
+    uint64_t low = 1ULL << i;
+    return low + random64(state) % low;
+}
+
+//!
+//! \brief
+//!    Entropy of a byte distribution where p(i) is proportional to
+//!    exp(-beta * i).
+//!
+
+static double entropy(double beta) {
+    double sum = 0;
+    double weighted = 0;
+    for (int i = 0; i < 256; i++) {
+        double w = exp(-beta * i);
+        sum += w;
+        weighted += w * beta * i;
+    }
+    return (weighted / sum + log(sum)) / log(2.0);
+}
+
+//!
+//! \brief
+//!    Extract the profile of an image.
+//!
+//! \param[in] data
+//!    Image data.
+//!
+//! \param[in] size
+//!    Image size in bytes.
+//!
+//! \param[out] profile
+//!    The profile.
+//!
+
+void rbf_corpus_t::extract(const uint8_t *data, size_t size, profile_t &profile) {
+
+    profile.size = size;
+    profile.header.assign(data, data + ((size < header_max) ? size : header_max));
+    memset(profile.zero,    0, sizeof(profile.zero));
+    memset(profile.ff,      0, sizeof(profile.ff));
+    memset(profile.literal, 0, sizeof(profile.literal));
+
+    uint64_t counts[256] = {0};
+    uint64_t literal_bytes = 0;
+    size_t literal = 0;
+
+    for (size_t i = profile.header.size(); i < size; ) {
+
+        //
+        // Measure a run of 0x00 or 0xff.  Short runs are literals.
+        //
+
+        uint8_t byte = data[i];
+        size_t len = 1;
+        if ((byte == 0x00) || (byte == 0xff)) {
+            while ((i + len < size) && (data[i + len] == byte)) {
+                len++;
+            }
+            if (len >= min_run) {
+                profile.literal[bucket(literal + 1)]++;
+                (byte ? profile.ff : profile.zero)[bucket(len)]++;
+                literal = 0;
+                i += len;
+                continue;
+            }
+        }
+
+        counts[byte]  += len;
+        literal_bytes += len;
+        literal       += len;
+        i             += len;
+    }
+
+    if (literal) {
+        profile.literal[bucket(literal + 1)]++;
+    }
+
+    profile.entropy = 0;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i]) {
+            double p = (double)counts[i] / literal_bytes;
+            profile.entropy -= p * log(p) / log(2.0);
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Write a profile.
+//!
+
+void rbf_corpus_t::write(FILE *fp, const profile_t &profile) {
+    fprintf(fp, "size %zu\n", profile.size);
+    fprintf(fp, "entropy %.4f\n", profile.entropy);
+    fprintf(fp, "header ");
+    for (size_t i = 0; i < profile.header.size(); i++) {
+        fprintf(fp, "%02x", profile.header[i]);
+    }
+    fprintf(fp, "\n");
+    const struct { const char *name; const uint64_t *histogram; } histograms[] = {
+        {"zero",    profile.zero},
+        {"ff",      profile.ff},
+        {"literal", profile.literal},
+    };
+    for (size_t h = 0; h < sizeof(histograms) / sizeof(histograms[0]); h++) {
+        for (int i = 0; i < buckets; i++) {
+            if (histograms[h].histogram[i]) {
+                fprintf(fp, "%s %d %llu\n", histograms[h].name, i, (unsigned long long)histograms[h].histogram[i]);
+            }
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Read a profile.
+//!
+//! \param[in] filename
+//!    Profile written by the <tt>profile-rbf</tt> command.
+//!
+//! \param[out] profile
+//!    The profile.
+//!
+//! \returns
+//!    True if the profile is valid.
+//!
+
+bool rbf_corpus_t::read(const char *filename, profile_t &profile) {
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    profile.size    = 0;
+    profile.entropy = 8.0;
+    profile.header.clear();
+    memset(profile.zero,    0, sizeof(profile.zero));
+    memset(profile.ff,      0, sizeof(profile.ff));
+    memset(profile.literal, 0, sizeof(profile.literal));
+
+    char line[512];
+    for (int lineno = 1; fgets(line, sizeof(line), fp); lineno++) {
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = 0;
+        }
+
+        char key[64], arg1[256], arg2[64];
+        int n = sscanf(line, "%63s %255s %63s", key, arg1, arg2);
+        if (n <= 0) {
+            continue;
+        }
+
+        bool ok = false;
+        if ((n == 2) && (strcmp(key, "size") == 0)) {
+            profile.size = strtoull(arg1, NULL, 0);
+            ok = rbf_format_t::valid_size(profile.size);
+        } else if ((n == 2) && (strcmp(key, "entropy") == 0)) {
+            profile.entropy = strtod(arg1, NULL);
+            ok = (profile.entropy >= 0) && (profile.entropy <= 8);
+        } else if ((n == 2) && (strcmp(key, "header") == 0)) {
+            size_t len = strlen(arg1);
+            ok = ((len & 1) == 0) && (len <= 2 * header_max);
+            for (size_t i = 0; ok && (i < len); i += 2) {
+                unsigned int byte;
+                ok = (sscanf(arg1 + i, "%2x", &byte) == 1);
+                profile.header.push_back(byte);
+            }
+        } else if ((n == 3) && ((strcmp(key, "zero") == 0) || (strcmp(key, "ff") == 0) ||
+                                (strcmp(key, "literal") == 0))) {
+            int i = strtol(arg1, NULL, 0);
+            uint64_t *histogram = (key[0] == 'z') ? profile.zero : (key[0] == 'f') ? profile.ff : profile.literal;
+            if ((i >= 0) && (i < buckets)) {
+                histogram[i] = strtoull(arg2, NULL, 0);
+                ok = true;
+            }
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: %s:%d: invalid profile item.\n", PROGNAME, filename, lineno);
+            fclose(fp);
+            return false;
+        }
+    }
+
+    fclose(fp);
+
+    if (profile.size == 0) {
+        fprintf(stderr, "%s: %s: profile has no size.\n", PROGNAME, filename);
+        return false;
+    }
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Generate a synthetic image.
+//!
+//! \param[in] profile
+//!    Profile of the image.
+//!
+//! \param[in] seed
+//!    Seed.  The same profile and seed always give the same image.
+//!
+//! \returns
+//!    The image, or an empty image if it cannot be allocated.
+//!
+
+rbf_image_t rbf_corpus_t::generate(const profile_t &profile, uint64_t seed) {
+
+    rbf_image_t image = rbf_image_t::allocate(profile.size, false);
+    if (!image.valid()) {
+        return image;
+    }
+
+    uint8_t *data = image.writable();
+    size_t size = profile.size;
+    uint64_t state = seed;
+
+    size_t pos = std::min(size, profile.header.size());
+    memcpy(data, profile.header.data(), pos);
+
+    //
+    // Literal byte distribution: p(i) proportional to exp(-beta * i) over
+    // a shuffled byte order, with beta chosen to give the entropy.
+    //
+
+    double lo = 0;
+    double hi = 64;
+    for (int i = 0; i < 64; i++) {
+        double beta = (lo + hi) / 2;
+        if (entropy(beta) > profile.entropy) {
+            lo = beta;
+        } else {
+            hi = beta;
+        }
+    }
+
+    uint8_t order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = i;
+    }
+    for (int i = 255; i > 0; i--) {
+        std::swap(order[i], order[random64(state) % (i + 1)]);
+    }
+
+    double cdf[256];
+    double sum = 0;
+    for (int i = 0; i < 256; i++) {
+        cdf[i] = (sum += exp(-lo * i));
+    }
+
+    uint64_t zero_runs = 0;
+    uint64_t ff_runs = 0;
+    for (int i = 0; i < buckets; i++) {
+        zero_runs += profile.zero[i];
+        ff_runs   += profile.ff[i];
+    }
+
+    //
+    // Alternate literals and runs until the image is full
+    //
+
+    while (pos < size) {
+
+        uint64_t literal = draw(profile.literal, state);
+        if ((literal == 0) && (zero_runs + ff_runs == 0)) {
+            literal = size - pos + 1;
+        }
+        for (uint64_t i = 1; (i < literal) && (pos < size); i++) {
+            double u = (random64(state) >> 11) * (sum / 9007199254740992.0);
+            data[pos++] = order[std::upper_bound(cdf, cdf + 255, u) - cdf];
+        }
+
+        if ((pos < size) && (zero_runs + ff_runs != 0)) {
+            bool zero = (random64(state) % (zero_runs + ff_runs)) < zero_runs;
+            uint64_t len = std::min<uint64_t>(draw(zero ? profile.zero : profile.ff, state), size - pos);
+            memset(data + pos, zero ? 0x00 : 0xff, len);
+            pos += len;
+        }
+    }
+
+    return image;
+}
+
+//!
+//! \brief
+//!    The <tt>profile-rbf</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int rbf_corpus_t::profile_main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " profile-rbf [options] file.rbf\n"
+        "\n"
+        "Print the size, header, run lengths and entropy of an rbf file.  The\n"
+        "profile holds no design data and can be given to gen-rbf.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --help          Print help message and exit.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {0,          0,                 0, 0},  // 1
+    };
+
+    int index = 0;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+            }
+        }
+    }
+
+    if (argv[optind] == NULL) {
+        printf("%s: missing rbf file\n", PROGNAME);
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    rbf_image_t image = rbf_image_t::open(argv[optind]);
+    if (!image.valid()) {
+        return EXIT_FAILURE;
+    }
+
+    profile_t profile;
+    extract(image.bytes(), image.size(), profile);
+    printf("# rbf profile of %s\n", argv[optind]);
+    write(stdout, profile);
+    return EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    The <tt>gen-rbf</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int rbf_corpus_t::generate_main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " gen-rbf [options] profile output.rbf\n"
+        "\n"
+        "Generate synthetic rbf files with the shape given by a profile from\n"
+        "profile-rbf.  The output depends only on the profile and the seed.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --count=n       Generate n files, output-000.rbf and so on, with\n"
+        "                  consecutive seeds.\n"
+        "  --help          Print help message and exit.\n"
+        "  --quiet         Do not list the files.\n"
+        "  --seed=n        Seed (default 1).\n"
+        "  --size=bytes    Override the image size (rounded down to whole words).\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"count",    required_argument, 0, 0},  // 1
+        {"quiet",    no_argument,       0, 0},  // 2
+        {"seed",     required_argument, 0, 0},  // 3
+        {"size",     required_argument, 0, 0},  // 4
+        {0,          0,                 0, 0},  // 5
+    };
+
+    int index = 0;
+    unsigned int count = 1;
+    bool quiet = false;
+    uint64_t seed = 1;
+    size_t size = 0;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    count = strtoul(optarg, NULL, 0);
+                    break;
+                case 2:
+                    quiet = true;
+                    break;
+                case 3:
+                    seed = strtoull(optarg, NULL, 0);
+                    break;
+                case 4:
+                    size = strtoull(optarg, NULL, 0) & ~(size_t)3;
+                    if (size == 0) {
+                        printf("%s: invalid size: %s\n", PROGNAME, optarg);
+                        return EXIT_FAILURE;
+                    }
+                    break;
+            }
+        }
+    }
+
+    if ((argv[optind] == NULL) || (argv[optind + 1] == NULL)) {
+        printf("%s: missing profile or output file\n", PROGNAME);
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    profile_t profile;
+    if (!read(argv[optind], profile)) {
+        return EXIT_FAILURE;
+    }
+    if (size) {
+        profile.size = size;
+    }
+
+    std::string output = argv[optind + 1];
+    std::string base = output;
+    if ((base.size() > 4) && (base.compare(base.size() - 4, 4, ".rbf") == 0)) {
+        base.erase(base.size() - 4);
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+
+        std::string filename = output;
+        if (count > 1) {
+            char suffix[16];
+            snprintf(suffix, sizeof(suffix), "-%03u.rbf", i);
+            filename = base + suffix;
+        }
+
+        rbf_image_t image = generate(profile, seed + i);
+        if (!image.valid()) {
+            return EXIT_FAILURE;
+        }
+
+        FILE *fp = fopen(filename.c_str(), "w");
+        bool ok = fp && (fwrite(image.bytes(), image.size(), 1, fp) == 1);
+        if (fp && (fclose(fp) != 0)) {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename.c_str(), strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        if (!quiet) {
+            printf("%s: wrote %s (%zu bytes, seed %llu)\n", PROGNAME, filename.c_str(), image.size(),
+                   (unsigned long long)(seed + i));
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,100 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Synthetic rbf corpus header file
+//!
+//! \details
+//!    This object extracts the statistical shape of an rbf file and generates
+//!    synthetic images with the same shape for benchmarks.
+//!
+//! \file
+//!    rbf_corpus.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_CORPUS_H
+#define __RBF_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Synthetic rbf corpus object
+//!
+//! \details
+//!    An image is modeled as its header (the preamble and option bits),
+//!    followed by a payload of literal bytes broken up by runs of 0x00 and
+//!    0xff bytes.  A run is at least min_run bytes long; shorter runs are
+//!    part of the literals.  The profile keeps the image size, the header,
+//!    histograms of the run and literal lengths in power-of-two buckets and
+//!    the entropy of the literal bytes.  It does not keep any of the design
+//!    data.
+//!
+//!    Generated images copy the header, then alternate literals and runs
+//!    drawn from the histograms.  Literal bytes are drawn from a skewed
+//!    distribution that has the profiled entropy.  Everything is derived
+//!    from the seed, so a corpus can be regenerated exactly.
+//!
+
+class rbf_corpus_t {
+
+    public:
+
+        static const size_t min_run    = 8;     //!< Shortest run of 0x00 or 0xff
+        static const size_t header_max = 64;    //!< Bytes of header kept
+        static const int    buckets    = 33;    //!< Power-of-two length buckets
+
+        //!
+        //! \brief
+        //!    Image profile
+        //!
+
+        struct profile_t {
+            size_t size;                        //!< Image size in bytes
+            double entropy;                     //!< Literal entropy in bits per byte
+            std::vector<uint8_t> header;        //!< Leading bytes of the image
+            uint64_t zero[buckets];             //!< 0x00 runs by length bucket
+            uint64_t ff[buckets];               //!< 0xff runs by length bucket
+            uint64_t literal[buckets];          //!< Literal stretches by length + 1 bucket
+        };
+
+        static void extract(const uint8_t *data, size_t size, profile_t &profile);
+        static void write(FILE *fp, const profile_t &profile);
+        static bool read(const char *filename, profile_t &profile);
+        static rbf_image_t generate(const profile_t &profile, uint64_t seed);
+        static int profile_main(int argc, char *argv[]);
+        static int generate_main(int argc, char *argv[]);
+
+};
+
+#endif
@@ -0,0 +1,929 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Encrypted RBF container
+//!
+//! \details
+//!    The container is sealed with ChaCha20-Poly1305 as described in RFC 8439
+//!    using the container header as the associated data.  Both primitives are
+//!    implemented here in portable C++ so that the loader has no library
+//!    dependencies when it is linked statically.
+//!
+//! \file
+//!    rbf_crypt.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "fpga_sim.hpp"
+#include "rbf_crypt.hpp"
+#include "rbf_format.hpp"
+
+const char rbf_crypt_t::magic[8] = {'K', 'S', '1', '0', 'R', 'B', 'F', 'E'};
+
+//!
+//! \brief
+//!    Read a little-endian 32-bit word from a byte stream.
+//!
+
+static inline uint32_t load32(const uint8_t *p) {
+    return ((uint32_t)p[0] <<  0) | ((uint32_t)p[1] <<  8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//!
+//! \brief
+//!    Write a little-endian 32-bit word to a byte stream.
+//!
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    p[0] = v >>  0;
+    p[1] = v >>  8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+//!
+//! \brief
+//!    Rotate a 32-bit word left.
+//!
+
+static inline uint32_t rotl(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+#define QUARTERROUND(a, b, c, d)                        \
+    a += b; d ^= a; d = rotl(d, 16);                    \
+    c += d; b ^= c; b = rotl(b, 12);                    \
+    a += b; d ^= a; d = rotl(d,  8);                    \
+    c += d; b ^= c; b = rotl(b,  7);
+
+//!
+//! \brief
+//!    Generate one 64 byte ChaCha20 keystream block.
+//!
+//! \param[in] key
+//!    256-bit key.
+//!
+//! \param[in] counter
+//!    Block counter.
+//!
+//! \param[in] nonce
+//!    96-bit nonce.
+//!
+//! \param[out] out
+//!    Keystream block.
+//!
+
+static void chacha20_block(const uint8_t *key, uint32_t counter, const uint8_t *nonce, uint8_t out[64]) {
+
+    uint32_t in[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        load32(key +  0), load32(key +  4), load32(key +  8), load32(key + 12),
+        load32(key + 16), load32(key + 20), load32(key + 24), load32(key + 28),
+        counter, load32(nonce + 0), load32(nonce + 4), load32(nonce + 8),
+    };
+
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+
+    for (int i = 0; i < 10; i++) {
+        QUARTERROUND(x[0], x[4], x[ 8], x[12]);
+        QUARTERROUND(x[1], x[5], x[ 9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[ 8], x[13]);
+        QUARTERROUND(x[3], x[4], x[ 9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i++) {
+        store32(&out[4 * i], x[i] + in[i]);
+    }
+}
+
+//!
+//! \brief
+//!    Encrypt or decrypt a buffer with ChaCha20.
+//!
+//! \param[in] key
+//!    256-bit key.
+//!
+//! \param[in] nonce
+//!    96-bit nonce.
+//!
+//! \param[in] counter
+//!    Block counter of the first block.
+//!
+//! \param[in] in
+//!    Input data.
+//!
+//! \param[out] out
+//!    Output data.  This may be the same as the input.
+//!
+//! \param[in] len
+//!    Number of bytes to process.
+//!
+
+static void chacha20_xor(const uint8_t *key, const uint8_t *nonce, uint32_t counter, const uint8_t *in, uint8_t *out, size_t len) {
+    uint8_t block[64];
+    while (len > 0) {
+        chacha20_block(key, counter++, nonce, block);
+        size_t n = len < sizeof(block) ? len : sizeof(block);
+        for (size_t i = 0; i < n; i++) {
+            out[i] = in[i] ^ block[i];
+        }
+        in  += n;
+        out += n;
+        len -= n;
+    }
+}
+
+//!
+//! \brief
+//!    Poly1305 one-time authenticator.
+//!
+//! \details
+//!    This uses 26-bit limbs so that all of the products fit in 64 bits,
+//!    which suits the 32-bit ARM core of the HPS.
+//!
+
+class poly1305_t {
+
+    private:
+
+        uint32_t r[5];                          //!< Clamped key
+        uint32_t h[5];                          //!< Accumulator
+        uint32_t pad[4];                        //!< Final pad (s)
+        uint8_t  buf[16];                       //!< Partial block
+        size_t   used;                          //!< Bytes in partial block
+
+        void blocks(const uint8_t *m, size_t bytes, uint32_t hibit);
+
+    public:
+
+        poly1305_t(const uint8_t key[32]);
+        void update(const uint8_t *m, size_t bytes);
+        void pad16(void);
+        void finish(uint8_t mac[16]);
+
+};
+
+//!
+//! \brief
+//!    Initialize the authenticator with a one-time key.
+//!
+
+poly1305_t::poly1305_t(const uint8_t key[32]) {
+    r[0] = (load32(&key[ 0]) >> 0) & 0x3ffffff;
+    r[1] = (load32(&key[ 3]) >> 2) & 0x3ffff03;
+    r[2] = (load32(&key[ 6]) >> 4) & 0x3ffc0ff;
+    r[3] = (load32(&key[ 9]) >> 6) & 0x3f03fff;
+    r[4] = (load32(&key[12]) >> 8) & 0x00fffff;
+    for (int i = 0; i < 5; i++) {
+        h[i] = 0;
+    }
+    for (int i = 0; i < 4; i++) {
+        pad[i] = load32(&key[16 + 4 * i]);
+    }
+    used = 0;
+}
+
+//!
+//! \brief
+//!    Process whole 16 byte blocks.
+//!
+
+void poly1305_t::blocks(const uint8_t *m, size_t bytes, uint32_t hibit) {
+
+    const uint32_t r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+    while (bytes >= 16) {
+        h0 += (load32(m +  0) >> 0) & 0x3ffffff;
+        h1 += (load32(m +  3) >> 2) & 0x3ffffff;
+        h2 += (load32(m +  6) >> 4) & 0x3ffffff;
+        h3 += (load32(m +  9) >> 6) & 0x3ffffff;
+        h4 += (load32(m + 12) >> 8) | hibit;
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c = (uint32_t)(d0 >> 26); h0 = (uint32_t)d0 & 0x3ffffff;
+        d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+        d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+        d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+        d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+
+        m     += 16;
+        bytes -= 16;
+    }
+
+    h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+}
+
+//!
+//! \brief
+//!    Add message bytes to the authenticator.
+//!
+
+void poly1305_t::update(const uint8_t *m, size_t bytes) {
+    if (used) {
+        size_t n = 16 - used < bytes ? 16 - used : bytes;
+        memcpy(&buf[used], m, n);
+        used  += n;
+        m     += n;
+        bytes -= n;
+        if (used < 16) {
+            return;
+        }
+        blocks(buf, 16, 1 << 24);
+        used = 0;
+    }
+    size_t whole = bytes & ~(size_t)15;
+    blocks(m, whole, 1 << 24);
+    memcpy(buf, m + whole, bytes - whole);
+    used = bytes - whole;
+}
+
+//!
+//! \brief
+//!    Zero pad the message to a 16 byte boundary as required by RFC 8439.
+//!
+
+void poly1305_t::pad16(void) {
+    if (used) {
+        memset(&buf[used], 0, 16 - used);
+        blocks(buf, 16, 1 << 24);
+        used = 0;
+    }
+}
+
+//!
+//! \brief
+//!    Compute the tag.
+//!
+
+void poly1305_t::finish(uint8_t mac[16]) {
+
+    if (used) {
+        buf[used++] = 1;
+        memset(&buf[used], 0, 16 - used);
+        blocks(buf, 16, 0);
+    }
+
+    uint32_t h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+    uint32_t c;
+
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    //
+    // Compute h - p and select it if it is not negative
+    //
+
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1UL << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    //
+    // h = (h + pad) % 2^128
+    //
+
+    h0 = (h0 >>  0) | (h1 << 26);
+    h1 = (h1 >>  6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 <<  8);
+
+    uint64_t f;
+    f = (uint64_t)h0 + pad[0];             store32(&mac[ 0], (uint32_t)f);
+    f = (uint64_t)h1 + pad[1] + (f >> 32); store32(&mac[ 4], (uint32_t)f);
+    f = (uint64_t)h2 + pad[2] + (f >> 32); store32(&mac[ 8], (uint32_t)f);
+    f = (uint64_t)h3 + pad[3] + (f >> 32); store32(&mac[12], (uint32_t)f);
+}
+
+//!
+//! \brief
+//!    Create the RFC 8439 AEAD authenticator for a container.
+//!
+//! \details
+//!    The one-time Poly1305 key is the first half of keystream block zero.
+//!    The header is the associated data.
+//!
+
+static poly1305_t aead_init(const uint8_t *key, const rbf_crypt_header_t *header) {
+    uint8_t block[64];
+    chacha20_block(key, 0, header->nonce, block);
+    poly1305_t poly(block);
+    poly.update((const uint8_t *)header, sizeof(*header));
+    poly.pad16();
+    memset(block, 0, sizeof(block));
+    return poly;
+}
+
+//!
+//! \brief
+//!    Finish the RFC 8439 AEAD authenticator.
+//!
+
+static void aead_finish(poly1305_t &poly, size_t size, uint8_t tag[rbf_crypt_t::tag_size]) {
+    uint8_t lengths[16];
+    store32(&lengths[ 0], sizeof(rbf_crypt_header_t));
+    store32(&lengths[ 4], 0);
+    store32(&lengths[ 8], (uint32_t)size);
+    store32(&lengths[12], 0);
+    poly.pad16();
+    poly.update(lengths, sizeof(lengths));
+    poly.finish(tag);
+}
+
+//!
+//! \brief
+//!    Check whether a file is an encrypted RBF container.
+//!
+//! \param[in] filename
+//!    Name of the file to check.
+//!
+//! \returns
+//!    True if the file starts with the container magic number.
+//!
+
+bool rbf_crypt_t::is_encrypted(const char *filename) {
+    char buf[sizeof(magic)];
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        return false;
+    }
+    bool ret = (fread(buf, 1, sizeof(buf), fp) == sizeof(buf)) && (memcmp(buf, magic, sizeof(magic)) == 0);
+    fclose(fp);
+    return ret;
+}
+
+//!
+//! \brief
+//!    Read the key from a keyfile.
+//!
+//! \details
+//!    The keyfile contains either the 32 byte key itself or the key as 64
+//!    hexadecimal digits optionally followed by whitespace.
+//!
+//! \param[in] filename
+//!    Name of the keyfile.
+//!
+//! \param[out] key
+//!    The key.
+//!
+//! \returns
+//!    True if the key was read successfully.
+//!
+
+bool rbf_crypt_t::read_keyfile(const char *filename, uint8_t key[key_size]) {
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    struct stat st;
+    if ((fstat(fileno(fp), &st) == 0) && (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        fprintf(stderr, "%s: warning: keyfile \"%s\" is accessible by other users.\n", PROGNAME, filename);
+    }
+
+    uint8_t buf[2 * key_size + 2];
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    fclose(fp);
+
+    bool ret = false;
+    if (len == key_size) {
+        memcpy(key, buf, key_size);
+        ret = true;
+    } else if (len >= 2 * key_size) {
+        ret = true;
+        for (size_t i = 0; i < 2 * key_size; i++) {
+            char c = buf[i];
+            int nibble = (c >= '0' && c <= '9') ? c - '0' :
+                         (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                         (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (nibble < 0) {
+                ret = false;
+                break;
+            }
+            key[i / 2] = (i & 1) ? (key[i / 2] | nibble) : (nibble << 4);
+        }
+        for (size_t i = 2 * key_size; i < len; i++) {
+            if (buf[i] != '\n' && buf[i] != '\r' && buf[i] != ' ') {
+                ret = false;
+            }
+        }
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (!ret) {
+        fprintf(stderr, "%s: keyfile \"%s\" must contain a 32 byte key or 64 hex digits.\n", PROGNAME, filename);
+    }
+    return ret;
+}
+
+//!
+//! \brief
+//!    Write an RBF image to an encrypted RBF container.
+//!
+//! \param[in] key
+//!    Encryption key.
+//!
+//! \param[in] rbf_data
+//!    RBF image.
+//!
+//! \param[in] rbf_size
+//!    Size of the RBF image in 32-bit words.
+//!
+//! \param[in] filename
+//!    Name of the container file to create.
+//!
+//! \returns
+//!    True if the container was written successfully.
+//!
+
+bool rbf_crypt_t::encrypt(const uint8_t key[key_size], const uint32_t *rbf_data, size_t rbf_size, const char *filename) {
+
+    rbf_crypt_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.size    = rbf_size * sizeof(uint32_t);
+
+    //
+    // A nonce must never be reused with the same key
+    //
+
+    FILE *rnd = fopen("/dev/urandom", "r");
+    if (!rnd || fread(header.nonce, 1, sizeof(header.nonce), rnd) != sizeof(header.nonce)) {
+        fprintf(stderr, "%s: unable to read /dev/urandom.\n", PROGNAME);
+        if (rnd) {
+            fclose(rnd);
+        }
+        return false;
+    }
+    fclose(rnd);
+
+    uint8_t *buf = (uint8_t *)malloc(header.size);
+    if (!buf) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    chacha20_xor(key, header.nonce, 1, (const uint8_t *)rbf_data, buf, header.size);
+
+    uint8_t tag[tag_size];
+    poly1305_t poly = aead_init(key, &header);
+    poly.update(buf, header.size);
+    aead_finish(poly, header.size, tag);
+
+    FILE *fp = fopen(filename, "w");
+    bool ret = fp &&
+        (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+        (fwrite(buf, 1, header.size, fp) == header.size) &&
+        (fwrite(tag, sizeof(tag), 1, fp) == 1);
+    if (fp && fclose(fp) != 0) {
+        ret = false;
+    }
+    if (!ret) {
+        perror(PROGNAME);
+    }
+
+    free(buf);
+    return ret;
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+rbf_decrypt_t::rbf_decrypt_t(void) :
+    header(NULL),
+    ring(chunks),
+    held(NULL),
+    verified(false) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+//! \details
+//!    Stop the decryption thread if it is still running and wipe the key.
+//!
+
+rbf_decrypt_t::~rbf_decrypt_t(void) {
+    pool.close();
+    if (worker.joinable()) {
+        worker.join();
+    }
+    memset(key, 0, sizeof(key));
+}
+
+//!
+//! \brief
+//!    Open an encrypted RBF container and start decrypting it.
+//!
+//! \param[in] filename
+//!    Name of the container file.
+//!
+//! \param[in] key
+//!    Decryption key.
+//!
+//! \returns
+//!    True if the container is well formed and decryption has started.
+//!
+
+bool rbf_decrypt_t::open(const char *filename, const uint8_t key[rbf_crypt_t::key_size]) {
+
+    image = rbf_image_t::open(filename);
+    if (!image.valid()) {
+        return false;
+    }
+
+    if (image.size() < sizeof(rbf_crypt_header_t) + rbf_crypt_t::tag_size) {
+        fprintf(stderr, "%s: \"%s\" is too short to be an encrypted rbf file.\n", PROGNAME, filename);
+        return false;
+    }
+
+    header = (const rbf_crypt_header_t *)image.bytes();
+
+    if ((memcmp(header->magic, rbf_crypt_t::magic, sizeof(header->magic)) != 0) ||
+        (header->version != rbf_crypt_t::version) ||
+        (header->reserved != 0) ||
+        ((header->size & 0x03) != 0) ||
+        (image.size() != sizeof(*header) + header->size + rbf_crypt_t::tag_size)) {
+        fprintf(stderr, "%s: \"%s\" is not a valid encrypted rbf file.\n", PROGNAME, filename);
+        return false;
+    }
+
+    if (!pool.create(chunks, chunk_size)) {
+        return false;
+    }
+
+    memcpy(this->key, key, sizeof(this->key));
+    worker = std::thread(&rbf_decrypt_t::decrypt, this);
+
+    //
+    // Decrypt on the second core so that decryption overlaps the data port
+    // writes on the first.
+    //
+
+    if (std::thread::hardware_concurrency() > 1) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(1, &cpus);
+        pthread_setaffinity_np(worker.native_handle(), sizeof(cpus), &cpus);
+    }
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Size of the decrypted RBF image.
+//!
+//! \returns
+//!    Size of the RBF image in bytes.
+//!
+
+size_t rbf_decrypt_t::size(void) const {
+    return header ? header->size : 0;
+}
+
+//!
+//! \brief
+//!    Decryption thread.
+//!
+//! \details
+//!    The MAC is computed over the ciphertext as each chunk is decrypted so
+//!    the container is only read once.  The thread stops early if the pool
+//!    is closed.
+//!
+
+void rbf_decrypt_t::decrypt(void) {
+
+    poly1305_t poly = aead_init(key, header);
+    const uint8_t *ciphertext = image.bytes() + sizeof(*header);
+    size_t size = header->size;
+
+    for (size_t offset = 0; offset < size; offset += chunk_size) {
+
+        rbf_chunk_t *chunk = pool.get(1);
+        if (!chunk) {
+            ring.close();
+            return;
+        }
+
+        size_t len = (size - offset < chunk_size) ? size - offset : chunk_size;
+        poly.update(ciphertext + offset, len);
+        chacha20_xor(key, header->nonce, 1 + offset / 64, ciphertext + offset, (uint8_t *)chunk->data, len);
+        chunk->words = len / sizeof(uint32_t);
+        ring.push(chunk);
+    }
+
+    uint8_t tag[rbf_crypt_t::tag_size];
+    aead_finish(poly, size, tag);
+
+    //
+    // Constant time comparison
+    //
+
+    const uint8_t *expected = ciphertext + size;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < sizeof(tag); i++) {
+        diff |= tag[i] ^ expected[i];
+    }
+
+    verified = (diff == 0);
+    ring.close();
+}
+
+//!
+//! \brief
+//!    Get the next decrypted chunk.
+//!
+//! \details
+//!    The chunk that was returned by the previous call is released back to
+//!    the pool.
+//!
+
+size_t rbf_decrypt_t::next(const uint32_t **chunk) {
+    if (held) {
+        pool.put(held);
+    }
+    held = ring.pop();
+    if (!held) {
+        return 0;
+    }
+    *chunk = held->data;
+    return held->words;
+}
+
+//!
+//! \brief
+//!    Report whether the Poly1305 tag matched.
+//!
+//! \details
+//!    This waits for the decryption thread to finish.
+//!
+
+bool rbf_decrypt_t::good(void) {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    return verified;
+}
+
+//!
+//! \brief
+//!    Print one line of the benchmark.
+//!
+
+static void bench_report(const char *name, size_t size, uint64_t ns, bool ok) {
+    printf("%-14s %8.1f MB %10.3f ms %9.1f MB/s  %s\n", name, size / 1e6, ns * 1e-6,
+           size / (ns * 1e-9) / 1e6, ok ? "ok" : "FAILED");
+}
+
+//!
+//! \brief
+//!    Decryption benchmark
+//!
+//! \details
+//!    An rbf file, such as a gen-rbf corpus image, or a pseudo-random image
+//!    that is the same on every run is encrypted into a temporary container
+//!    and then
+//!
+//!    - loaded unencrypted into the simulated FPGA (plain),
+//!    - decrypted without being loaded (decrypt only), and
+//!    - decrypted while it is loaded into the simulated FPGA (pipelined).
+//!
+//!    The simulated FPGA runs in virtual time, so the plain load measures
+//!    the loader itself.  The pipelined load is bounded by the slower of the
+//!    other two when decryption overlaps the load.
+//!
+//! \param[in] argc
+//!    Number of arguments, starting with "bench-crypt".
+//!
+//! \param[in] argv
+//!    Arguments
+//!
+//! \returns
+//!    EXIT_SUCCESS if every run produced the right data.
+//!
+
+int rbf_crypt_t::bench(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " bench-crypt [options]\n"
+        "\n"
+        "Measure the plain, decrypt-only and pipelined (decrypted while loaded)\n"
+        "throughput of an encrypted container, using the simulated FPGA.  The\n"
+        "container holds an rbf file, such as one from gen-rbf, or a\n"
+        "pseudo-random image that is the same on every run.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --help          Print help message and exit.\n"
+        "  --image=file    Encrypt this rbf file instead of a pseudo-random\n"
+        "                  image.\n"
+        "  --size=MB       Size of the pseudo-random image (default 32).\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"size",     required_argument, 0, 0},  // 1
+        {"image",    required_argument, 0, 0},  // 2
+        {0,          0,                 0, 0},  // 3
+    };
+
+    int index = 0;
+    size_t size = 32 * 1024 * 1024;
+    const char *image_file = NULL;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    size = strtoul(optarg, NULL, 0) * 1024 * 1024;
+                    break;
+                case 2:
+                    image_file = optarg;
+                    break;
+            }
+        }
+    }
+
+    //
+    // Read the rbf file or make a pseudo-random image, and encrypt it
+    //
+
+    rbf_image_t image;
+    if (image_file) {
+        image = rbf_image_t::open(image_file);
+        if (!image.valid()) {
+            return EXIT_FAILURE;
+        }
+        if (!rbf_format_t::valid_size(image.size())) {
+            fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+            return EXIT_FAILURE;
+        }
+        size = image.size();
+    } else {
+        image = rbf_image_t::allocate(size, false);
+        if (!image.valid()) {
+            return EXIT_FAILURE;
+        }
+        uint32_t *words = (uint32_t *)image.writable();
+        uint32_t x = 0x12345678;
+        for (size_t i = 0; i < image.word_count(); i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            words[i] = x;
+        }
+    }
+
+    if (size == 0) {
+        printf("%s: the image must not be empty.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t key[key_size];
+    for (size_t i = 0; i < key_size; i++) {
+        key[i] = i * 37 + 11;
+    }
+
+    char filename[] = "/tmp/fpga_loader-bench-XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        perror(PROGNAME);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    if (!encrypt(key, image.words(), image.word_count(), filename)) {
+        unlink(filename);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-14s %11s %13s %14s\n", "run", "size", "time", "throughput");
+
+    //
+    // Plain load
+    //
+
+    fpga_sim_t plain;
+    if (!plain.open()) {
+        unlink(filename);
+        return EXIT_FAILURE;
+    }
+    rbf_buffer_t buffer = image.chunks(rbf_decrypt_t::chunk_size / sizeof(uint32_t));
+    uint64_t start = now_ns();
+    fpga_loader_t plain_loader(plain);
+    bool plain_ok = (plain_loader.loadFPGA(buffer, false) == EXIT_SUCCESS);
+    bench_report("plain", size, now_ns() - start, plain_ok);
+
+    //
+    // Decrypt only.  The container is mapped by open(), so that is timed
+    // too.
+    //
+
+    start = now_ns();
+    rbf_decrypt_t decrypt;
+    bool decrypt_ok = decrypt.open(filename, key);
+    hash64_t hash;
+    const uint32_t *chunk;
+    for (size_t len; decrypt_ok && ((len = decrypt.next(&chunk)) != 0); ) {
+        hash.update(chunk, len * sizeof(uint32_t));
+    }
+    decrypt_ok = decrypt_ok && decrypt.good() && (hash.digest() == plain.data_hash());
+    bench_report("decrypt only", size, now_ns() - start, decrypt_ok);
+
+    //
+    // Pipelined
+    //
+
+    fpga_sim_t pipelined;
+    if (!pipelined.open()) {
+        unlink(filename);
+        return EXIT_FAILURE;
+    }
+    start = now_ns();
+    rbf_decrypt_t source;
+    bool pipelined_ok = source.open(filename, key);
+    fpga_loader_t pipelined_loader(pipelined);
+    pipelined_ok = pipelined_ok && (pipelined_loader.loadFPGA(source, false) == EXIT_SUCCESS) &&
+        (pipelined.data_hash() == plain.data_hash());
+    bench_report("pipelined", size, now_ns() - start, pipelined_ok);
+
+    unlink(filename);
+    return (plain_ok && decrypt_ok && pipelined_ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
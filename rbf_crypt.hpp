@@ -0,0 +1,134 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Encrypted RBF container header file
+//!
+//! \details
+//!    An encrypted RBF container holds an RBF image sealed with the
+//!    ChaCha20-Poly1305 AEAD construction (RFC 8439).  The container is
+//!    decrypted chunk by chunk while the FPGA is being programmed so that the
+//!    cleartext image never exists in memory as a whole.
+//!
+//! \file
+//!    rbf_crypt.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_CRYPT_H
+#define __RBF_CRYPT_H
+
+#include <stdint.h>
+#include <thread>
+
+#include "fpga_loader.hpp"
+#include "rbf_image.hpp"
+#include "rbf_pool.hpp"
+
+//!
+//! \brief
+//!    Encrypted RBF container header
+//!
+//! \details
+//!    The header is followed by the ciphertext and then by the 16 byte
+//!    Poly1305 tag.  The header is authenticated as associated data.  All
+//!    fields are little-endian.
+//!
+
+struct rbf_crypt_header_t {
+    char     magic[8];                          //!< (0x000) "KS10RBFE"
+    uint32_t version;                           //!< (0x008) Container version
+    uint32_t size;                              //!< (0x00c) Size of the RBF image in bytes
+    uint8_t  nonce[12];                         //!< (0x010) ChaCha20 nonce
+    uint32_t reserved;                          //!< (0x01c) Must be zero
+};
+
+//!
+//! \brief
+//!    Encrypted RBF container support
+//!
+
+class rbf_crypt_t {
+
+    public:
+
+        static const char     magic[8];         //!< Container magic number
+        static const uint32_t version = 1;      //!< Container version
+        static const size_t   tag_size = 16;    //!< Poly1305 tag size
+        static const size_t   key_size = 32;    //!< ChaCha20 key size
+
+        static bool is_encrypted(const char *filename);
+        static bool read_keyfile(const char *filename, uint8_t key[key_size]);
+        static bool encrypt(const uint8_t key[key_size], const uint32_t *rbf_data, size_t rbf_size, const char *filename);
+        static int bench(int argc, char *argv[]);
+
+};
+
+//!
+//! \brief
+//!    Configuration data source that decrypts an encrypted RBF container.
+//!
+//! \details
+//!    A worker thread, pinned to the second core when there is one, decrypts
+//!    the container into chunks from a small pool and passes them to the
+//!    loader through a ring while the loader writes the previous chunks to
+//!    the FPGA.  The Poly1305 tag is checked after the last chunk; good()
+//!    reports the result.
+//!
+
+class rbf_decrypt_t : public rbf_source_t {
+
+    public:
+
+        static const size_t chunk_size = 64 * 1024;     //!< Chunk size in bytes
+        static const size_t chunks     = 4;             //!< Number of chunk buffers
+
+    private:
+
+        uint8_t key[rbf_crypt_t::key_size];     //!< ChaCha20 key
+        rbf_image_t image;                      //!< The container
+        const rbf_crypt_header_t *header;       //!< Container header
+        rbf_pool_t pool;                        //!< Decrypted chunk buffers
+        rbf_ring_t ring;                        //!< Decrypted chunks in order
+        rbf_chunk_t *held;                      //!< Chunk the loader is writing
+        bool verified;                          //!< Poly1305 tag matched
+        std::thread worker;                     //!< Decryption thread
+
+        void decrypt(void);
+
+    public:
+
+        rbf_decrypt_t(void);
+        ~rbf_decrypt_t(void);
+        bool open(const char *filename, const uint8_t key[rbf_crypt_t::key_size]);
+        size_t size(void) const;
+        size_t next(const uint32_t **chunk);
+        bool good(void);
+
+};
+
+#endif
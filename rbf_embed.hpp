@@ -0,0 +1,77 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Embedded RBF image header file
+//!
+//! \details
+//!    When the loader is built with "make RBF=file.rbf" the rbf file is
+//!    linked into the executable and is programmed when no file is given
+//!    on the command line.
+//!
+//! \file
+//!    rbf_embed.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_EMBED_H
+#define __RBF_EMBED_H
+
+#ifdef RBF_EMBED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rbf_format.hpp"
+
+//
+// rbf_embed.h is generated by the Makefile.  It provides the name, size and
+// first bytes of the embedded file.
+//
+
+#include "rbf_embed.h"
+
+//!
+//! \brief
+//!    Embedded image data.  See rbf_embed.S.
+//!
+
+extern "C" const uint8_t rbf_embed_data[];
+
+//
+// Check the embedded image when the loader is built so that it does not need
+// to be checked when it is loaded.
+//
+
+static_assert(rbf_format_t::valid_size(rbf_embed_size),
+              "embedded rbf file length is not exact multiple of 32-bit words");
+static_assert(rbf_format_t::has_preamble(rbf_embed_head, sizeof(rbf_embed_head)),
+              "embedded rbf file does not begin with the rbf preamble");
+
+#endif
+
+#endif
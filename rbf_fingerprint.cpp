@@ -0,0 +1,361 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    RBF fingerprint
+//!
+//! \file
+//!    rbf_fingerprint.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "rbf_fingerprint.hpp"
+
+const char rbf_fingerprint_t::magic[8] = {'K', 'S', '1', '0', 'R', 'B', 'F', 'P'};
+
+//!
+//! \brief
+//!    Constructor.  The fingerprint is empty until sample() is called.
+//!
+
+rbf_fingerprint_t::rbf_fingerprint_t(void) :
+    filename(NULL),
+    size(0),
+    sample_hash(0),
+    pages_read(0) {
+}
+
+//!
+//! \brief
+//!    Compute the sampled digest of a file.
+//!
+//! \details
+//!    The first page and pages at 1/16, 2/16, ... 16/16 of the way through
+//!    the file are hashed with their offsets and the file size.  Small
+//!    files have fewer distinct pages, and a file of 17 pages or fewer is
+//!    hashed completely.
+//!
+//! \param[in] filename
+//!    Name of the file.  It must be a regular file.
+//!
+//! \returns
+//!    True if the file was sampled.
+//!
+
+bool rbf_fingerprint_t::sample(const char *filename) {
+
+    this->filename = filename;
+    pages_read = 0;
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) || (st.st_size == 0)) {
+        fprintf(stderr, "%s: %s: not a regular file with data\n", PROGNAME, filename);
+        close(fd);
+        return false;
+    }
+
+    //
+    // Only the sampled pages should be read from storage
+    //
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    size = st.st_size;
+    hash64_t hash;
+    hash.update(&size, sizeof(size));
+
+    uint8_t buf[page_size];
+    uint64_t last_page = (size - 1) / page_size;
+    uint64_t prev_page = ~0ULL;
+    for (unsigned int i = 0; i <= samples; i++) {
+        uint64_t page = last_page * i / samples;
+        if (page == prev_page) {
+            continue;
+        }
+        prev_page = page;
+
+        uint64_t offset = page * page_size;
+        size_t len = (size - offset < page_size) ? size - offset : page_size;
+        ssize_t ret = pread(fd, buf, len, offset);
+        if (ret != (ssize_t)len) {
+            fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, (ret < 0) ? strerror(errno) : "short read");
+            close(fd);
+            return false;
+        }
+        hash.update(&offset, sizeof(offset));
+        hash.update(buf, len);
+        pages_read++;
+    }
+
+    close(fd);
+    sample_hash = hash.digest();
+    return true;
+}
+
+//!
+//! \brief
+//!    Compute the full digest of a file.
+//!
+
+bool rbf_fingerprint_t::digest(const char *filename, uint64_t &hash) {
+
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t buf_size = 1024 * 1024;
+    uint8_t *buf = (uint8_t *)malloc(buf_size);
+    if (buf == NULL) {
+        close(fd);
+        return false;
+    }
+
+    hash64_t full;
+    bool ok = true;
+    for (;;) {
+        ssize_t len = read(fd, buf, buf_size);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        if (len == 0) {
+            break;
+        }
+        full.update(buf, len);
+    }
+
+    free(buf);
+    close(fd);
+    hash = full.digest();
+    return ok;
+}
+
+//!
+//! \brief
+//!    Read the record of the loaded image.
+//!
+
+bool rbf_fingerprint_t::read_record(const char *statefile, rbf_fingerprint_record_t &record) {
+    int fd = open(statefile, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t len = pread(fd, &record, sizeof(record), 0);
+    close(fd);
+    return (len == sizeof(record)) && (memcmp(record.magic, magic, sizeof(magic)) == 0) &&
+        (record.version == version);
+}
+
+//!
+//! \brief
+//!    Replace the record of the loaded image.
+//!
+//! \details
+//!    The record is written to a temporary file and renamed over the state
+//!    file, so a reader never sees a partial record.
+//!
+
+bool rbf_fingerprint_t::write_record(const char *statefile, const rbf_fingerprint_record_t &record) {
+    std::string temp = std::string(statefile) + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = (write(fd, &record, sizeof(record)) == sizeof(record));
+    if ((close(fd) != 0) || !ok || (rename(temp.c_str(), statefile) != 0)) {
+        unlink(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Check whether the file is the image that was recorded as loaded.
+//!
+//! \param[in] statefile
+//!    State file.
+//!
+//! \returns
+//!    True if the size and the sampled digest match the record.
+//!
+
+bool rbf_fingerprint_t::matches(const char *statefile) const {
+    rbf_fingerprint_record_t record;
+    if (!filename || !read_record(statefile, record)) {
+        return false;
+    }
+    return (record.size == size) && (record.sample == sample_hash);
+}
+
+//!
+//! \brief
+//!    Record the file as the loaded image.
+//!
+//! \details
+//!    The record is written with the sampled digest, under the device
+//!    lock.  The full digest is filled in by confirm(), which must only be
+//!    called after the lock is released: the background process inherits
+//!    the lock descriptor and would hold the lock until it finishes.
+//!
+//! \param[in] statefile
+//!    State file.
+//!
+//! \returns
+//!    True if the record was written.
+//!
+
+bool rbf_fingerprint_t::record(const char *statefile) const {
+    rbf_fingerprint_record_t record;
+    memset(&record, 0, sizeof(record));
+    memcpy(record.magic, magic, sizeof(magic));
+    record.version = version;
+    record.size    = size;
+    record.sample  = sample_hash;
+    if (!write_record(statefile, record)) {
+        fprintf(stderr, "%s: %s: unable to record the loaded image: %s\n", PROGNAME, statefile, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Compute the full digest of the file in the background.
+//!
+//! \details
+//!    A detached process hashes the file at low priority.  If the record
+//!    has no full digest yet, it is filled in.  If the record has a
+//!    different full digest, the file is not the loaded image after all:
+//!    the record is removed and a warning is logged to syslog.  The record
+//!    is left alone if it was replaced while the file was being hashed.
+//!
+//!    The process is double forked so it is never left as a zombie, and its
+//!    standard streams are redirected to /dev/null so it does not hold a
+//!    pipe open for whoever ran the loader.
+//!
+//! \param[in] statefile
+//!    State file.
+//!
+
+void rbf_fingerprint_t::confirm(const char *statefile) const {
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return;
+    }
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    if (fork() != 0) {
+        _exit(0);
+    }
+
+    int null = open("/dev/null", O_RDWR);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (null > STDERR_FILENO) {
+            close(null);
+        }
+    }
+    setpriority(PRIO_PROCESS, 0, 10);
+
+    uint64_t full;
+    if (!digest(filename, full)) {
+        _exit(1);
+    }
+
+    rbf_fingerprint_record_t record;
+    if (!read_record(statefile, record) || (record.size != size) || (record.sample != sample_hash)) {
+        _exit(0);
+    }
+
+    if (record.full == 0) {
+        record.full = full;
+        write_record(statefile, record);
+    } else if (record.full != full) {
+        forget(statefile);
+        openlog(PROGNAME, LOG_PID, LOG_USER);
+        syslog(LOG_WARNING, "%s matched the sampled digest of the loaded image but not its full digest; "
+               "the next load will program the FPGA", filename);
+        closelog();
+    }
+    _exit(0);
+}
+
+//!
+//! \brief
+//!    Remove the record of the loaded image.
+//!
+//! \details
+//!    This is called before the FPGA is programmed, so an interrupted or
+//!    failed load never leaves a record behind.
+//!
+//! \param[in] statefile
+//!    State file.
+//!
+
+void rbf_fingerprint_t::forget(const char *statefile) {
+    unlink(statefile);
+}
@@ -0,0 +1,127 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    RBF fingerprint header file
+//!
+//! \details
+//!    Decide from a few pages of an rbf file whether it is the image that is
+//!    already loaded, and confirm the decision later with a full digest.
+//!
+//! \file
+//!    rbf_fingerprint.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_FINGERPRINT_H
+#define __RBF_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATEFILE "/run/fpga_loader.state"
+
+//!
+//! \brief
+//!    Record of the loaded image in the state file
+//!
+//! \details
+//!    The full digest is zero until it has been computed in the
+//!    background.
+//!
+
+struct rbf_fingerprint_record_t {
+    char     magic[8];                          //!< (0x000) "KS10RBFP"
+    uint32_t version;                           //!< (0x008) Record version
+    uint32_t reserved;                          //!< (0x00c) Must be zero
+    uint64_t size;                              //!< (0x010) Size of the file in bytes
+    uint64_t sample;                            //!< (0x018) Sampled digest
+    uint64_t full;                              //!< (0x020) hash64_t of the file, or zero
+};
+
+//!
+//! \brief
+//!    Two-tier fingerprint of an rbf file
+//!
+//! \details
+//!    The sampled digest covers the file size, the first page, and pages at
+//!    fixed fractions of the file.  The file is read with pread() and
+//!    readahead disabled, so deciding whether an image is already loaded
+//!    reads a few pages, not the whole file.  A different image changes the
+//!    size or the header, or almost always one of the sampled pages.
+//!
+//!    The sampled digest alone can miss a change between the sampled pages,
+//!    so the full digest of the file is computed by a detached background
+//!    process.  If it does not match the full digest recorded for the
+//!    loaded image, the record is removed so the next load reprograms the
+//!    FPGA.
+//!
+//!    The state file lives in /run, so it does not survive a power cycle.
+//!    Any load of the FPGA removes it first.
+//!
+
+class rbf_fingerprint_t {
+
+    public:
+
+        static const char     magic[8];         //!< Record magic number
+        static const uint32_t version = 1;      //!< Record version
+        static const size_t   page_size = 4096; //!< Size of a sampled page
+        static const unsigned int samples = 16; //!< Pages sampled after the first
+
+    private:
+
+        const char *filename;                   //!< Name of the file
+        uint64_t size;                          //!< Size of the file in bytes
+        uint64_t sample_hash;                   //!< Sampled digest
+        size_t pages_read;                      //!< Pages read for the sampled digest
+
+        static bool read_record(const char *statefile, rbf_fingerprint_record_t &record);
+        static bool write_record(const char *statefile, const rbf_fingerprint_record_t &record);
+        static bool digest(const char *filename, uint64_t &hash);
+
+    public:
+
+        rbf_fingerprint_t(void);
+        bool sample(const char *filename);
+        bool matches(const char *statefile) const;
+        bool record(const char *statefile) const;
+        void confirm(const char *statefile) const;
+        static void forget(const char *statefile);
+
+        //!
+        //! \brief
+        //!    Number of pages read for the sampled digest.
+        //!
+
+        size_t pages(void) const {
+            return pages_read;
+        }
+
+};
+
+#endif
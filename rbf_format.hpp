@@ -0,0 +1,98 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    RBF file format header file
+//!
+//! \details
+//!    Checks on the raw binary file format that are shared by the run time
+//!    file checks and the build time checks on an embedded image.
+//!
+//! \file
+//!    rbf_format.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_FORMAT_H
+#define __RBF_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//!
+//! \brief
+//!    RBF file format
+//!
+//! \details
+//!    A Cyclone V rbf file is a stream of 32-bit
+//!    words that begins with a preamble of all-ones padding.  These checks
+//!    are constexpr so that they can be evaluated by static_assert.
+//!
+
+class rbf_format_t {
+
+    public:
+
+        static const size_t preamble_size = 4;  //!< Bytes of 0xff that start the file
+
+        //!
+        //! \brief
+        //!    Check that the image is a whole number of 32-bit words.
+        //!
+        //! \param[in] size
+        //!    Size of the image in bytes.
+        //!
+
+        static constexpr bool valid_size(size_t size) {
+            return (size != 0) && ((size & 0x03) == 0);
+        }
+
+        //!
+        //! \brief
+        //!    Check that the image begins with the preamble.
+        //!
+        //! \param[in] data
+        //!    Start of the image.
+        //!
+        //! \param[in] size
+        //!    Bytes available at data.
+        //!
+
+        static constexpr bool has_preamble(const uint8_t *data, size_t size) {
+            return has_preamble(data, size, 0);
+        }
+
+    private:
+
+        static constexpr bool has_preamble(const uint8_t *data, size_t size, size_t i) {
+            return (i == preamble_size) ||
+                ((i < size) && (data[i] == 0xff) && has_preamble(data, size, i + 1));
+        }
+
+};
+
+#endif
@@ -0,0 +1,377 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    RBF image
+//!
+//! \file
+//!    rbf_image.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rbf_image.hpp"
+#include "rbf_probe.hpp"
+
+//!
+//! \brief
+//!    Constructor.  This creates an empty image.
+//!
+
+rbf_image_t::rbf_image_t(void) :
+    data(NULL),
+    length(0),
+    capacity(0),
+    fd(-1),
+    backing(none) {
+}
+
+//!
+//! \brief
+//!    Destructor.  This releases the backing.
+//!
+
+rbf_image_t::~rbf_image_t(void) {
+    release();
+}
+
+//!
+//! \brief
+//!    Move constructor.  The backing is transferred and the source image is
+//!    left empty.
+//!
+
+rbf_image_t::rbf_image_t(rbf_image_t &&image) :
+    data(image.data),
+    length(image.length),
+    capacity(image.capacity),
+    fd(image.fd),
+    backing(image.backing) {
+    image.data     = NULL;
+    image.length   = 0;
+    image.capacity = 0;
+    image.fd       = -1;
+    image.backing  = none;
+}
+
+//!
+//! \brief
+//!    Move assignment.  The current backing is released first.
+//!
+
+rbf_image_t &rbf_image_t::operator=(rbf_image_t &&image) {
+    if (this != &image) {
+        release();
+        data     = image.data;
+        length   = image.length;
+        capacity = image.capacity;
+        fd       = image.fd;
+        backing  = image.backing;
+        image.data     = NULL;
+        image.length   = 0;
+        image.capacity = 0;
+        image.fd       = -1;
+        image.backing  = none;
+    }
+    return *this;
+}
+
+//!
+//! \brief
+//!    Release the backing.
+//!
+
+void rbf_image_t::release(void) {
+    if ((backing != none) && (backing != borrowed) && capacity) {
+        munmap(data, capacity);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    data     = NULL;
+    length   = 0;
+    capacity = 0;
+    fd       = -1;
+    backing  = none;
+}
+
+//!
+//! \brief
+//!    Open an image file.
+//!
+//! \details
+//!    Regular files are mapped directly.  Anything else (a pipe, or "-" for
+//!    stdin) is read into memory first.
+//!
+//! \param[in] filename
+//!    Name of the image file, or "-" for stdin.
+//!
+//! \returns
+//!    The image, or an empty image on failure.
+//!
+
+rbf_image_t rbf_image_t::open(const char *filename) {
+    RBF_PROBE1(ingest_start, filename);
+    rbf_image_t image = ingest(filename);
+    RBF_PROBE3(ingest_done, filename, image.data, image.length);
+    return image;
+}
+
+//!
+//! \brief
+//!    Map or read an image file.  This is the body of open().
+//!
+
+rbf_image_t rbf_image_t::ingest(const char *filename) {
+
+    if (strcmp(filename, "-") == 0) {
+        return read(STDIN_FILENO);
+    }
+
+    int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        return rbf_image_t();
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        close(fd);
+        return rbf_image_t();
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        rbf_image_t image = read(fd);
+        close(fd);
+        return image;
+    }
+
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: %s: file is empty\n", PROGNAME, filename);
+        close(fd);
+        return rbf_image_t();
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, filename, strerror(errno));
+        return rbf_image_t();
+    }
+
+    rbf_image_t image;
+    image.data     = (uint8_t *)addr;
+    image.length   = st.st_size;
+    image.capacity = st.st_size;
+    image.backing  = mapped;
+    return image;
+}
+
+//!
+//! \brief
+//!    Read an image from a pipe or other stream.
+//!
+//! \details
+//!    The data is read directly into a mapping of a memfd which is grown as
+//!    the data arrives, so the image is not copied again after it leaves the
+//!    kernel.  If memfd is not available, anonymous memory is used instead.
+//!
+//! \param[in] fd
+//!    File descriptor to read until end of file.  It is not closed.
+//!
+//! \returns
+//!    The image, or an empty image on failure.
+//!
+
+rbf_image_t rbf_image_t::read(int fd) {
+
+    rbf_image_t image;
+
+#ifdef MFD_CLOEXEC
+    image.fd = memfd_create("rbf_image", MFD_CLOEXEC);
+#endif
+
+    size_t capacity = 8 * 1024 * 1024;
+    if ((image.fd >= 0) && (ftruncate(image.fd, capacity) != 0)) {
+        fprintf(stderr, "%s: %s\n", PROGNAME, strerror(errno));
+        return rbf_image_t();
+    }
+
+    void *addr = (image.fd >= 0) ?
+        mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, image.fd, 0) :
+        mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", PROGNAME, strerror(errno));
+        return rbf_image_t();
+    }
+
+    image.data     = (uint8_t *)addr;
+    image.capacity = capacity;
+    image.backing  = (image.fd >= 0) ? memfd : anonymous;
+
+    for (;;) {
+
+        //
+        // Grow the mapping when it is full
+        //
+
+        if (image.length == image.capacity) {
+            capacity = 2 * image.capacity;
+            if ((image.fd >= 0) && (ftruncate(image.fd, capacity) != 0)) {
+                fprintf(stderr, "%s: %s\n", PROGNAME, strerror(errno));
+                return rbf_image_t();
+            }
+            addr = mremap(image.data, image.capacity, capacity, MREMAP_MAYMOVE);
+            if (addr == MAP_FAILED) {
+                fprintf(stderr, "%s: %s\n", PROGNAME, strerror(errno));
+                return rbf_image_t();
+            }
+            image.data     = (uint8_t *)addr;
+            image.capacity = capacity;
+        }
+
+        ssize_t len = ::read(fd, image.data + image.length, image.capacity - image.length);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: %s\n", PROGNAME, strerror(errno));
+            return rbf_image_t();
+        }
+        if (len == 0) {
+            break;
+        }
+        image.length += len;
+    }
+
+    if (image.length == 0) {
+        fprintf(stderr, "%s: input is empty\n", PROGNAME);
+        return rbf_image_t();
+    }
+
+    return image;
+}
+
+//!
+//! \brief
+//!    Allocate a writable image.
+//!
+//! \param[in] size
+//!    Size of the image in bytes.
+//!
+//! \param[in] huge
+//!    Try to back the image with huge pages to reduce TLB misses while it
+//!    is streamed.  Normal pages are used if huge pages are not available.
+//!
+//! \returns
+//!    The image, or an empty image on failure.
+//!
+
+rbf_image_t rbf_image_t::allocate(size_t size, bool huge) {
+
+    rbf_image_t image;
+    void *addr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (huge) {
+        const size_t hugepage_size = 2 * 1024 * 1024;
+        size_t capacity = (size + hugepage_size - 1) & ~(hugepage_size - 1);
+        addr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            image.capacity = capacity;
+            image.backing  = hugepage;
+        }
+    }
+#endif
+
+    if (addr == MAP_FAILED) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "%s: unable to allocate %zu bytes: %s\n", PROGNAME, size, strerror(errno));
+            return rbf_image_t();
+        }
+        image.capacity = size;
+        image.backing  = anonymous;
+    }
+
+    image.data   = (uint8_t *)addr;
+    image.length = size;
+    return image;
+}
+
+//!
+//! \brief
+//!    Wrap memory that is owned by someone else.
+//!
+//! \details
+//!    The memory must stay valid for the life of the image and is never
+//!    released by it.
+//!
+//! \param[in] data
+//!    Image data.  This must be 4-byte aligned.
+//!
+//! \param[in] size
+//!    Size of the image in bytes.
+//!
+//! \returns
+//!    The image, or an empty image if the data is not aligned.
+//!
+
+rbf_image_t rbf_image_t::borrow(const void *data, size_t size) {
+    rbf_image_t image;
+    if (((uintptr_t)data & 0x03) != 0) {
+        fprintf(stderr, "%s: rbf data buffer is not aligned properly.\n", PROGNAME);
+        return image;
+    }
+    image.data    = (uint8_t *)data;
+    image.length  = size;
+    image.backing = borrowed;
+    return image;
+}
+
+//!
+//! \brief
+//!    Shrink the image.
+//!
+//! \param[in] size
+//!    New size of the image in bytes.  The backing is not released.
+//!
+
+void rbf_image_t::truncate(size_t size) {
+    if (size < length) {
+        length = size;
+    }
+}
@@ -0,0 +1,181 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    RBF image header file
+//!
+//! \details
+//!    This object owns the memory that holds an RBF image, whatever backs
+//!    it, and hands the image to the loader without copying it.
+//!
+//! \file
+//!    rbf_image.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_IMAGE_H
+#define __RBF_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fpga_loader.hpp"
+
+//!
+//! \brief
+//!    RBF image object
+//!
+//! \details
+//!    An image is move-only.  The backing is released when the image that
+//!    owns it is destroyed, so there is exactly one owner and the release
+//!    point is deterministic.  The image data is always 4-byte aligned;
+//!    mapped and allocated images are page aligned.
+//!
+
+class rbf_image_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Memory that backs the image
+        //!
+
+        enum backing_t {
+            none,                               //!< Empty image
+            mapped,                             //!< mmap() of a file
+            memfd,                              //!< mmap() of a memfd filled from a pipe
+            anonymous,                          //!< Anonymous memory
+            hugepage,                           //!< Anonymous memory in huge pages
+            borrowed,                           //!< Memory owned by someone else
+        };
+
+    private:
+
+        uint8_t  *data;                         //!< Image data
+        size_t    length;                       //!< Image size in bytes
+        size_t    capacity;                     //!< Size of the mapping
+        int       fd;                           //!< Backing file descriptor or -1
+        backing_t backing;                      //!< Kind of backing
+
+        void release(void);
+        static rbf_image_t ingest(const char *filename);
+
+    public:
+
+        rbf_image_t(void);
+        ~rbf_image_t(void);
+        rbf_image_t(rbf_image_t &&image);
+        rbf_image_t &operator=(rbf_image_t &&image);
+        rbf_image_t(const rbf_image_t &) = delete;
+        rbf_image_t &operator=(const rbf_image_t &) = delete;
+
+        static rbf_image_t open(const char *filename);
+        static rbf_image_t read(int fd);
+        static rbf_image_t allocate(size_t size, bool huge);
+        static rbf_image_t borrow(const void *data, size_t size);
+
+        void truncate(size_t size);
+
+        //!
+        //! \brief
+        //!    Check whether the image holds data.
+        //!
+
+        bool valid(void) const {
+            return backing != none;
+        }
+
+        //!
+        //! \brief
+        //!    Kind of memory that backs the image.
+        //!
+
+        backing_t kind(void) const {
+            return backing;
+        }
+
+        //!
+        //! \brief
+        //!    Image data as bytes.
+        //!
+
+        const uint8_t *bytes(void) const {
+            return data;
+        }
+
+        //!
+        //! \brief
+        //!    Image data as 32-bit words.
+        //!
+
+        const uint32_t *words(void) const {
+            return (const uint32_t *)data;
+        }
+
+        //!
+        //! \brief
+        //!    Writable image data.  Only allocated images are writable.
+        //!
+
+        uint8_t *writable(void) {
+            return ((backing == anonymous) || (backing == hugepage)) ? data : NULL;
+        }
+
+        //!
+        //! \brief
+        //!    Size of the image in bytes.
+        //!
+
+        size_t size(void) const {
+            return length;
+        }
+
+        //!
+        //! \brief
+        //!    Size of the image in whole 32-bit words.
+        //!
+
+        size_t word_count(void) const {
+            return length / sizeof(uint32_t);
+        }
+
+        //!
+        //! \brief
+        //!    Iterate over the image in chunks.
+        //!
+        //! \param[in] chunk
+        //!    Chunk size in 32-bit words.  Zero yields the image in one chunk.
+        //!
+
+        rbf_buffer_t chunks(size_t chunk = 0) const {
+            return rbf_buffer_t(words(), word_count(), chunk);
+        }
+
+};
+
+#endif
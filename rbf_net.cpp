@@ -0,0 +1,687 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Network load
+//!
+//! \file
+//!    rbf_net.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include "device_lock.hpp"
+#include "fpga_io.hpp"
+#include "fpga_sim.hpp"
+#include "fpga_status.hpp"
+#include "rbf_fingerprint.hpp"
+#include "rbf_format.hpp"
+#include "rbf_image.hpp"
+#include "rbf_net.hpp"
+#include "rbf_push.hpp"
+
+const char rbf_net_t::magic[8] = {'K', 'S', '1', '0', 'R', 'B', 'F', 'N'};
+
+//
+// A stalled client must not hold the FPGA in configuration mode forever
+//
+
+static const int recv_timeout = 10;
+
+//!
+//! \brief
+//!    Receive exactly len bytes.
+//!
+//! \returns
+//!    True if all of the bytes were received.
+//!
+
+static bool recv_all(int fd, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+    while (len) {
+        ssize_t ret = recv(fd, p, len, MSG_WAITALL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (ret == 0) {
+            return false;
+        }
+        p   += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Send exactly len bytes.
+//!
+//! \returns
+//!    True if all of the bytes were sent.
+//!
+
+static bool send_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len) {
+        ssize_t ret = send(fd, p, len, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p   += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Send the reply line to the client.
+//!
+
+static void reply(int fd, const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buf) - 1) {
+        len = sizeof(buf) - 1;
+    }
+    send_all(fd, buf, len);
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] fd
+//!    Connected socket.  The header has already been received.
+//!
+//! \param[in] header
+//!    Network load header.
+//!
+
+rbf_socket_t::rbf_socket_t(int fd, const rbf_net_header_t &header) :
+    fd(fd),
+    remaining(header.size),
+    expected(header.hash),
+    failed(false),
+    to_loader(chunks),
+    to_hash(chunks),
+    held(NULL) {
+    if (!pool.create(chunks, chunk_size)) {
+        failed = true;
+        to_loader.close();
+        return;
+    }
+    receiver = std::thread(&rbf_socket_t::receive, this);
+    hasher   = std::thread(&rbf_socket_t::digest, this);
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+//! \details
+//!    If the load stopped early, the receive thread is woken and stops.
+//!
+
+rbf_socket_t::~rbf_socket_t(void) {
+    pool.close();
+    shutdown(fd, SHUT_RD);
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+    if (hasher.joinable()) {
+        hasher.join();
+    }
+}
+
+//!
+//! \brief
+//!    Receive thread.
+//!
+
+void rbf_socket_t::receive(void) {
+    while (remaining) {
+        rbf_chunk_t *chunk = pool.get(2);
+        if (!chunk) {
+            failed = true;
+            break;
+        }
+        size_t len = (remaining < chunk_size) ? remaining : chunk_size;
+        if (!recv_all(fd, chunk->data, len)) {
+            fprintf(stderr, "%s: connection lost with %zu bytes to go.\n", PROGNAME, remaining);
+            failed = true;
+            pool.put(chunk);
+            pool.put(chunk);
+            break;
+        }
+        remaining   -= len;
+        chunk->words = len / sizeof(uint32_t);
+        to_hash.push(chunk);
+        to_loader.push(chunk);
+    }
+    to_hash.close();
+    to_loader.close();
+}
+
+//!
+//! \brief
+//!    Hashing thread.
+//!
+
+void rbf_socket_t::digest(void) {
+    for (rbf_chunk_t *chunk; (chunk = to_hash.pop()) != NULL;) {
+        hash.update(chunk->data, chunk->words * sizeof(uint32_t));
+        pool.put(chunk);
+    }
+}
+
+//!
+//! \brief
+//!    Get the next chunk of the image.
+//!
+//! \details
+//!    The chunk that was returned by the previous call is released.
+//!
+
+size_t rbf_socket_t::next(const uint32_t **chunk) {
+    if (held) {
+        pool.put(held);
+    }
+    held = to_loader.pop();
+    if (!held) {
+        return 0;
+    }
+    *chunk = held->data;
+    return held->words;
+}
+
+//!
+//! \brief
+//!    Check that the whole image arrived intact.
+//!
+//! \details
+//!    This waits for the receive and hashing threads to finish.
+//!
+
+bool rbf_socket_t::good(void) {
+    if (receiver.joinable()) {
+        receiver.join();
+    }
+    if (hasher.joinable()) {
+        hasher.join();
+    }
+    return !failed && (remaining == 0) && (hash.digest() == expected);
+}
+
+//!
+//! \brief
+//!    Open the listening socket.
+//!
+//! \returns
+//!    Socket or -1 on failure.
+//!
+
+static int listen_on(const char *addr, const char *port) {
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    struct addrinfo *res;
+    int err = getaddrinfo(addr, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", PROGNAME, gai_strerror(err));
+        return -1;
+    }
+
+    //
+    // Try IPv6 first.  An IPv6 socket also accepts IPv4 connections.
+    //
+
+    int fd = -1;
+    for (int pass = 0; (pass < 2) && (fd < 0); pass++) {
+        for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+            if ((ai->ai_family == AF_INET6) != (pass == 0)) {
+                continue;
+            }
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if ((bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) && (listen(fd, 4) == 0)) {
+                break;
+            }
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) {
+        fprintf(stderr, "%s: unable to listen on port %s: %s\n", PROGNAME, port, strerror(errno));
+    }
+
+    freeaddrinfo(res);
+    return fd;
+}
+
+//!
+//! \brief
+//!    Receive and program one image.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+static int receive(int fd, fpga_io_t &fpga_io, bool simulate, const char *lockfile,
+                   unsigned int lock_timeout, const char *statefile, const char *statusfile,
+                   bool debug, bool quiet) {
+
+    struct timeval tv;
+    tv.tv_sec  = recv_timeout;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    //
+    // Check the header
+    //
+
+    rbf_net_header_t header;
+    if (!recv_all(fd, &header, sizeof(header))) {
+        fprintf(stderr, "%s: connection lost while reading header.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    if ((memcmp(header.magic, rbf_net_t::magic, sizeof(header.magic)) != 0) ||
+        (header.version != rbf_net_t::version)) {
+        fprintf(stderr, "%s: bad header from client.\n", PROGNAME);
+        reply(fd, "error: bad header\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!rbf_format_t::valid_size(header.size) || (header.size > rbf_net_t::max_size)) {
+        fprintf(stderr, "%s: bad image size (%u bytes) from client.\n", PROGNAME, header.size);
+        reply(fd, "error: bad image size\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!quiet) {
+        printf("%s: receiving %u bytes.\n", PROGNAME, header.size);
+    }
+
+    //
+    // Program the FPGA as the image arrives
+    //
+
+    device_lock_t device_lock;
+    if (!simulate && !device_lock.lock(lockfile, lock_timeout, quiet)) {
+        reply(fd, "error: FPGA is busy\n");
+        return EXIT_FAILURE;
+    }
+
+    fpga_status_t fpga_status;
+    if (statefile) {
+        rbf_fingerprint_t::forget(statefile);
+    }
+    if (statusfile) {
+        fpga_status.open(statusfile, true);
+    }
+    fpga_status.publish(fpga_status_t::configuring, 0);
+
+    uint64_t start = now_ns();
+    rbf_socket_t rbf_socket(fd, header);
+    fpga_loader_t fpga_loader(fpga_io);
+    int ret = fpga_loader.loadFPGA(rbf_socket, debug);
+    uint64_t program_ns = now_ns() - start;
+
+    if (ret == EXIT_SUCCESS) {
+        fpga_status.publish(fpga_status_t::user, header.hash);
+    } else {
+        fpga_status.publish(fpga_status_t::failed, 0);
+    }
+    device_lock.unlock();
+
+    if (ret != EXIT_SUCCESS) {
+        reply(fd, "error: FPGA programming failed\n");
+        return ret;
+    }
+
+    reply(fd, "ok %.3f ms\n", program_ns * 1e-6);
+    if (!quiet) {
+        printf("%s: FPGA progammed successfully in %.3f ms\n", PROGNAME, program_ns * 1e-6);
+    }
+    return EXIT_SUCCESS;
+}
+
+//!
+//! \brief
+//!    The <tt>serve</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int rbf_net_t::serve(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " serve [options]\n"
+        "\n"
+        "Receive rbf images from \"" PROGNAME " push\" and program them as they\n"
+        "arrive.  There is no authentication: anyone who can reach the port can\n"
+        "program the FPGA.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --bind=address  Address to listen on (default all).\n"
+        "  --debug         Print debug messages.\n"
+        "  --help          Print help message and exit.\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Refuse an image if the FPGA is busy for longer than this.\n"
+        "  --once          Exit after the first image.\n"
+        "  --port=port     TCP port (default " RBF_NET_PORT ").\n"
+        "  --quiet         Suppress messages.\n"
+        "  --simulate      Program a simulated FPGA instead of the hardware.\n"
+        "  --state-file=file\n"
+        "                  Record of the loaded image (default " STATEFILE ").\n"
+        "  --status-file=file\n"
+        "                  Status page that each image is published to (default\n"
+        "                  " STATUSFILE ").  See \"status\".\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"bind",     required_argument, 0, 0},  // 1
+        {"debug",    no_argument,       0, 0},  // 2
+        {"lockfile", required_argument, 0, 0},  // 3
+        {"lock-timeout", required_argument, 0, 0}, // 4
+        {"once",     no_argument,       0, 0},  // 5
+        {"port",     required_argument, 0, 0},  // 6
+        {"quiet",    no_argument,       0, 0},  // 7
+        {"simulate", no_argument,       0, 0},  // 8
+        {"state-file", required_argument, 0, 0}, // 9
+        {"status-file", required_argument, 0, 0}, // 10
+        {0,          0,                 0, 0},  // 11
+    };
+
+    int index = 0;
+    const char *addr = NULL;
+    bool debug = false;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    bool once = false;
+    const char *port = RBF_NET_PORT;
+    bool quiet = false;
+    bool simulate = false;
+    const char *statefile = NULL;
+    const char *statusfile = NULL;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    addr = optarg;
+                    break;
+                case 2:
+                    debug = true;
+                    break;
+                case 3:
+                    lockfile = optarg;
+                    break;
+                case 4:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+                case 5:
+                    once = true;
+                    break;
+                case 6:
+                    port = optarg;
+                    break;
+                case 7:
+                    quiet = true;
+                    break;
+                case 8:
+                    simulate = true;
+                    break;
+                case 9:
+                    statefile = optarg;
+                    break;
+                case 10:
+                    statusfile = optarg;
+                    break;
+            }
+        }
+    }
+
+    //
+    // A simulated FPGA publishes only to the files it is given
+    //
+
+    if (!simulate && !statefile) {
+        statefile = STATEFILE;
+    }
+    if (!simulate && !statusfile) {
+        statusfile = STATUSFILE;
+    }
+
+    fpga_io_t fpga_hw;
+    fpga_sim_t fpga_sim;
+    fpga_io_t &fpga_io = simulate ? fpga_sim : fpga_hw;
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    int listen_fd = listen_on(addr, port);
+    if (listen_fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    if (!quiet) {
+        printf("%s: listening on port %s.\n", PROGNAME, port);
+        fflush(stdout);
+    }
+
+    //
+    // Images are programmed one at a time in the order they arrive
+    //
+
+    int ret = EXIT_SUCCESS;
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: accept: %s\n", PROGNAME, strerror(errno));
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        ret = receive(fd, fpga_io, simulate, lockfile, lock_timeout, statefile, statusfile, debug, quiet);
+        if (simulate && debug) {
+            printf("%s: simulated FPGA received %zu bytes (hash %016llx)\n", PROGNAME,
+                   fpga_sim.data_size(), (unsigned long long)fpga_sim.data_hash());
+        }
+        fflush(stdout);
+        close(fd);
+
+        if (once) {
+            break;
+        }
+    }
+
+    close(listen_fd);
+    return ret;
+}
+
+//!
+//! \brief
+//!    The <tt>push</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int rbf_net_t::push(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " push [options] host [host...] \"raw_binary_file.rbf\"\n"
+        "\n"
+        "Send an rbf image to \"" PROGNAME " serve\" on each host and wait for them\n"
+        "to be programmed.  The hosts are programmed concurrently.  A host may be\n"
+        "given as host:port or [address]:port.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --help          Print help message and exit.\n"
+        "  --jobs=n        Maximum number of hosts in progress at a time\n"
+        "                  (default 32).\n"
+        "  --port=port     TCP port (default " RBF_NET_PORT ").\n"
+        "  --quiet         Only report failures.\n"
+        "  --timeout=seconds\n"
+        "                  Time allowed for each host (default 60).\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",    no_argument,       0, 0},  // 0
+        {"jobs",    required_argument, 0, 0},  // 1
+        {"port",    required_argument, 0, 0},  // 2
+        {"quiet",   no_argument,       0, 0},  // 3
+        {"timeout", required_argument, 0, 0},  // 4
+        {0,         0,                 0, 0},  // 5
+    };
+
+    int index = 0;
+    unsigned int jobs = 32;
+    const char *port = RBF_NET_PORT;
+    bool quiet = false;
+    unsigned int timeout = 60;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    jobs = strtoul(optarg, NULL, 0);
+                    break;
+                case 2:
+                    port = optarg;
+                    break;
+                case 3:
+                    quiet = true;
+                    break;
+                case 4:
+                    timeout = strtoul(optarg, NULL, 0);
+                    break;
+            }
+        }
+    }
+
+    if (argc - optind < 2) {
+        printf("%s: missing host or filename\n", PROGNAME);
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    const char *filename = argv[argc - 1];
+
+    rbf_image_t rbf_image = rbf_image_t::open(filename);
+    if (!rbf_image.valid()) {
+        return EXIT_FAILURE;
+    }
+
+    if (!rbf_format_t::valid_size(rbf_image.size())) {
+        fprintf(stderr, "%s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    if (rbf_image.size() > max_size) {
+        fprintf(stderr, "%s: \"%s\" is %zu bytes.  The largest image a board accepts is %u bytes.\n", PROGNAME,
+                filename, rbf_image.size(), max_size);
+        return EXIT_FAILURE;
+    }
+
+    rbf_push_t rbf_push(rbf_image, jobs, timeout, quiet);
+    for (int i = optind; i < argc - 1; i++) {
+        rbf_push.add(argv[i], port);
+    }
+
+    return rbf_push.run();
+}
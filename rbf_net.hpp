@@ -0,0 +1,134 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Network load header file
+//!
+//! \details
+//!    The <tt>serve</tt> command receives rbf images over TCP and programs
+//!    them as they arrive.  The <tt>push</tt> command sends one.
+//!
+//! \file
+//!    rbf_net.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_NET_H
+#define __RBF_NET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+
+#include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "rbf_pool.hpp"
+
+#define RBF_NET_PORT "4810"
+
+//!
+//! \brief
+//!    Network load header
+//!
+//! \details
+//!    The client sends the header and then the image.  The server replies
+//!    with one line of text that starts with "ok" or "error" and closes the
+//!    connection.  All fields are little-endian.
+//!
+
+struct rbf_net_header_t {
+    char     magic[8];                          //!< (0x000) "KS10RBFN"
+    uint32_t version;                           //!< (0x008) Protocol version
+    uint32_t size;                              //!< (0x00c) Size of the RBF image in bytes
+    uint64_t hash;                              //!< (0x010) hash64_t of the RBF image
+};
+
+//!
+//! \brief
+//!    Configuration data source that reads an image from a socket.
+//!
+//! \details
+//!    A receiver thread fills chunks from a small pool as the data arrives
+//!    and hands each chunk to two readers: the loader, which writes it to
+//!    the FPGA, and a hashing thread.  Neither the receive nor the hash
+//!    holds up the data port writes, and the pool bounds the data that is
+//!    buffered ahead of the loader.  good() reports whether the whole image
+//!    arrived and matched the hash in the header.
+//!
+
+class rbf_socket_t : public rbf_source_t {
+
+    public:
+
+        static const size_t chunk_size = 64 * 1024;     //!< Chunk size in bytes
+        static const size_t chunks     = 4;             //!< Number of chunk buffers
+
+    private:
+
+        int fd;                                 //!< Connected socket
+        size_t remaining;                       //!< Bytes still to be received
+        uint64_t expected;                      //!< Hash from the header
+        hash64_t hash;                          //!< Hash of the bytes received
+        bool failed;                            //!< Receive error or early EOF
+        rbf_pool_t pool;                        //!< Received chunk buffers
+        rbf_ring_t to_loader;                   //!< Chunks for the loader
+        rbf_ring_t to_hash;                     //!< Chunks for the hashing thread
+        rbf_chunk_t *held;                      //!< Chunk the loader is writing
+        std::thread receiver;                   //!< Receive thread
+        std::thread hasher;                     //!< Hashing thread
+
+        void receive(void);
+        void digest(void);
+
+    public:
+
+        rbf_socket_t(int fd, const rbf_net_header_t &header);
+        ~rbf_socket_t(void);
+        size_t next(const uint32_t **chunk);
+        bool good(void);
+
+};
+
+//!
+//! \brief
+//!    Network load commands
+//!
+
+class rbf_net_t {
+
+    public:
+
+        static const char     magic[8];         //!< Header magic number
+        static const uint32_t version = 1;      //!< Protocol version
+        static const uint32_t max_size = 64 * 1024 * 1024;  //!< Largest image accepted
+
+        static int serve(int argc, char *argv[]);
+        static int push(int argc, char *argv[]);
+
+};
+
+#endif
@@ -0,0 +1,474 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Chunk pool
+//!
+//! \file
+//!    rbf_pool.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <thread>
+
+#include "fpga_loader.hpp"
+#include "rbf_pool.hpp"
+
+//!
+//! \brief
+//!    Constructor.  This creates an empty pool.
+//!
+
+rbf_pool_t::rbf_pool_t(void) :
+    slab(NULL),
+    slab_size(0),
+    chunk_bytes(0),
+    chunks(NULL),
+    count(0),
+    closed(false),
+    peak(0),
+    waits(0) {
+}
+
+//!
+//! \brief
+//!    Destructor.  Every chunk must have been returned.
+//!
+
+rbf_pool_t::~rbf_pool_t(void) {
+    if (slab) {
+        munmap(slab, slab_size);
+    }
+    delete[] chunks;
+}
+
+//!
+//! \brief
+//!    Allocate the chunks.
+//!
+//! \param[in] count
+//!    Number of chunks.
+//!
+//! \param[in] chunk_size
+//!    Size of each chunk in bytes.  This is rounded up to whole pages.
+//!
+//! \returns
+//!    True if the slab was allocated.
+//!
+
+bool rbf_pool_t::create(size_t count, size_t chunk_size) {
+
+    chunk_bytes = (chunk_size + page_size - 1) & ~(page_size - 1);
+    slab_size   = count * chunk_bytes;
+
+    void *addr = mmap(NULL, slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "%s: unable to allocate %zu bytes of chunk buffers.\n", PROGNAME, slab_size);
+        slab_size = 0;
+        return false;
+    }
+    slab = (uint8_t *)addr;
+    mlock(slab, slab_size);
+
+    this->count = count;
+    chunks = new rbf_chunk_t[count];
+    free_list.reserve(count);
+    for (size_t i = count; i-- > 0;) {
+        chunks[i].data  = (uint32_t *)(slab + i * chunk_bytes);
+        chunks[i].words = 0;
+        chunks[i].refs  = 0;
+        free_list.push_back(&chunks[i]);
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Take a chunk from the pool.
+//!
+//! \param[in] readers
+//!    Number of readers the chunk will be handed to.
+//!
+//! \returns
+//!    An empty chunk, or NULL if the pool has been closed.
+//!
+
+rbf_chunk_t *rbf_pool_t::get(unsigned int readers) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (free_list.empty() && !closed) {
+        waits++;
+        cond.wait(lock, [this] { return closed || !free_list.empty(); });
+    }
+    if (closed) {
+        return NULL;
+    }
+    rbf_chunk_t *chunk = free_list.back();
+    free_list.pop_back();
+    if (count - free_list.size() > peak) {
+        peak = count - free_list.size();
+    }
+    chunk->words = 0;
+    chunk->refs.store(readers, std::memory_order_relaxed);
+    return chunk;
+}
+
+//!
+//! \brief
+//!    Drop one reference to a chunk.  The last reader returns it to the
+//!    pool.
+//!
+
+void rbf_pool_t::put(rbf_chunk_t *chunk) {
+    if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_list.push_back(chunk);
+        }
+        cond.notify_one();
+    }
+}
+
+//!
+//! \brief
+//!    Close the pool.  A stage that is waiting in get(), or that calls it
+//!    later, gets NULL and should stop.
+//!
+
+void rbf_pool_t::close(void) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    cond.notify_all();
+}
+
+//!
+//! \brief
+//!    Wait for the other side of a ring.
+//!
+
+static void backoff(unsigned int &spins) {
+    if (spins++ < 64) {
+        std::this_thread::yield();
+    } else {
+        usleep(10);
+    }
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] capacity
+//!    Number of chunks the ring holds.  This is rounded up to a power of
+//!    two.
+//!
+
+rbf_ring_t::rbf_ring_t(size_t capacity) :
+    head(0),
+    tail(0),
+    closed(false),
+    stalls(0) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    slots = new rbf_chunk_t *[size];
+    mask  = size - 1;
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+rbf_ring_t::~rbf_ring_t(void) {
+    delete[] slots;
+}
+
+//!
+//! \brief
+//!    Pass a chunk to the consumer.  This waits if the ring is full.
+//!
+
+void rbf_ring_t::push(rbf_chunk_t *chunk) {
+    size_t h = head.load(std::memory_order_relaxed);
+    for (unsigned int spins = 0; h - tail.load(std::memory_order_acquire) > mask;) {
+        backoff(spins);
+    }
+    slots[h & mask] = chunk;
+    head.store(h + 1, std::memory_order_release);
+}
+
+//!
+//! \brief
+//!    Take the next chunk from the producer.  This waits if the ring is
+//!    empty.
+//!
+//! \returns
+//!    The chunk, or NULL once the ring is closed and empty.
+//!
+
+rbf_chunk_t *rbf_ring_t::pop(void) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    for (unsigned int spins = 0;; backoff(spins)) {
+        if (head.load(std::memory_order_acquire) != t) {
+            rbf_chunk_t *chunk = slots[t & mask];
+            tail.store(t + 1, std::memory_order_release);
+            return chunk;
+        }
+        if (closed.load(std::memory_order_acquire)) {
+            if (head.load(std::memory_order_acquire) != t) {
+                continue;
+            }
+            return NULL;
+        }
+        if (spins == 0) {
+            stalls++;
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Tell the consumer that no more chunks will be pushed.
+//!
+
+void rbf_ring_t::close(void) {
+    closed.store(true, std::memory_order_release);
+}
+
+//!
+//! \brief
+//!    Keep the CPU busy, standing in for the work of a stage.
+//!
+
+static void work(unsigned int usecs) {
+    uint64_t start = now_ns();
+    while (now_ns() - start < usecs * 1000ULL) {
+    }
+}
+
+//!
+//! \brief
+//!    The <tt>bench-pool</tt> command.
+//!
+//! \details
+//!    A producer fills chunks and hands each one to two readers, a
+//!    transfer stage and a hash stage, as the network and decryption
+//!    pipelines do.  Each stage spends a fixed time on every chunk, and
+//!    each scenario makes a different stage four times slower than the
+//!    others.  The pipeline should run at the speed of its slowest stage
+//!    while never using more chunks than the pool holds.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int rbf_pool_t::bench(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " bench-pool [options]\n"
+        "\n"
+        "Stress the chunk pool and rings with a producer, a transfer stage and a\n"
+        "hash stage, with each stage in turn made the bottleneck.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --chunk-size=KB Size of each chunk (default 64).\n"
+        "  --chunks=n      Number of chunks in the pool (default 4).\n"
+        "  --help          Print help message and exit.\n"
+        "  --size=MB       Data passed through the pipeline in each scenario\n"
+        "                  (default 64).\n"
+        "  --work=us       Time each stage spends on a chunk (default 20).  The\n"
+        "                  slow stage spends four times as long.\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",       no_argument,       0, 0},  // 0
+        {"chunks",     required_argument, 0, 0},  // 1
+        {"chunk-size", required_argument, 0, 0},  // 2
+        {"size",       required_argument, 0, 0},  // 3
+        {"work",       required_argument, 0, 0},  // 4
+        {0,            0,                 0, 0},  // 5
+    };
+
+    int index = 0;
+    size_t count = 4;
+    size_t chunk_size = 64 * 1024;
+    size_t size = 64 * 1024 * 1024;
+    unsigned int us = 20;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    count = strtoul(optarg, NULL, 0);
+                    break;
+                case 2:
+                    chunk_size = strtoul(optarg, NULL, 0) * 1024;
+                    break;
+                case 3:
+                    size = strtoul(optarg, NULL, 0) * 1024 * 1024;
+                    break;
+                case 4:
+                    us = strtoul(optarg, NULL, 0);
+                    break;
+            }
+        }
+    }
+
+    if ((count == 0) || (chunk_size == 0) || (size == 0)) {
+        printf("%s: the pool and the data must not be empty.\n", PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    static const struct {
+        const char *name;
+        unsigned int produce;
+        unsigned int transfer;
+        unsigned int hash;
+    } scenarios[] = {
+        {"balanced",      1, 1, 1},
+        {"slow producer", 4, 1, 1},
+        {"slow transfer", 1, 4, 1},
+        {"slow hash",     1, 1, 4},
+        {"no work",       0, 0, 0},
+    };
+
+    printf("%-14s %8s %8s %8s %9s %7s %6s %9s %9s %5s\n", "scenario", "produce", "transfer", "hash",
+           "MB/s", "of best", "waits", "t-stalls", "h-stalls", "peak");
+
+    bool ok = true;
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+
+        rbf_pool_t pool;
+        if (!pool.create(count, chunk_size)) {
+            return EXIT_FAILURE;
+        }
+        rbf_ring_t transfer(count);
+        rbf_ring_t hash(count);
+        size_t words = pool.chunk_size() / sizeof(uint32_t);
+        size_t total = (size + pool.chunk_size() - 1) / pool.chunk_size();
+        unsigned int produce_us  = scenarios[s].produce  * us;
+        unsigned int transfer_us = scenarios[s].transfer * us;
+        unsigned int hash_us     = scenarios[s].hash     * us;
+        size_t errors = 0;
+        size_t hash_errors = 0;
+
+        uint64_t start = now_ns();
+
+        std::thread producer([&] {
+            for (size_t n = 0; n < total; n++) {
+                rbf_chunk_t *chunk = pool.get(2);
+                chunk->data[0]         = n;
+                chunk->data[words - 1] = ~n;
+                chunk->words           = words;
+                work(produce_us);
+                transfer.push(chunk);
+                hash.push(chunk);
+            }
+            transfer.close();
+            hash.close();
+        });
+
+        std::thread hasher([&] {
+            size_t n = 0;
+            for (rbf_chunk_t *chunk; (chunk = hash.pop()) != NULL; n++) {
+                if ((chunk->data[0] != (uint32_t)n) || (chunk->data[chunk->words - 1] != (uint32_t)~n)) {
+                    hash_errors++;
+                }
+                work(hash_us);
+                pool.put(chunk);
+            }
+        });
+
+        size_t n = 0;
+        for (rbf_chunk_t *chunk; (chunk = transfer.pop()) != NULL; n++) {
+            if ((chunk->data[0] != (uint32_t)n) || (chunk->data[chunk->words - 1] != (uint32_t)~n)) {
+                errors++;
+            }
+            work(transfer_us);
+            pool.put(chunk);
+        }
+
+        producer.join();
+        hasher.join();
+        double secs = (now_ns() - start) * 1e-9;
+        errors += hash_errors;
+
+        //
+        // The best the pipeline can do is the speed of its slowest stage
+        //
+
+        unsigned int slowest = produce_us;
+        if (transfer_us > slowest) {
+            slowest = transfer_us;
+        }
+        if (hash_us > slowest) {
+            slowest = hash_us;
+        }
+        double best = total * slowest * 1e-6;
+
+        printf("%-14s %6u us %6u us %6u us %9.1f %6.0f%% %6llu %9llu %9llu %2zu/%zu\n", scenarios[s].name,
+               produce_us, transfer_us, hash_us, total * pool.chunk_size() / secs / 1e6,
+               best ? 100 * best / secs : 100.0, (unsigned long long)pool.wait_count(),
+               (unsigned long long)transfer.stall_count(), (unsigned long long)hash.stall_count(),
+               pool.peak_use(), count);
+
+        if (errors || (n != total)) {
+            printf("%s: %s: %zu chunks out of order or corrupted, %zu of %zu delivered.\n", PROGNAME,
+                   scenarios[s].name, errors, n, total);
+            ok = false;
+        }
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
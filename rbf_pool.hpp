@@ -0,0 +1,190 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Chunk pool header file
+//!
+//! \details
+//!    Fixed pool of refcounted chunk buffers and the single-producer,
+//!    single-consumer rings that pass them between the stages of a load.
+//!
+//! \file
+//!    rbf_pool.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_POOL_H
+#define __RBF_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+class rbf_pool_t;
+
+//!
+//! \brief
+//!    Chunk buffer
+//!
+//! \details
+//!    A chunk is handed to each of its readers with one reference apiece.
+//!    Each reader calls rbf_pool_t::put() when it is finished, and the last
+//!    one returns the chunk to the pool.  Readers must not write the data.
+//!
+
+struct rbf_chunk_t {
+    uint32_t *data;                             //!< Page aligned buffer
+    size_t words;                               //!< Words of data in the buffer
+    std::atomic<unsigned int> refs;             //!< Readers that still hold the chunk
+};
+
+//!
+//! \brief
+//!    Chunk pool
+//!
+//! \details
+//!    All of the chunks are carved from one page aligned slab that is
+//!    allocated by create() and locked into memory when the limits allow
+//!    it, so a pipeline that uses the pool never holds more than the slab
+//!    no matter how unbalanced its stages are.  get() blocks while every
+//!    chunk is in use, which is the backpressure on the first stage.  The
+//!    free list is only touched once per chunk, so it is kept under a
+//!    mutex; the data path between stages is the lock-free rbf_ring_t.
+//!
+
+class rbf_pool_t {
+
+    public:
+
+        static const size_t page_size = 4096;   //!< Chunk alignment
+
+    private:
+
+        uint8_t *slab;                          //!< Memory for all of the chunks
+        size_t slab_size;                       //!< Size of the slab in bytes
+        size_t chunk_bytes;                     //!< Size of each chunk in bytes
+        rbf_chunk_t *chunks;                    //!< Chunk descriptors
+        size_t count;                           //!< Number of chunks
+        std::vector<rbf_chunk_t *> free_list;   //!< Chunks that are not in use
+        std::mutex mutex;                       //!< Protects the free list
+        std::condition_variable cond;           //!< Signals a returned chunk
+        bool closed;                            //!< get() fails once the pool is closed
+        size_t peak;                            //!< Most chunks in use at once
+        uint64_t waits;                         //!< Calls to get() that had to wait
+
+    public:
+
+        rbf_pool_t(void);
+        ~rbf_pool_t(void);
+        rbf_pool_t(const rbf_pool_t &) = delete;
+        rbf_pool_t &operator=(const rbf_pool_t &) = delete;
+
+        bool create(size_t count, size_t chunk_size);
+        rbf_chunk_t *get(unsigned int readers);
+        void put(rbf_chunk_t *chunk);
+        void close(void);
+
+        //!
+        //! \brief
+        //!    Size of each chunk in bytes.
+        //!
+
+        size_t chunk_size(void) const {
+            return chunk_bytes;
+        }
+
+        //!
+        //! \brief
+        //!    Most chunks that were in use at once.
+        //!
+
+        size_t peak_use(void) const {
+            return peak;
+        }
+
+        //!
+        //! \brief
+        //!    Number of times the first stage waited for a free chunk.
+        //!
+
+        uint64_t wait_count(void) const {
+            return waits;
+        }
+
+        static int bench(int argc, char *argv[]);
+
+};
+
+//!
+//! \brief
+//!    Single-producer, single-consumer ring of chunks
+//!
+//! \details
+//!    One thread pushes and one thread pops.  The indexes are on separate
+//!    cache lines and are the only shared state, so neither side takes a
+//!    lock.  A ring at least as large as the pool never fills.  An empty
+//!    ring is waited on by spinning briefly and then sleeping, which keeps
+//!    the wakeup latency well below the time it takes to fill a chunk.
+//!
+
+class rbf_ring_t {
+
+    private:
+
+        rbf_chunk_t **slots;                    //!< Ring storage
+        size_t mask;                            //!< Ring size - 1
+        alignas(64) std::atomic<size_t> head;   //!< Chunks pushed
+        alignas(64) std::atomic<size_t> tail;   //!< Chunks popped
+        alignas(64) std::atomic<bool> closed;   //!< No more chunks will be pushed
+        uint64_t stalls;                        //!< Pops that found the ring empty
+
+    public:
+
+        rbf_ring_t(size_t capacity);
+        ~rbf_ring_t(void);
+        rbf_ring_t(const rbf_ring_t &) = delete;
+        rbf_ring_t &operator=(const rbf_ring_t &) = delete;
+
+        void push(rbf_chunk_t *chunk);
+        rbf_chunk_t *pop(void);
+        void close(void);
+
+        //!
+        //! \brief
+        //!    Number of times the consumer found the ring empty.
+        //!
+
+        uint64_t stall_count(void) const {
+            return stalls;
+        }
+
+};
+
+#endif
@@ -0,0 +1,142 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Static tracepoints header file
+//!
+//! \details
+//!    USDT probes that bpftrace, perf and SystemTap can attach to without a
+//!    rebuild.  Each probe is a single nop until a tracer enables it.
+//!
+//! \file
+//!    rbf_probe.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_PROBE_H
+#define __RBF_PROBE_H
+
+//!
+//! \brief
+//!    Static tracepoints
+//!
+//! \details
+//!    The probes use the same ELF note (.note.stapsdt, version 3) as
+//!    <sys/sdt.h> but do not need it installed.  A probe site is one nop
+//!    whose arguments are described in the note.  Arguments are evaluated
+//!    into registers even when no tracer is attached, so they should be
+//!    values that are already at hand.  The provider is "fpga_loader".  List
+//!    the probes with
+//!
+//!        readelf -n fpga_loader
+//!        bpftrace -l 'usdt:./fpga_loader:*'
+//!
+//!    Arguments are at most one machine word each.
+//!
+//!    | Probe        | Arguments                                            |
+//!    |--------------|------------------------------------------------------|
+//!    | ingest_start | filename (char *)                                    |
+//!    | ingest_done  | filename (char *), data (void *), size in bytes      |
+//!    | step         | step number in loadFPGA(), 0 to 17, or in loadPR(),  |
+//!    |              | 101 to 110                                           |
+//!    | wait_done    | step number, polls, 1 if the state was reached       |
+//!    | chunk        | offset in bytes, length in bytes, data (void *)      |
+//!
+//!    ingest_done has a NULL data pointer if the file could not be read.
+//!    Step 13 fires once for 13a and 13b, and Step 10a (verification) has
+//!    no step probe.  wait_done fires at the end of the polling in Steps 5,
+//!    7, 11, 14, 16, 104 and 108.
+//!
+//!    Define RBF_NO_PROBES to build without the notes.  "make check-probes"
+//!    fails if a probe in the table is missing from the executable.
+//!
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(RBF_NO_PROBES)
+
+#include <type_traits>
+
+#if defined(__LP64__)
+#define RBF_PROBE_ADDR ".8byte"
+#else
+#define RBF_PROBE_ADDR ".4byte"
+#endif
+
+//
+// The argument size is negative for signed arguments, as in <sys/sdt.h>.
+// The %n operand modifier prints the constant negated.
+//
+
+#define RBF_PROBE_SIZE(x) ((std::is_signed<decltype(x)>::value ? 1 : -1) * (int)sizeof(x))
+#define RBF_PROBE_OPERAND(n, x) [s##n] "n" (RBF_PROBE_SIZE(x)), [a##n] "nor" (x)
+#define RBF_PROBE_FORMAT(n) "%n[s" #n "]@%[a" #n "]"
+
+#define RBF_PROBE_NOTE(name, format, ...)                                       \
+    __asm__ __volatile__(                                                       \
+        "990: nop\n"                                                            \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+        ".balign 4\n"                                                           \
+        ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+        "991: .asciz \"stapsdt\"\n"                                             \
+        "992: .balign 4\n"                                                      \
+        "993: " RBF_PROBE_ADDR " 990b\n"                                        \
+        RBF_PROBE_ADDR " _.stapsdt.base\n"                                      \
+        RBF_PROBE_ADDR " 0\n"                                                   \
+        ".asciz \"fpga_loader\"\n"                                              \
+        ".asciz \"" #name "\"\n"                                                \
+        ".asciz \"" format "\"\n"                                               \
+        "994: .balign 4\n"                                                      \
+        ".popsection\n"                                                         \
+        ".ifndef _.stapsdt.base\n"                                              \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n"                                                \
+        ".hidden _.stapsdt.base\n"                                              \
+        "_.stapsdt.base: .space 1\n"                                            \
+        ".size _.stapsdt.base, 1\n"                                             \
+        ".popsection\n"                                                         \
+        ".endif\n"                                                              \
+        :: __VA_ARGS__)
+
+#define RBF_PROBE1(name, a0) \
+    RBF_PROBE_NOTE(name, RBF_PROBE_FORMAT(0), RBF_PROBE_OPERAND(0, a0))
+
+#define RBF_PROBE2(name, a0, a1) \
+    RBF_PROBE_NOTE(name, RBF_PROBE_FORMAT(0) " " RBF_PROBE_FORMAT(1), \
+                   RBF_PROBE_OPERAND(0, a0), RBF_PROBE_OPERAND(1, a1))
+
+#define RBF_PROBE3(name, a0, a1, a2) \
+    RBF_PROBE_NOTE(name, RBF_PROBE_FORMAT(0) " " RBF_PROBE_FORMAT(1) " " RBF_PROBE_FORMAT(2), \
+                   RBF_PROBE_OPERAND(0, a0), RBF_PROBE_OPERAND(1, a1), RBF_PROBE_OPERAND(2, a2))
+
+#else
+
+#define RBF_PROBE1(name, a0)
+#define RBF_PROBE2(name, a0, a1)
+#define RBF_PROBE3(name, a0, a1, a2)
+
+#endif
+
+#endif
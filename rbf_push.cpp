@@ -0,0 +1,408 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fan-out push
+//!
+//! \file
+//!    rbf_push.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "rbf_push.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] image
+//!    Image to send.  It must stay valid until run() returns.
+//!
+//! \param[in] jobs
+//!    Maximum number of boards in progress at a time.
+//!
+//! \param[in] timeout
+//!    Seconds allowed for each board, from connect() to the reply.
+//!
+//! \param[in] quiet
+//!    Only report failures.
+//!
+
+rbf_push_t::rbf_push_t(const rbf_image_t &image, unsigned int jobs, unsigned int timeout, bool quiet) :
+    image(image),
+    jobs(jobs ? jobs : 1),
+    timeout(timeout),
+    quiet(quiet),
+    epfd(-1) {
+    memcpy(header.magic, rbf_net_t::magic, sizeof(header.magic));
+    header.version = rbf_net_t::version;
+    header.size    = image.size();
+    header.hash    = hash64_t::hash(image.bytes(), image.size());
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+rbf_push_t::~rbf_push_t(void) {
+    for (size_t i = 0; i < boards.size(); i++) {
+        if (boards[i].fd >= 0) {
+            close(boards[i].fd);
+        }
+    }
+    if (epfd >= 0) {
+        close(epfd);
+    }
+}
+
+//!
+//! \brief
+//!    Add a board.
+//!
+//! \param[in] name
+//!    <tt>host</tt>, <tt>host:port</tt> or <tt>[address]:port</tt>.
+//!
+//! \param[in] port
+//!    Port to use when the name does not include one.
+//!
+
+void rbf_push_t::add(const char *name, const char *port) {
+
+    board_t board;
+    board.name     = name;
+    board.host     = name;
+    board.port     = port;
+    board.fd       = -1;
+    board.state    = waiting;
+    board.sent     = 0;
+    board.start_ns = 0;
+    board.sent_ns  = 0;
+    board.done_ns  = 0;
+
+    const char *colon = strrchr(name, ':');
+    if ((name[0] == '[') && colon && (colon[-1] == ']')) {
+        board.host = std::string(name + 1, colon - 1);
+        board.port = colon + 1;
+    } else if (colon && (strchr(name, ':') == colon)) {
+        board.host = std::string(name, colon);
+        board.port = colon + 1;
+    }
+
+    boards.push_back(board);
+}
+
+//!
+//! \brief
+//!    Report the result for one board.
+//!
+
+void rbf_push_t::report(const board_t &board) {
+    if (board.state == done) {
+        if (!quiet) {
+            double send_secs = (board.sent_ns - board.start_ns) * 1e-9;
+            printf("%s: %s: sent %zu bytes in %.3f ms (%.1f MB/s), %s, %.3f ms total\n", PROGNAME,
+                   board.name.c_str(), image.size(), send_secs * 1e3, image.size() / send_secs / 1e6,
+                   board.reply.c_str(), (board.done_ns - board.start_ns) * 1e-6);
+        }
+    } else {
+        fprintf(stderr, "%s: %s: failed after %.3f ms: %s\n", PROGNAME, board.name.c_str(),
+                (board.done_ns - board.start_ns) * 1e-6, board.reply.c_str());
+    }
+    fflush(stdout);
+}
+
+//!
+//! \brief
+//!    Finish with a board.
+//!
+//! \param[in] board
+//!    Board
+//!
+//! \param[in] state
+//!    <tt>done</tt> or <tt>failed</tt>
+//!
+//! \param[in] reason
+//!    Reason for the failure or NULL to keep the reply.
+//!
+
+void rbf_push_t::finish(board_t &board, state_t state, const char *reason) {
+    if (board.fd >= 0) {
+        close(board.fd);
+        board.fd = -1;
+    }
+    if (reason) {
+        board.reply = reason;
+    }
+    board.state   = state;
+    board.done_ns = now_ns();
+    report(board);
+}
+
+//!
+//! \brief
+//!    Start connecting to a board.
+//!
+
+void rbf_push_t::start(board_t &board) {
+
+    board.start_ns = now_ns();
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *res;
+    int err = getaddrinfo(board.host.c_str(), board.port.c_str(), &hints, &res);
+    if (err != 0) {
+        finish(board, failed, gai_strerror(err));
+        return;
+    }
+
+    board.fd = socket(res->ai_family, res->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, res->ai_protocol);
+    if (board.fd < 0) {
+        freeaddrinfo(res);
+        finish(board, failed, strerror(errno));
+        return;
+    }
+
+    int ret = connect(board.fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if ((ret != 0) && (errno != EINPROGRESS)) {
+        finish(board, failed, strerror(errno));
+        return;
+    }
+
+    struct epoll_event ev;
+    ev.events   = EPOLLOUT;
+    ev.data.ptr = &board;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, board.fd, &ev);
+    board.state = connecting;
+}
+
+//!
+//! \brief
+//!    Make progress on a board when its socket is ready.
+//!
+
+void rbf_push_t::service(board_t &board) {
+
+    if (board.state == connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(board.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            finish(board, failed, strerror(err));
+            return;
+        }
+        board.state = sending;
+    }
+
+    if (board.state == sending) {
+
+        //
+        // Send as much as the socket will take
+        //
+
+        size_t total = sizeof(header) + image.size();
+        while (board.sent < total) {
+            ssize_t ret;
+            if (board.sent < sizeof(header)) {
+                ret = send(board.fd, (const uint8_t *)&header + board.sent, sizeof(header) - board.sent,
+                           MSG_NOSIGNAL | MSG_MORE);
+            } else {
+                ret = send(board.fd, image.bytes() + board.sent - sizeof(header), total - board.sent,
+                           MSG_NOSIGNAL);
+            }
+            if (ret < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    return;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                //
+                // The server may have refused the image and replied
+                //
+
+                break;
+            }
+            board.sent += ret;
+        }
+
+        board.sent_ns = now_ns();
+        shutdown(board.fd, SHUT_WR);
+        board.state = receiving;
+
+        struct epoll_event ev;
+        ev.events   = EPOLLIN;
+        ev.data.ptr = &board;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, board.fd, &ev);
+        return;
+    }
+
+    if (board.state == receiving) {
+
+        //
+        // Collect the reply until the server closes the connection
+        //
+
+        char buf[256];
+        ssize_t ret = recv(board.fd, buf, sizeof(buf), 0);
+        if (ret < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                return;
+            }
+            finish(board, failed, board.reply.empty() ? strerror(errno) : NULL);
+            return;
+        }
+        if (ret > 0) {
+            board.reply.append(buf, ret);
+            if (board.reply.size() < 256) {
+                return;
+            }
+        }
+
+        while (!board.reply.empty() && (board.reply[board.reply.size() - 1] == '\n')) {
+            board.reply.erase(board.reply.size() - 1);
+        }
+        if (board.reply.compare(0, 2, "ok") == 0) {
+            finish(board, done, NULL);
+        } else {
+            finish(board, failed, board.reply.empty() ? "no reply" : NULL);
+        }
+    }
+}
+
+//!
+//! \brief
+//!    Send the image to all of the boards.
+//!
+//! \returns
+//!    EXIT_SUCCESS if every board was programmed.
+//!
+
+int rbf_push_t::run(void) {
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror(PROGNAME);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t begin = now_ns();
+    uint64_t progress = begin;
+    size_t next = 0;
+    size_t finished = 0;
+    std::vector<struct epoll_event> events(jobs);
+
+    while (finished < boards.size()) {
+
+        //
+        // Fill the free slots
+        //
+
+        size_t active = 0;
+        for (size_t i = 0; i < next; i++) {
+            if ((boards[i].state != done) && (boards[i].state != failed)) {
+                active++;
+            }
+        }
+        while ((active < jobs) && (next < boards.size())) {
+            start(boards[next++]);
+            if (boards[next - 1].state != failed) {
+                active++;
+            }
+        }
+
+        //
+        // Service the sockets that are ready
+        //
+
+        int n = epoll_wait(epfd, events.data(), events.size(), 100);
+        for (int i = 0; i < n; i++) {
+            service(*(board_t *)events[i].data.ptr);
+        }
+
+        //
+        // Give up on boards that have taken too long
+        //
+
+        uint64_t now = now_ns();
+        finished = 0;
+        for (size_t i = 0; i < next; i++) {
+            board_t &board = boards[i];
+            if ((board.state != done) && (board.state != failed) && timeout &&
+                (now - board.start_ns > timeout * 1000000000ULL)) {
+                finish(board, failed, "timeout");
+            }
+            if ((board.state == done) || (board.state == failed)) {
+                finished++;
+            }
+        }
+
+        //
+        // Report progress once a second
+        //
+
+        if (!quiet && (boards.size() > 1) && (now - progress > 1000000000ULL) && (finished < boards.size())) {
+            uint64_t sent = 0;
+            for (size_t i = 0; i < next; i++) {
+                sent += boards[i].sent;
+            }
+            printf("%s: %zu of %zu boards finished, %zu in progress, %.1f MB sent\n", PROGNAME,
+                   finished, boards.size(), next - finished, sent / 1e6);
+            fflush(stdout);
+            progress = now;
+        }
+    }
+
+    size_t good = 0;
+    for (size_t i = 0; i < boards.size(); i++) {
+        if (boards[i].state == done) {
+            good++;
+        }
+    }
+
+    if (boards.size() > 1) {
+        printf("%s: programmed %zu of %zu boards in %.3f s\n", PROGNAME, good, boards.size(),
+               (now_ns() - begin) * 1e-9);
+    }
+
+    return (good == boards.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
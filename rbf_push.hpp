@@ -0,0 +1,121 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Fan-out push header file
+//!
+//! \details
+//!    This object sends one rbf image to the "serve" daemons on many boards
+//!    at the same time.
+//!
+//! \file
+//!    rbf_push.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_PUSH_H
+#define __RBF_PUSH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "rbf_image.hpp"
+#include "rbf_net.hpp"
+
+//!
+//! \brief
+//!    Fan-out push object
+//!
+//! \details
+//!    All of the connections are driven by one epoll() loop with
+//!    non-blocking sockets.  Every board is sent the same mapped image, so
+//!    the image is read once however many boards there are.  At most
+//!    <tt>jobs</tt> boards are in progress at a time; the rest wait for a
+//!    free slot.  Each board is reported as it finishes.
+//!
+
+class rbf_push_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    State of one board
+        //!
+
+        enum state_t {
+            waiting,                            //!< Not started
+            connecting,                         //!< Waiting for connect()
+            sending,                            //!< Sending the header and image
+            receiving,                          //!< Waiting for the reply
+            done,                               //!< Programmed
+            failed,                             //!< Failed
+        };
+
+        //!
+        //! \brief
+        //!    One board
+        //!
+
+        struct board_t {
+            std::string name;                   //!< Name as given on the command line
+            std::string host;                   //!< Host name or address
+            std::string port;                   //!< TCP port
+            int fd;                             //!< Socket
+            state_t state;                      //!< Progress
+            size_t sent;                        //!< Bytes of header and image sent
+            uint64_t start_ns;                  //!< Time the connection was started
+            uint64_t sent_ns;                   //!< Time the image was sent
+            uint64_t done_ns;                   //!< Time the reply was received
+            std::string reply;                  //!< Reply from the server or the error
+        };
+
+        const rbf_image_t &image;               //!< Image to send
+        rbf_net_header_t header;                //!< Header to send
+        std::vector<board_t> boards;            //!< Boards
+        unsigned int jobs;                      //!< Maximum boards in progress
+        unsigned int timeout;                   //!< Seconds allowed per board
+        bool quiet;                             //!< Suppress messages
+        int epfd;                               //!< epoll descriptor
+
+        void start(board_t &board);
+        void service(board_t &board);
+        void finish(board_t &board, state_t state, const char *reason);
+        void report(const board_t &board);
+
+    public:
+
+        rbf_push_t(const rbf_image_t &image, unsigned int jobs, unsigned int timeout, bool quiet);
+        ~rbf_push_t(void);
+        void add(const char *name, const char *port);
+        int run(void);
+
+};
+
+#endif
@@ -0,0 +1,295 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Resident RBF image
+//!
+//! \file
+//!    rbf_resident.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rbf_format.hpp"
+#include "rbf_resident.hpp"
+
+const char rbf_resident_t::magic[8] = {'K', 'S', '1', '0', 'R', 'B', 'F', 'R'};
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+rbf_resident_t::rbf_resident_t(void) :
+    fd(-1),
+    region(NULL),
+    region_size(0),
+    header(NULL),
+    offset(0) {
+}
+
+//!
+//! \brief
+//!    Destructor
+//!
+
+rbf_resident_t::~rbf_resident_t(void) {
+    if (region) {
+        munmap(region, region_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+//!
+//! \brief
+//!    Map the resident region.
+//!
+//! \param[in] spec
+//!    Either <tt>address:size</tt> of reserved physical memory, or the name
+//!    of a file that stands in for it.  The region must be page aligned.
+//!
+//! \returns
+//!    True if the region was mapped.
+//!
+
+bool rbf_resident_t::open(const char *spec) {
+
+    const char *path = spec;
+    off_t addr = 0;
+    size_t size = 0;
+
+    //
+    // Physical memory is given as address:size
+    //
+
+    char *end;
+    unsigned long long val = strtoull(spec, &end, 0);
+    if ((end != spec) && (*end == ':')) {
+        path = "/dev/mem";
+        addr = val;
+        size = strtoull(end + 1, &end, 0);
+        if ((*end != 0) || (size == 0)) {
+            fprintf(stderr, "%s: resident region \"%s\" is not address:size.\n", PROGNAME, spec);
+            return false;
+        }
+    }
+
+    fd = ::open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s: %s\n", PROGNAME, path, strerror(errno));
+        return false;
+    }
+
+    if (size == 0) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fprintf(stderr, "%s: %s: %s\n", PROGNAME, path, strerror(errno));
+            return false;
+        }
+        size = st.st_size;
+    }
+
+    if (((addr | size) & (getpagesize() - 1)) != 0) {
+        fprintf(stderr, "%s: resident region \"%s\" is not page aligned.\n", PROGNAME, spec);
+        return false;
+    }
+
+    if (size <= data_offset) {
+        fprintf(stderr, "%s: resident region \"%s\" is too small.\n", PROGNAME, spec);
+        return false;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, addr);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: unable to mmap() resident region \"%s\": %s\n", PROGNAME, spec, strerror(errno));
+        return false;
+    }
+
+    region      = (uint8_t *)map;
+    region_size = size;
+    header      = (volatile rbf_resident_header_t *)region;
+    return true;
+}
+
+//!
+//! \brief
+//!    Flush the region when it is backed by a file.
+//!
+
+void rbf_resident_t::sync(void) {
+    __sync_synchronize();
+    msync(region, region_size, MS_SYNC);
+}
+
+//!
+//! \brief
+//!    Store an image in the resident region.
+//!
+//! \details
+//!    The generation is made odd before the image is written and even again
+//!    after the size and hash are recorded.  Nothing is written if the
+//!    region already holds an intact copy of the same image.
+//!
+//! \param[in] image
+//!    Image to store.
+//!
+//! \param[in] quiet
+//!    Suppress messages.
+//!
+//! \returns
+//!    True if the region holds the image.
+//!
+
+bool rbf_resident_t::store(const rbf_image_t &image, bool quiet) {
+
+    if (image.size() > region_size - data_offset) {
+        fprintf(stderr, "%s: rbf file (%zu bytes) does not fit in the resident region (%zu bytes).\n",
+                PROGNAME, image.size(), region_size - data_offset);
+        return false;
+    }
+
+    uint64_t digest = hash64_t::hash(image.bytes(), image.size());
+    bool valid = (memcmp((const void *)header->magic, magic, sizeof(magic)) == 0) &&
+                 (header->version == version);
+    uint32_t generation = valid ? header->generation : 0;
+
+    if (valid && ((generation & 1) == 0) && (header->size == image.size()) && (header->hash == digest) &&
+        (memcmp(region + data_offset, image.bytes(), image.size()) == 0)) {
+        if (!quiet) {
+            printf("%s: Resident image is current (generation %u).\n", PROGNAME, generation);
+        }
+        return true;
+    }
+
+    //
+    // Mark the region as being updated
+    //
+
+    generation = (generation | 1);
+    memcpy((void *)header->magic, magic, sizeof(magic));
+    header->version    = version;
+    header->generation = generation;
+    header->size       = 0;
+    header->reserved   = 0;
+    header->hash       = 0;
+    sync();
+
+    //
+    // Write the image and then publish it
+    //
+
+    memcpy(region + data_offset, image.bytes(), image.size());
+    header->size = image.size();
+    header->hash = digest;
+    sync();
+    header->generation = generation + 1;
+    sync();
+
+    if (!quiet) {
+        printf("%s: Stored rbf file in resident region (generation %u).\n", PROGNAME, generation + 1);
+    }
+    return true;
+}
+
+//!
+//! \brief
+//!    Check the resident image header and prepare to stream it.
+//!
+//! \param[in] quiet
+//!    Suppress messages.
+//!
+//! \returns
+//!    True if the region holds a complete image.
+//!
+
+bool rbf_resident_t::load(bool quiet) {
+
+    if ((memcmp((const void *)header->magic, magic, sizeof(magic)) != 0) ||
+        (header->version != version) ||
+        (header->reserved != 0)) {
+        fprintf(stderr, "%s: resident region does not hold an rbf image.\n", PROGNAME);
+        return false;
+    }
+
+    if ((header->generation & 1) != 0) {
+        fprintf(stderr, "%s: resident image (generation %u) was not stored completely.\n", PROGNAME, header->generation);
+        return false;
+    }
+
+    if ((header->size > region_size - data_offset) || !rbf_format_t::valid_size(header->size)) {
+        fprintf(stderr, "%s: resident image size (%u bytes) is not valid.\n", PROGNAME, header->size);
+        return false;
+    }
+
+    if (!quiet) {
+        printf("%s: Using resident image (generation %u, %u bytes).\n", PROGNAME, header->generation, header->size);
+    }
+
+    offset = 0;
+    hash = hash64_t();
+    return true;
+}
+
+//!
+//! \brief
+//!    Return the next chunk of the resident image.
+//!
+
+size_t rbf_resident_t::next(const uint32_t **chunk) {
+    size_t size = header->size;
+    if (offset >= size) {
+        return 0;
+    }
+    size_t len = (size - offset < chunk_size) ? size - offset : chunk_size;
+    const uint8_t *data = region + data_offset + offset;
+    hash.update(data, len);
+    offset += len;
+    *chunk = (const uint32_t *)data;
+    return len / sizeof(uint32_t);
+}
+
+//!
+//! \brief
+//!    Check the hash of the streamed image.
+//!
+//! \returns
+//!    True if the whole image was streamed and matched the recorded hash.
+//!
+
+bool rbf_resident_t::good(void) {
+    return (offset == header->size) && (hash.digest() == header->hash);
+}
@@ -0,0 +1,116 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Resident RBF image header file
+//!
+//! \details
+//!    This object keeps a prepared rbf image in a reserved region of
+//!    physical memory so that it survives a crash of the loader or of the
+//!    console and can be reprogrammed without reading the SD card.
+//!
+//! \file
+//!    rbf_resident.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_RESIDENT_H
+#define __RBF_RESIDENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "rbf_image.hpp"
+
+//!
+//! \brief
+//!    Resident image header
+//!
+//! \details
+//!    The header is at the start of the region and the image starts at
+//!    rbf_resident_t::data_offset.  The generation is odd while an image is
+//!    being stored, so a store that was interrupted is never mistaken for
+//!    a good image.
+//!
+
+struct rbf_resident_header_t {
+    char     magic[8];                          //!< (0x000) "KS10RBFR"
+    uint32_t version;                           //!< (0x008) Header version
+    uint32_t generation;                        //!< (0x00c) Incremented by each store
+    uint32_t size;                              //!< (0x010) Size of the RBF image in bytes
+    uint32_t reserved;                          //!< (0x014) Must be zero
+    uint64_t hash;                              //!< (0x018) hash64_t of the RBF image
+};
+
+//!
+//! \brief
+//!    Configuration data source that streams a resident image.
+//!
+//! \details
+//!    The region is either physical memory that is reserved from the kernel
+//!    (for example with a reserved-memory node in the device tree), mapped
+//!    through /dev/mem, or a regular file that stands in for it.
+//!
+//!    The image is hashed as it is streamed to the FPGA; good() reports
+//!    whether it matched the hash that was recorded when it was stored.
+//!
+
+class rbf_resident_t : public rbf_source_t {
+
+    public:
+
+        static const char     magic[8];         //!< Header magic number
+        static const uint32_t version = 1;      //!< Header version
+        static const size_t   data_offset = 4096;       //!< Offset of the image in the region
+        static const size_t   chunk_size = 64 * 1024;   //!< Chunk size in bytes
+
+    private:
+
+        int fd;                                 //!< Region file descriptor
+        uint8_t *region;                        //!< mmap() of the region
+        size_t region_size;                     //!< Size of the region
+        volatile rbf_resident_header_t *header; //!< Region header
+        size_t offset;                          //!< Bytes streamed
+        hash64_t hash;                          //!< Hash of the bytes streamed
+
+        void sync(void);
+
+    public:
+
+        rbf_resident_t(void);
+        ~rbf_resident_t(void);
+        bool open(const char *spec);
+        bool store(const rbf_image_t &image, bool quiet);
+        bool load(bool quiet);
+        size_t next(const uint32_t **chunk);
+        bool good(void);
+
+};
+
+#endif
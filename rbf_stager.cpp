@@ -0,0 +1,206 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Image stager
+//!
+//! \file
+//!    rbf_stager.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fpga_loader.hpp"
+#include "hash64.hpp"
+#include "rbf_format.hpp"
+#include "rbf_stager.hpp"
+
+//!
+//! \brief
+//!    Constructor.  This starts the staging thread.
+//!
+//! \param[in] budget
+//!    Memory budget for staged images in bytes.
+//!
+//! \param[in] profile
+//!    Storage device to emulate while reading images, or NULL.
+//!
+
+rbf_stager_t::rbf_stager_t(size_t budget, const rbf_throttle_t::profile_t *profile) :
+    budget(budget),
+    used(0),
+    stop(false),
+    throttle(profile ? *profile : rbf_throttle_t::profile_t()),
+    throttled(profile != NULL) {
+    worker = std::thread(&rbf_stager_t::run, this);
+}
+
+//!
+//! \brief
+//!    Destructor.  Images that have not been staged are abandoned.
+//!
+
+rbf_stager_t::~rbf_stager_t(void) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+//!
+//! \brief
+//!    Add an image to the end of the staging queue.
+//!
+//! \param[in] filename
+//!    rbf file
+//!
+
+void rbf_stager_t::add(const std::string &filename) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(filename);
+    }
+    cond.notify_all();
+}
+
+//!
+//! \brief
+//!    Take the next image.
+//!
+//! \details
+//!    This waits for the image to be staged.  The caller must have added
+//!    an image that has not been taken.
+//!
+//! \param[out] wait_ns
+//!    If not NULL, the time spent waiting is added to it.
+//!
+//! \returns
+//!    The staged image.  The image is empty if it could not be staged.
+//!
+
+rbf_stager_t::staged_t rbf_stager_t::take(uint64_t *wait_ns) {
+    uint64_t start = now_ns();
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return !ready.empty(); });
+    staged_t staged = std::move(ready.front());
+    ready.pop_front();
+    used -= staged.image.size();
+    lock.unlock();
+    cond.notify_all();
+    if (wait_ns) {
+        *wait_ns += now_ns() - start;
+    }
+    return staged;
+}
+
+//!
+//! \brief
+//!    Read, check, hash and pin one image.
+//!
+
+void rbf_stager_t::stage(staged_t &staged) {
+
+    uint64_t start = now_ns();
+    staged.hash   = 0;
+    staged.pinned = false;
+    staged.image  = rbf_image_t::open(staged.filename.c_str());
+
+    if (staged.image.valid() && !rbf_format_t::valid_size(staged.image.size())) {
+        fprintf(stderr, "%s: %s: rbf file length is not exact multiple of 32-bit words.\n", PROGNAME,
+                staged.filename.c_str());
+        staged.image = rbf_image_t();
+    }
+
+    if (staged.image.valid() && throttled) {
+        throttle.delay(staged.image.size());
+    }
+
+    if (staged.image.valid()) {
+        staged.hash   = hash64_t::hash(staged.image.bytes(), staged.image.size());
+        staged.pinned = (mlock(staged.image.bytes(), staged.image.size()) == 0);
+    }
+
+    staged.stage_ns = now_ns() - start;
+}
+
+//!
+//! \brief
+//!    Staging thread.
+//!
+
+void rbf_stager_t::run(void) {
+
+    for (;;) {
+
+        //
+        // Wait for an image
+        //
+
+        staged_t staged;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return stop || !pending.empty(); });
+            if (stop) {
+                return;
+            }
+            staged.filename = pending.front();
+            pending.pop_front();
+        }
+
+        //
+        // An image that would overrun the budget is not read until the
+        // images ahead of it have been taken.  The image is counted while it
+        // is being staged.  A file that cannot be sized is staged anyway so
+        // that stage() reports the error.
+        //
+
+        struct stat st;
+        size_t size = (stat(staged.filename.c_str(), &st) == 0) ? st.st_size : 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this, size] { return stop || ready.empty() || (used + size <= budget); });
+            if (stop) {
+                return;
+            }
+            used += size;
+        }
+
+        stage(staged);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            used = used - size + staged.image.size();
+            ready.push_back(std::move(staged));
+        }
+        cond.notify_all();
+    }
+}
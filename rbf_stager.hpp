@@ -0,0 +1,111 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Image stager header file
+//!
+//! \details
+//!    This object reads, checks, hashes and pins upcoming rbf images in the
+//!    background so that each load can start its data phase immediately.
+//!
+//! \file
+//!    rbf_stager.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_STAGER_H
+#define __RBF_STAGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "rbf_image.hpp"
+#include "rbf_throttle.hpp"
+
+//!
+//! \brief
+//!    Image stager object
+//!
+//! \details
+//!    Images are staged in the order they were added.  Each image is mapped,
+//!    its length is checked, it is hashed with hash64_t (which also faults
+//!    in every page) and it is locked into memory if the process is allowed
+//!    to.  A storage throttle can slow the reads down to the speed of the
+//!    device that holds the images on the board.  Staged images that have
+//!    not been taken yet are limited to the memory budget; one image is
+//!    always staged even if it is larger than the budget so that the stager
+//!    cannot stall.
+//!
+
+class rbf_stager_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    A staged image
+        //!
+
+        struct staged_t {
+            std::string filename;               //!< rbf file
+            rbf_image_t image;                  //!< Image, empty if it could not be staged
+            uint64_t hash;                      //!< hash64_t of the image
+            uint64_t stage_ns;                  //!< Time taken to stage the image
+            bool pinned;                        //!< Image is locked into memory
+        };
+
+    private:
+
+        size_t budget;                          //!< Memory budget in bytes
+        size_t used;                            //!< Bytes being staged or staged and not yet taken
+        std::deque<std::string> pending;        //!< Images still to be staged
+        std::deque<staged_t> ready;             //!< Staged images in order
+        bool stop;                              //!< Destructor is waiting
+        std::mutex mutex;                       //!< Protects the queues
+        std::condition_variable cond;           //!< Signals queue changes
+        rbf_throttle_t throttle;                //!< Storage throttle
+        bool throttled;                         //!< Throttle is in use
+        std::thread worker;                     //!< Staging thread
+
+        void run(void);
+        void stage(staged_t &staged);
+
+    public:
+
+        rbf_stager_t(size_t budget, const rbf_throttle_t::profile_t *profile = NULL);
+        ~rbf_stager_t(void);
+        void add(const std::string &filename);
+        staged_t take(uint64_t *wait_ns = NULL);
+
+};
+
+#endif
@@ -0,0 +1,242 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Storage throttle
+//!
+//! \file
+//!    rbf_throttle.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rbf_throttle.hpp"
+
+//!
+//! \brief
+//!    Built-in profiles.
+//!
+//! \details
+//!    The SD card figures are typical of the cards used with the DE10-Nano
+//!    when read through the HPS SD/MMC controller: sequential bandwidth
+//!    after filesystem overhead, and the command latency of each read.
+//!    Custom figures can be given on the command line.
+//!
+
+const rbf_throttle_t::profile_t rbf_throttle_t::profiles[] = {
+    {"sd-slow",   5e6, 3.0e-3, 2.0e-3, 64 * 1024,  64 * 1024},
+    {"sd",       12e6, 1.0e-3, 0.5e-3, 64 * 1024, 128 * 1024},
+    {"sd-fast",  22e6, 0.5e-3, 0.2e-3, 128 * 1024, 256 * 1024},
+    {"usb",      30e6, 0.3e-3, 0.1e-3, 128 * 1024, 512 * 1024},
+    {NULL,          0,      0,      0,         0,          0},
+};
+
+//!
+//! \brief
+//!    Parse a profile.
+//!
+//! \param[in] spec
+//!    A profile name, or <tt>MB/s[:latency_ms[:jitter_ms]]</tt>.
+//!
+//! \param[out] profile
+//!    The profile.
+//!
+//! \returns
+//!    True if the profile is valid.
+//!
+
+bool rbf_throttle_t::parse(const char *spec, profile_t &profile) {
+
+    for (const profile_t *p = profiles; p->name; p++) {
+        if (strcmp(spec, p->name) == 0) {
+            profile = *p;
+            return true;
+        }
+    }
+
+    char *end;
+    double mbps    = strtod(spec, &end);
+    double latency = 0;
+    double jitter  = 0;
+    if (*end == ':') {
+        latency = strtod(end + 1, &end);
+        if (*end == ':') {
+            jitter = strtod(end + 1, &end);
+        }
+    }
+    if ((end == spec) || (*end != 0) || (mbps <= 0) || (latency < 0) || (jitter < 0)) {
+        fprintf(stderr, "%s: invalid throttle profile \"%s\".  Use MB/s[:latency_ms[:jitter_ms]] or one of:", PROGNAME, spec);
+        for (const profile_t *p = profiles; p->name; p++) {
+            fprintf(stderr, " %s", p->name);
+        }
+        fprintf(stderr, "\n");
+        return false;
+    }
+
+    profile.name      = spec;
+    profile.bandwidth = mbps * 1e6;
+    profile.latency   = latency * 1e-3;
+    profile.jitter    = jitter * 1e-3;
+    profile.request   = 64 * 1024;
+    profile.burst     = 64 * 1024;
+    return true;
+}
+
+//!
+//! \brief
+//!    Constructor
+//!
+//! \param[in] profile
+//!    Storage device to emulate.
+//!
+
+rbf_throttle_t::rbf_throttle_t(const profile_t &profile) :
+    profile(profile),
+    source(NULL),
+    pending(NULL),
+    remaining(0),
+    tokens(profile.burst),
+    last_ns(now_ns()),
+    delay_ns(0),
+    seed(1) {
+}
+
+//!
+//! \brief
+//!    Throttle a source.
+//!
+//! \param[in] source
+//!    Source to read through the throttle.
+//!
+
+void rbf_throttle_t::attach(rbf_source_t &source) {
+    this->source = &source;
+    pending   = NULL;
+    remaining = 0;
+}
+
+//!
+//! \brief
+//!    Wait as long as the device would take to read some bytes.
+//!
+//! \param[in] bytes
+//!    Number of bytes.  This is split into requests.
+//!
+
+void rbf_throttle_t::delay(size_t bytes) {
+
+    while (bytes) {
+
+        size_t len = (bytes < profile.request) ? bytes : profile.request;
+        bytes -= len;
+
+        //
+        // Refill the bucket
+        //
+
+        uint64_t now = now_ns();
+        tokens += (now - last_ns) * 1e-9 * profile.bandwidth;
+        if (tokens > profile.burst) {
+            tokens = profile.burst;
+        }
+        last_ns = now;
+
+        //
+        // Access latency plus the time to earn the bytes that are missing
+        //
+
+        seed = seed * 1103515245 + 12345;
+        double jitter = profile.jitter * (2.0 * ((seed >> 8) & 0xffff) / 65535.0 - 1.0);
+        double secs = profile.latency + jitter;
+        if (secs < 0) {
+            secs = 0;
+        }
+
+        tokens -= len;
+        if (tokens < 0) {
+            secs += -tokens / profile.bandwidth;
+        }
+
+        uint64_t ns = secs * 1e9;
+        struct timespec ts = {(time_t)(ns / 1000000000), (long)(ns % 1000000000)};
+        while (nanosleep(&ts, &ts) != 0) {
+            ;
+        }
+        delay_ns += ns;
+
+        //
+        // The debt has been paid.  Only time that the caller spends
+        // elsewhere refills the bucket, which models the read-ahead.
+        //
+
+        if (tokens < 0) {
+            tokens = 0;
+        }
+        last_ns = now_ns();
+    }
+}
+
+//!
+//! \brief
+//!    Get the next request from the wrapped source.
+//!
+
+size_t rbf_throttle_t::next(const uint32_t **chunk) {
+
+    if (remaining == 0) {
+        remaining = source ? source->next(&pending) : 0;
+        if (remaining == 0) {
+            return 0;
+        }
+    }
+
+    size_t len = profile.request / sizeof(uint32_t);
+    if (len > remaining) {
+        len = remaining;
+    }
+
+    delay(len * sizeof(uint32_t));
+
+    *chunk     = pending;
+    pending   += len;
+    remaining -= len;
+    return len;
+}
+
+//!
+//! \brief
+//!    The data is intact if the wrapped source says so.
+//!
+
+bool rbf_throttle_t::good(void) {
+    return source ? source->good() : true;
+}
@@ -0,0 +1,124 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Storage throttle header file
+//!
+//! \details
+//!    This object slows an image source down to the speed of a slow storage
+//!    device so that ingest and overlap can be measured on any machine.
+//!
+//! \file
+//!    rbf_throttle.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __RBF_THROTTLE_H
+#define __RBF_THROTTLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fpga_loader.hpp"
+
+//!
+//! \brief
+//!    Storage throttle object
+//!
+//! \details
+//!    Reads are split into requests.  Each request pays an access latency,
+//!    varied by a uniform jitter, and draws its bytes from a token bucket
+//!    that refills at the device bandwidth.  The bucket holds one burst of
+//!    bytes, which models the read-ahead of the device.  The jitter uses a
+//!    fixed seed so that runs can be compared.
+//!
+//!    The throttle can wrap another source, in which case the data is
+//!    delayed as it is streamed to the FPGA, or delay() can be called
+//!    directly by code that reads an image ahead of time.
+//!
+
+class rbf_throttle_t : public rbf_source_t {
+
+    public:
+
+        //!
+        //! \brief
+        //!    Storage device profile
+        //!
+
+        struct profile_t {
+            const char *name;                   //!< Profile name
+            double bandwidth;                   //!< Bytes per second
+            double latency;                     //!< Access latency per request in seconds
+            double jitter;                      //!< Maximum latency variation in seconds
+            size_t request;                     //!< Request size in bytes
+            size_t burst;                       //!< Token bucket size in bytes
+        };
+
+        static const profile_t profiles[];      //!< Built-in profiles
+        static bool parse(const char *spec, profile_t &profile);
+
+    private:
+
+        profile_t profile;                      //!< Device being emulated
+        rbf_source_t *source;                   //!< Wrapped source or NULL
+        const uint32_t *pending;                //!< Unread part of the current chunk
+        size_t remaining;                       //!< Words left in the current chunk
+        double tokens;                          //!< Bytes available without waiting
+        uint64_t last_ns;                       //!< Time the bucket was last filled
+        uint64_t delay_ns;                      //!< Total time spent throttled
+        uint32_t seed;                          //!< Jitter generator state
+
+    public:
+
+        rbf_throttle_t(const profile_t &profile);
+        void attach(rbf_source_t &source);
+        void delay(size_t bytes);
+        size_t next(const uint32_t **chunk);
+        bool good(void);
+
+        //!
+        //! \brief
+        //!    Total time spent throttled in nanoseconds.
+        //!
+
+        uint64_t throttled_ns(void) const {
+            return delay_ns;
+        }
+
+        //!
+        //! \brief
+        //!    Profile being emulated.
+        //!
+
+        const profile_t &device(void) const {
+            return profile;
+        }
+
+};
+
+#endif
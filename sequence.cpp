@@ -0,0 +1,501 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Test sequencer
+//!
+//! \file
+//!    sequence.cpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//!
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "device_lock.hpp"
+#include "fpga_loader.hpp"
+#include "fpga_sim.hpp"
+#include "fpga_status.hpp"
+#include "rbf_fingerprint.hpp"
+#include "rbf_stager.hpp"
+#include "sequence.hpp"
+
+//!
+//! \brief
+//!    Constructor
+//!
+
+sequence_t::sequence_t(fpga_io_t &io) :
+    io(io),
+    naive_reloads(0),
+    tests(0) {
+}
+
+//!
+//! \brief
+//!    Read the matrix file.
+//!
+//! \param[in] filename
+//!    Name of the matrix file.
+//!
+//! \returns
+//!    True if the matrix is valid.
+//!
+
+bool sequence_t::configure(const char *filename) {
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        perror(PROGNAME);
+        return false;
+    }
+
+    std::string last;
+    char line[1024];
+    for (int lineno = 1; fgets(line, sizeof(line), fp); lineno++) {
+
+        char *p = line;
+        while (isspace(*p)) {
+            p++;
+        }
+        if ((*p == 0) || (*p == '#')) {
+            continue;
+        }
+
+        char *image = p;
+        while (*p && !isspace(*p)) {
+            p++;
+        }
+        if (*p) {
+            *p++ = 0;
+        }
+        while (isspace(*p)) {
+            p++;
+        }
+        char *end = p + strlen(p);
+        while ((end > p) && isspace(end[-1])) {
+            *--end = 0;
+        }
+        if (*p == 0) {
+            fprintf(stderr, "%s: %s:%d: missing test command.\n", PROGNAME, filename, lineno);
+            fclose(fp);
+            return false;
+        }
+
+        //
+        // Count the reloads the matrix order would need
+        //
+
+        if (last != image) {
+            naive_reloads++;
+            last = image;
+        }
+
+        size_t i;
+        for (i = 0; i < groups.size(); i++) {
+            if (groups[i].image == image) {
+                break;
+            }
+        }
+        if (i == groups.size()) {
+            group_t group;
+            group.image  = image;
+            group.loaded = false;
+            groups.push_back(group);
+        }
+
+        test_t test;
+        test.command = p;
+        test.status  = -1;
+        test.secs    = 0;
+        groups[i].tests.push_back(test);
+        tests++;
+    }
+
+    fclose(fp);
+
+    if (tests == 0) {
+        fprintf(stderr, "%s: %s: no tests.\n", PROGNAME, filename);
+        return false;
+    }
+
+    return true;
+}
+
+//!
+//! \brief
+//!    Print the order in which the tests will be run.
+//!
+
+void sequence_t::plan(void) {
+    for (size_t i = 0; i < groups.size(); i++) {
+        printf("load %s\n", groups[i].image.c_str());
+        for (size_t j = 0; j < groups[i].tests.size(); j++) {
+            printf("    %s\n", groups[i].tests[j].command.c_str());
+        }
+    }
+    printf("%s: %zu tests, %zu reloads (matrix order would need %zu)\n", PROGNAME,
+           tests, groups.size(), naive_reloads);
+}
+
+//!
+//! \brief
+//!    Program each image and run its tests.
+//!
+//! \param[in] lockfile
+//!    Device lock file.
+//!
+//! \param[in] lock_timeout
+//!    Maximum time to wait for the device lock in seconds.
+//!
+//! \param[in] simulate
+//!    The FPGA is simulated so the device lock is not needed.
+//!
+//! \param[in] statefile
+//!    Record of the loaded image that is forgotten before each load, or NULL.
+//!
+//! \param[in] statusfile
+//!    Status page that each load is published to, or NULL.
+//!
+//! \param[in] stage_budget
+//!    Memory allowed for images that are staged ahead, in bytes.
+//!
+//! \param[in] throttle
+//!    Storage device to emulate while staging, or NULL.
+//!
+//! \param[in] debug
+//!    Print debug messages.
+//!
+//! \param[in] quiet
+//!    Only print the summary.
+//!
+//! \returns
+//!    EXIT_SUCCESS if every image was programmed and every test passed.
+//!
+
+int sequence_t::run(const char *lockfile, unsigned int lock_timeout, bool simulate,
+                    const char *statefile, const char *statusfile, size_t stage_budget,
+                    const rbf_throttle_t::profile_t *throttle, bool debug, bool quiet) {
+
+    uint64_t start     = now_ns();
+    uint64_t wait_ns   = 0;
+    uint64_t load_ns   = 0;
+    uint64_t test_ns   = 0;
+    size_t   passed    = 0;
+    size_t   failed    = 0;
+    size_t   skipped   = 0;
+
+    //
+    // Stage the images in the order they are programmed
+    //
+
+    rbf_stager_t stager(stage_budget, throttle);
+    for (size_t i = 0; i < groups.size(); i++) {
+        stager.add(groups[i].image);
+    }
+
+    fpga_status_t fpga_status;
+    if (statusfile) {
+        fpga_status.open(statusfile, true);
+    }
+
+    for (size_t i = 0; i < groups.size(); i++) {
+
+        group_t &group = groups[i];
+
+        //
+        // Wait for the image
+        //
+
+        rbf_stager_t::staged_t staged = stager.take(&wait_ns);
+        rbf_image_t &image = staged.image;
+        if (debug && image.valid()) {
+            printf("%s: staged %s: %zu bytes, hash %016llx, %s, %.3f ms\n", PROGNAME, group.image.c_str(),
+                   image.size(), (unsigned long long)staged.hash, staged.pinned ? "pinned" : "not pinned",
+                   staged.stage_ns * 1e-6);
+        }
+
+        if (!image.valid()) {
+            fprintf(stderr, "%s: %s: skipping %zu tests.\n", PROGNAME, group.image.c_str(), group.tests.size());
+            skipped += group.tests.size();
+            continue;
+        }
+
+        //
+        // Program the image
+        //
+
+        device_lock_t device_lock;
+        if (!simulate && !device_lock.lock(lockfile, lock_timeout, quiet)) {
+            fprintf(stderr, "%s: %s: skipping %zu tests.\n", PROGNAME, group.image.c_str(), group.tests.size());
+            skipped += group.tests.size();
+            continue;
+        }
+
+        if (!quiet) {
+            printf("%s: programming %s\n", PROGNAME, group.image.c_str());
+            fflush(stdout);
+        }
+
+        if (statefile) {
+            rbf_fingerprint_t::forget(statefile);
+        }
+        fpga_status.publish(fpga_status_t::configuring, 0);
+
+        uint64_t t0 = now_ns();
+        rbf_buffer_t rbf_buffer = image.chunks();
+        fpga_loader_t fpga_loader(io);
+        group.loaded = (fpga_loader.loadFPGA(rbf_buffer, debug) == EXIT_SUCCESS);
+        load_ns += now_ns() - t0;
+
+        if (group.loaded) {
+            fpga_status.publish(fpga_status_t::user, staged.hash);
+        } else {
+            fpga_status.publish(fpga_status_t::failed, 0);
+        }
+
+        if (!group.loaded) {
+            fprintf(stderr, "%s: %s: programming failed, skipping %zu tests.\n", PROGNAME,
+                    group.image.c_str(), group.tests.size());
+            skipped += group.tests.size();
+            continue;
+        }
+
+        io.enable_bridges();
+
+        //
+        // Run the tests
+        //
+
+        setenv("FPGA_LOADER_IMAGE", group.image.c_str(), 1);
+        if (!simulate) {
+            char pid[16];
+            snprintf(pid, sizeof(pid), "%d", (int)getpid());
+            setenv(LOCKHOLDER, pid, 1);
+        }
+        for (size_t j = 0; j < group.tests.size(); j++) {
+            test_t &test = group.tests[j];
+            fflush(stdout);
+            t0 = now_ns();
+            int ret = system(test.command.c_str());
+            test.secs = (now_ns() - t0) * 1e-9;
+            test_ns += now_ns() - t0;
+            test.status = ((ret != -1) && WIFEXITED(ret)) ? WEXITSTATUS(ret) : -1;
+            if (test.status == 0) {
+                passed++;
+            } else {
+                failed++;
+            }
+            if (!quiet || (test.status != 0)) {
+                printf("%s: %s %s: %s (%.3f s)\n", PROGNAME, (test.status == 0) ? "PASS" : "FAIL",
+                       group.image.c_str(), test.command.c_str(), test.secs);
+            }
+        }
+        unsetenv("FPGA_LOADER_IMAGE");
+        unsetenv(LOCKHOLDER);
+    }
+
+    //
+    // Summary
+    //
+
+    size_t reloads = groups.size();
+    printf("%s: %zu tests: %zu passed, %zu failed, %zu skipped\n", PROGNAME, tests, passed, failed, skipped);
+    printf("%s: %zu reloads (matrix order would need %zu, saved %zu)\n", PROGNAME, reloads,
+           naive_reloads, naive_reloads - reloads);
+    printf("%s: time: staging wait %.3f s, programming %.3f s, tests %.3f s, total %.3f s\n", PROGNAME,
+           wait_ns * 1e-9, load_ns * 1e-9, test_ns * 1e-9, (now_ns() - start) * 1e-9);
+
+    return ((failed == 0) && (skipped == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//!
+//! \brief
+//!    The <tt>sequence</tt> command.
+//!
+//! \param[in] argc
+//!    argc is the number of arguments provided.
+//!
+//! \param[in] argv
+//!    argv is an array of arguments.  argv[0] is the command name.
+//!
+//! \returns
+//!    EXIT_SUCCESS or EXIT_FAILURE
+//!
+
+int sequence_t::main(int argc, char *argv[]) {
+
+    const char *usage =
+        "\n"
+        "usage: " PROGNAME " sequence [options] matrix_file\n"
+        "\n"
+        "Run a matrix of tests, programming each image once.  Each line of the\n"
+        "matrix file is an rbf file followed by a shell command that tests it.\n"
+        "\n"
+        "Valid options are:\n"
+        "  --debug         Print debug messages.\n"
+        "  --dry-run       Print the order of the loads and tests and exit.\n"
+        "  --help          Print help message and exit.\n"
+        "  --lockfile=file Device lock file (default " LOCKFILE ").\n"
+        "  --lock-timeout=seconds\n"
+        "                  Skip an image if the FPGA is busy for longer than this.\n"
+        "  --quiet         Only print failures and the summary.\n"
+        "  --simulate      Program a simulated FPGA instead of the hardware.\n"
+        "  --stage-budget=MB\n"
+        "                  Memory for images staged ahead of the one in use\n"
+        "                  (default 64).  At least one image is always staged.\n"
+        "  --state-file=file\n"
+        "                  Record of the loaded image (default " STATEFILE ").\n"
+        "  --status-file=file\n"
+        "                  Status page that each load is published to (default\n"
+        "                  " STATUSFILE ").  See \"status\".\n"
+        "  --throttle=profile\n"
+        "                  Stage the images at the speed of a slow storage device:\n"
+        "                  sd-slow, sd, sd-fast, usb, or MB/s[:latency_ms[:jitter_ms]].\n"
+        "\n";
+
+    static const struct option options[] = {
+        {"help",     no_argument,       0, 0},  // 0
+        {"debug",    no_argument,       0, 0},  // 1
+        {"dry-run",  no_argument,       0, 0},  // 2
+        {"lockfile", required_argument, 0, 0},  // 3
+        {"lock-timeout", required_argument, 0, 0}, // 4
+        {"quiet",    no_argument,       0, 0},  // 5
+        {"simulate", no_argument,       0, 0},  // 6
+        {"stage-budget", required_argument, 0, 0}, // 7
+        {"throttle", required_argument, 0, 0},  // 8
+        {"state-file", required_argument, 0, 0}, // 9
+        {"status-file", required_argument, 0, 0}, // 10
+        {0,          0,                 0, 0},  // 11
+    };
+
+    int index = 0;
+    bool debug = false;
+    bool dry_run = false;
+    const char *lockfile = LOCKFILE;
+    unsigned int lock_timeout = 0;
+    bool quiet = false;
+    bool simulate = false;
+    size_t stage_budget = 64;
+    const char *statefile = NULL;
+    const char *statusfile = NULL;
+    rbf_throttle_t::profile_t throttle = {};
+    bool throttled = false;
+    opterr = 0;
+    for (;;) {
+        int ret = getopt_long(argc, argv, "", options, &index);
+        if (ret == -1) {
+            break;
+        } else if (ret == '?') {
+            printf("%s: unrecognized option: %s\n", PROGNAME, argv[optind-1]);
+            printf(usage);
+            return EXIT_FAILURE;
+        } else {
+            switch(index) {
+                case 0:
+                    printf(usage);
+                    return EXIT_SUCCESS;
+                case 1:
+                    debug = true;
+                    break;
+                case 2:
+                    dry_run = true;
+                    break;
+                case 3:
+                    lockfile = optarg;
+                    break;
+                case 4:
+                    lock_timeout = strtoul(optarg, NULL, 0);
+                    break;
+                case 5:
+                    quiet = true;
+                    break;
+                case 6:
+                    simulate = true;
+                    break;
+                case 7:
+                    stage_budget = strtoul(optarg, NULL, 0);
+                    break;
+                case 8:
+                    if (!rbf_throttle_t::parse(optarg, throttle)) {
+                        return EXIT_FAILURE;
+                    }
+                    throttled = true;
+                    break;
+                case 9:
+                    statefile = optarg;
+                    break;
+                case 10:
+                    statusfile = optarg;
+                    break;
+            }
+        }
+    }
+
+    if (argv[optind] == NULL) {
+        printf("%s: missing matrix file\n", PROGNAME);
+        printf(usage);
+        return EXIT_FAILURE;
+    }
+
+    fpga_io_t fpga_hw;
+    fpga_sim_t fpga_sim;
+    fpga_io_t &fpga_io = simulate ? fpga_sim : fpga_hw;
+
+    sequence_t sequence(fpga_io);
+    if (!sequence.configure(argv[optind])) {
+        return EXIT_FAILURE;
+    }
+
+    if (dry_run) {
+        sequence.plan();
+        return EXIT_SUCCESS;
+    }
+
+    if (!fpga_io.open()) {
+        return EXIT_FAILURE;
+    }
+
+    //
+    // A simulated FPGA publishes only to the files it is given
+    //
+
+    if (!simulate && !statefile) {
+        statefile = STATEFILE;
+    }
+    if (!simulate && !statusfile) {
+        statusfile = STATUSFILE;
+    }
+
+    return sequence.run(lockfile, lock_timeout, simulate, statefile, statusfile,
+                        stage_budget * 1024 * 1024, throttled ? &throttle : NULL, debug, quiet);
+}
@@ -0,0 +1,116 @@
+//******************************************************************************
+//
+//  KS10 Console Microcontroller
+//
+//! \brief
+//!    Test sequencer header file
+//!
+//! \details
+//!    The <tt>sequence</tt> command programs each image of an image by test
+//!    matrix once and runs all of the tests that need it.
+//!
+//! \file
+//!    sequence.hpp
+//!
+//! \author
+//!    Rob Doyle - doyle (at) cox (dot) net
+//
+//******************************************************************************
+//
+// Copyright (C) 2022 Rob Doyle
+//
+// This file is part of the KS10 FPGA Project
+//
+// The KS10 FPGA project is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or (at your option) any
+// later version.
+//
+// The KS10 FPGA project is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this software.  If not, see <http://www.gnu.org/licenses/>.
+//
+//******************************************************************************
+//
+
+#ifndef __SEQUENCE_H
+#define __SEQUENCE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fpga_io.hpp"
+#include "rbf_image.hpp"
+#include "rbf_throttle.hpp"
+
+//!
+//! \brief
+//!    Test sequencer object
+//!
+//! \details
+//!    The matrix file has one test per line: the rbf file, then the shell
+//!    command that tests it.  Blank lines and lines that start with '#' are
+//!    ignored.
+//!
+//!    The tests are grouped by image, in the order that each image first
+//!    appears, so that each image is programmed exactly once.  The images
+//!    that follow are staged by rbf_stager_t while the current image is
+//!    programmed and tested.  The tests are run with FPGA_LOADER_IMAGE set
+//!    to the name of the image and with the bridges enabled.  The device
+//!    lock is held while an image and its tests run.
+//!
+//!    The tests run with FPGA_LOADER_LOCK_HOLDER set to the PID of the
+//!    sequencer, so "fpga_loader io", "profile-mmio" and loads started by
+//!    a test use the lock that the sequencer holds instead of waiting for
+//!    it.  Any other tool that takes the lock must not be used as a test.
+//!
+
+class sequence_t {
+
+    private:
+
+        //!
+        //! \brief
+        //!    One test
+        //!
+
+        struct test_t {
+            std::string command;                //!< Shell command
+            int status;                         //!< Exit status
+            double secs;                        //!< Run time
+        };
+
+        //!
+        //! \brief
+        //!    One image and its tests
+        //!
+
+        struct group_t {
+            std::string image;                  //!< rbf file
+            std::vector<test_t> tests;          //!< Tests in matrix order
+            bool loaded;                        //!< Programmed successfully
+        };
+
+        fpga_io_t &io;                          //!< HPS register access
+        std::vector<group_t> groups;            //!< Tests grouped by image
+        size_t naive_reloads;                   //!< Reloads in matrix order
+        size_t tests;                           //!< Number of tests
+
+    public:
+
+        sequence_t(fpga_io_t &io);
+        bool configure(const char *filename);
+        void plan(void);
+        int run(const char *lockfile, unsigned int lock_timeout, bool simulate,
+                const char *statefile, const char *statusfile, size_t stage_budget,
+                const rbf_throttle_t::profile_t *throttle, bool debug, bool quiet);
+        static int main(int argc, char *argv[]);
+
+};
+
+#endif